@@ -2,12 +2,67 @@
 Author - Hardik Suhag
 
 Compilation Environment:
-Use any linux distribution with GNU compiler on or after C++ 14 ( >= GCC 6.3)
+Use any linux distribution with GNU compiler on or after C++ 17 ( >= GCC 8)
 
 To compile program use:-
-$g++ assembler.cpp -o assembler
+$g++ -std=c++17 assembler.cpp -o assembler -pthread
 $./assembler COPY.txt
 
+To assemble many files at once with a pool of 8 threads use:-
+$./assembler -j 8 a.asm b.asm c.asm
+
+To split both passes of a large file over 8 threads use:-
+$./assembler -t 8 BIG.txt
+
+To reuse the outputs of sources assembled before, kept in a cache directory, use:-
+$./assembler --cache=.asmcache COPY.txt
+
+To assemble a file again every time it is saved, reusing the unchanged lines, use:-
+$./assembler --watch COPY.txt
+
+To keep assemblers resident and send them requests from a thin client use:-
+$./assembler --daemon &
+$g++ -std=c++17 -O2 assembler_client.cpp -o assembler_client -pthread
+$./assembler_client COPY.txt
+
+To print the time, allocations and table probes of each phase as JSON use:-
+$./assembler --stats=json COPY.txt 2> stats.json
+
+To read, parse, encode and write at the same time on 4 threads use:-
+$./assembler --pipeline BIG.txt
+
+To assemble in a single streaming pass (object program only) use:-
+$./assembler --one-pass COPY.txt
+
+To write only the object program, to a file of your choice, use:-
+$./assembler --emit=obj --obj-file=prog.obj COPY.txt
+
+To also write the object program in the binary format, or to convert between the two, use:-
+$./assembler --emit=obj,bin COPY.txt
+$./assembler --convert output_object_program.txt prog.bin
+
+To assemble a SIC/XE program (#, @, +, BASE and the registers B, S, T, F) use:-
+$./assembler COPYXE.txt
+
+Literals (=C'EOF', =X'05', =3) are placed in pools after LTORG or before END, one copy per content:-
+$./assembler COPYLIT.txt
+
+Operands can be expressions (BUFFER+3, *-2), EQU defines a symbol (MAXLEN EQU BUFEND-BUFFER) and ORG moves the location counter:-
+$./assembler COPYEXP.txt
+
+To remove redundant loads, thread jumps and turn calls ending a subroutine into jumps use:-
+$./assembler -O COPY.txt
+
+Control sections start at CSECT, EXTDEF and EXTREF name the symbols they share (D, R and M records). To link separately assembled ones use:-
+$./assembler --link copy.obj rdrec.obj wrrec.obj
+
+To run a program on the SIC/XE simulator, with files standing in for its devices, use:-
+$./assembler --run COPY.txt --device=F1:input.txt --device=05:output.txt
+
+To find where a program spends its time, as a report annotating its source, use:-
+$./assembler --run --profile COPY.txt
+$cat execution_profile.txt
+
 To view 'Intermediate File', 'Assembly listing' or 'Output Object Program' use:-
 $cat intermediate_file.txt
 $cat assembly_listing.txt
@@ -16,6 +71,10 @@ $cat output_object_program.txt
 To view how the code works and its documentation, open the 'readme.txt' file:-
 $cat readme.txt
 
+The assembler can also be embedded as a library. Construct an 'assembler'
+object and call assemble() with the source text; the object program, listing
+and diagnostics are returned in memory and nothing is written to disk.
+
 */
 
 #include <iostream>
@@ -23,29 +82,125 @@ $cat readme.txt
 #include <algorithm>
 #include <vector>
 #include <unordered_map>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <csignal>
+#include <sstream>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 using namespace std;
 
 // assembler settings
+#define ASM_VERSION "1.22" // part of every cache key, change it when the outputs of the assembler change
 #define SHOW_W_LINBL 0
 #define INDENT "\t\t"
 #define PRG_DFLTN "UNTITL"
 #define IMD_FNAME "intermediate_file.txt"
 #define ALS_FNAME "assembly_listing.txt"
+#define ALS_HEADER "Obj" INDENT "Location\n\n" // first lines of the assembly listing
 #define OBJ_FNAME "output_object_program.txt"
+#define BIN_FNAME "output_object_program.bin"
+#define IMD_FEXTN ".imd" // batch mode output extensions, replace the source's extension
+#define ALS_FEXTN ".lst"
+#define OBJ_FEXTN ".obj"
+#define BIN_FEXTN ".bin"
+#define OBJ_NAMES 6 // names a D or R record holds at most
+#define OBJ_CHUNK (1<<16) // one-pass mode hands object records to its sink in chunks of this size
+#define SRC_CHUNK (1<<18) // smallest piece of source handled by one thread in each pass
+#define SYM_BLOCK (1<<16) // symbol names are copied into blocks of this size
+#define PIPE_BATCH (1<<16) // pipelined mode reads the source in batches of about this many bytes
+#define PIPE_DEPTH 8 // batches each stage of the pipelined mode can run ahead of the next
+#define OUT_BUFFER (1<<20) // bytes an output writer gathers before writing them
+#define CACHE_LIMIT (256LL<<20) // bytes of entries a build cache keeps unless given another limit
+#define SIM_MEMORY (1<<15) // bytes of memory of the simulated SIC machine
+#define SIM_HALT 0xFFFFFF // return address the simulator starts a program with, returning to it halts
+#define DEV_FEXTN ".dev" // the simulator's device XX reads or writes the file XX.dev unless given another
+#define PRF_FNAME "execution_profile.txt" // report of a profiled run
+#define PRF_HOTSP 20 // lines listed as hot spots in the report
+#define WATCH_POLL 10 // milliseconds between the checks of --watch for a changed source
+#define DMN_SOCKET "sic_assembler.sock" // socket of the daemon in $XDG_RUNTIME_DIR or DMN_SOCKDIR, unless SIC_ASSEMBLER_SOCKET names another
+#define DMN_SOCKDIR "/tmp/sic_assembler-%u" // directory of the socket for a user id without $XDG_RUNTIME_DIR, only the user may enter it
+#define DMN_MAGIC "SICDMN02" // first field of every request to the daemon, the last two are the version of the protocol
+#define DMN_MAXMSG (1<<30) // bytes of the largest message the daemon and its clients accept
+
+// type of operands
+enum operand_type : unsigned char {
+	O_NOOPD, // no operand
+	O_LABEL, // label
+	O_INDXD, // indexed, label,X
+	O_DECIM, // decimal
+	O_HEXAD, // hexadecimal, X'..'
+	O_CHRAR, // character array, C'..'
+	O_REGS,  // registers of a format 2 instruction, r1,r2
+	O_LITRL, // literal, =C'..', =X'..' or =value
+	O_EXPRS, // expression of symbols, decimal numbers and *, like BUFEND-BUFFER or *+3
+	O_NAMES  // comma separated names of EXTDEF and EXTREF, like BUFFER,LENGTH
+};
 
-// macros for type of operands
-#define O_NOOPD "no operand"
-#define O_LABEL "label"
-#define O_INDXD "indexed"
-#define O_DECIM "decimal"
-#define O_HEXAD "hexadecimal"
-#define O_CHRAR "character array"
+// addressing of a format 3/4 operand (SIC/XE), given by a prefix
+enum addressing_mode : unsigned char {
+	A_SIMPLE, // label
+	A_IMMEDIATE, // #label or #value, the operand is the address itself
+	A_INDIRECT // @label, the operand is at the address held there
+};
+
+// interned mnemonics, an instruction keeps one of these ids instead of the text
+enum mnemonic_id : unsigned char {
+	M_NONE,
+	// assembler directives
+	M_START, M_END, M_BYTE, M_WORD, M_RESB, M_RESW, M_BASE, M_NOBASE, M_LTORG, M_EQU, M_ORG,
+	M_CSECT, M_EXTDEF, M_EXTREF,
+	// operations
+	M_LDA, M_LDX, M_LDL, M_STA, M_STX, M_STL, M_LDCH, M_STCH,
+	M_ADD, M_SUB, M_MUL, M_DIV, M_COMP,
+	M_J, M_JLT, M_JEQ, M_JGT, M_JSUB, M_RSUB,
+	M_TIX, M_TD, M_RD, M_WD,
+	// operations of SIC/XE only, formats 3/4, 2 and 1
+	M_LDB, M_LDS, M_LDT, M_LDF, M_STB, M_STS, M_STT, M_STF, M_STI, M_STSW,
+	M_AND, M_OR, M_ADDF, M_SUBF, M_MULF, M_DIVF, M_COMPF, M_LPS, M_SSK,
+	M_ADDR, M_SUBR, M_MULR, M_DIVR, M_COMPR, M_RMO, M_CLEAR, M_SHIFTL, M_SHIFTR, M_TIXR, M_SVC,
+	M_FIX, M_FLOAT, M_NORM, M_HIO, M_SIO, M_TIO,
+	M_COUNT
+};
 
 // ERROR STATEMENTS =>
 // file related errors
 #define E_NOARG "No input file provided"
 #define E_NOFIL "Can't open the input file, perhaps the name was wrong?"
-#define E_NOIMD "Can't locate the intermediate assembly file, perhaps it was relocated or deleted?"
+#define E_NORED "Can't read the input file"
+#define E_NOWRT(fname) (string("Can't write the output file <") + string(fname) + string(">"))
+#define E_BADJB "Invalid batch mode arguments, use '-j <number of threads> <input files...>'"
+#define E_BADOP(option) (string("Invalid command line option <") + string(option) + string(">"))
+#define E_BADOB "The file is not an object program, in either the text or the binary format"
+#define E_BADDV(option) (string("Invalid device <") + string(option) + string(">, use '--device=<hex device number>:<file>'"))
+#define E_BADCH(dir) (string("Can't use the cache directory <") + string(dir) + string(">"))
+#define E_BADSK(socket) (string("Can't listen on the socket <") + string(socket) + string(">"))
+#define E_DMDIR(dir) (string("The directory <") + string(dir) + string("> of the daemon's socket must belong to you alone"))
+#define E_DMRUN(socket) (string("A daemon is already listening on the socket <") + string(socket) + string(">"))
+#define E_BADST "Statistics are only available for a single file assembled in two passes, use '--stats=json <input file>'"
 
 // pass - 1 => Errors in <START>, <END> statements
 #define E_NOFST "The first instruction is not a START instruction, use the format '<label> START <address>'"
@@ -66,23 +221,59 @@ using namespace std;
 #define E_WGIDX "Incorrect usage of indexed addressing. Only the index regsiter X is permitted"
 #define E_NALNM "The symbol is not an alphanumeric starting with a letter"
 #define E_SMFMT "Invalid operand syntax"
+#define E_NOFM4 "Only operations of format 3 have the extended format 4, remove the '+'"
+#define E_XEIDX "Indexed addressing can't be combined with immediate (#) or indirect (@) addressing"
+#define E_F2OPD(opn, form) (string("The instruction <") + string(opn) + string("> expects the operand '") + string(form) + string("', the registers are A, X, L, B, S, T, F, PC and SW"))
+#define E_NOOPD(opn) (string("The instruction <") + string(opn) + string("> expects no operand. One provided"))
+#define E_BASOP "<BASE> only accepts a label, whose address the base register holds"
+#define E_LTFMT "Invalid literal, use =C'<characters>' or =X'<hexadecimal bytes>' of at most 30 bytes, or =<decimal word>"
+#define E_LTADR "A literal can't be indexed or combined with immediate (#) or indirect (@) addressing"
+#define E_EXFMT "Invalid expression, use symbols, decimal numbers and * (the location counter) joined by +, -, * and / with parentheses"
+#define E_EQLBL "<EQU> defines the symbol in its label, one is required"
+#define E_DFOPD "<EQU> and <ORG> only accept a symbol, a decimal number or an expression"
+#define E_CSLBL "<CSECT> starts a control section named by its label, one is required"
+#define E_EXNAM "The names of control sections and external symbols are at most 6 characters long"
 
 // pass - 2 => syntax errors and structural errors
 #define E_RWNDM "<RESW> and <RESB> only accept numeric (decimal) operands"
-#define E_WDNDM "<WORD> assembler directive only accepts numeric (decimal) operands"
+#define E_WDNDM "<WORD> assembler directive only accepts numeric (decimal) operands, symbols or expressions"
+#define E_EXREL "The expression is neither absolute nor relative, its addresses must pair up as +A-B, with at most one left over, and can't be multiplied or divided"
+#define E_EXDIV "Division by zero in the expression"
+#define E_EXOUT "The value of the expression is out of bounds"
+#define E_DFCYC "The value of the <EQU> or <ORG> depends on itself, through the symbols of its expression"
+#define E_ORGRS "<ORG> without an operand restores the location counter of before the previous <ORG>, there is none"
 #define E_DTERR "Constants require data in decimal/hexadecimal/charater-array formats"
 #define E_DTOUT "Constant's data is out of bounds. Word is 3 bytes long and Byte is 1 byte long"
 #define E_RSUBO "The instruction <RSUB> expects no operand. One provided"
 #define E_DNALW "Direct addressing is not allowed in Sic, you must specify label or variable names"
+#define E_IMOUT "Immediate or indirect value out of bounds, format 3 takes at most 4095 and format 4 at most 1048575"
+#define E_NORCH(symbol) (string("The address of <") + string(symbol) + string("> is out of reach of PC and base relative addressing, use format 4 (+)"))
 #define E_INVSY(symbol) ((string("No variable named <")+string(symbol))+string("> was declared in the program"))
 #define E_ENDOP "Invalid operand for the <END> intruction. Please specify the label of the first instruction to execute"
+#define E_EXUSE "An external symbol (EXTREF) can only be added to or subtracted from the operand of an operation or a <WORD>"
+#define E_EXDEF(symbol) (string("The symbol <") + string(symbol) + string("> of <EXTDEF> must be an address defined in its control section"))
 
 // other errors
 #define E_LOCLG "Starting address of program too large for the entire program to fit into memory, try reducing it in the START instruction"
 #define E_INTRL "Syntax error, please correct syntax and try again."
+#define E_XEMOD "SIC/XE instructions need both passes, the one-pass and pipelined modes only assemble SIC programs"
+#define E_LTMOD "Literals and <LTORG> need both passes, the one-pass and pipelined modes don't place literal pools"
+#define E_EXMOD "Expressions, <EQU> and <ORG> need both passes, the one-pass and pipelined modes only take plain symbols"
+
+// linking loader errors
+#define E_LKOBJ(fname) (string("The file <") + string(fname) + string("> is not a text object program of control sections"))
+#define E_LKDUP(symbol) (string("The external symbol <") + string(symbol) + string("> is defined by more than one control section"))
+#define E_LKUND(symbol) (string("The external symbol <") + string(symbol) + string("> isn't defined by any control section"))
+#define E_LKMEM "The linked program doesn't fit in memory, its control sections are loaded one after another from the starting address of the first"
 
-// warning flags
-bool fl_empty_lines;
+// simulator errors, at the address of the instruction that failed
+#define E_SIMMEM "The program doesn't fit in the 32K memory of the SIC machine"
+#define E_SIMOPC(pc, opcode) (string("Invalid opcode <") + hex_string(opcode, 2) + string("> at address <") + hex_string(pc, 4) + string(">"))
+#define E_SIMADR(pc, ta) (string("Address <") + hex_string(ta, 6) + string("> is outside memory, used at address <") + hex_string(pc, 4) + string(">"))
+#define E_SIMDIV(pc) (string("Division by zero at address <") + hex_string(pc, 4) + string(">"))
+#define E_SIMDEV(dev, fname) (string("Device <") + hex_string(dev, 2) + string("> can't use the file <") + string(fname) + string(">"))
+#define E_SIMLIM "Instruction limit reached, the program was stopped"
+#define E_SIMUNS(pc, opcode) (string("The operation <") + hex_string(opcode, 2) + string("> at address <") + hex_string(pc, 4) + string("> isn't supported by the simulator"))
 
 // Warning Statements
 #define W_LINBL "The program contains one or more non-empty blank lines"
@@ -93,155 +284,824 @@ bool fl_empty_lines;
 // Declaration of the instruction class
 class instruction;
 
-// file streams
-ifstream assembly_program;
-ofstream intermediate_file_w;
-ifstream intermediate_file_r;
-ofstream assembly_listing;
-ofstream object_program;
-
-// data structures
-unordered_map <string, int> OPTAB;
-unordered_map <string, int> SYMTAB;
-unordered_map <string, int> DIRECTIVES;
-
-// global program information variables
-int program_starting_address;
-int first_executable_instruction;
-int length_of_program;
-string program_name;
-
-// global variables
-string input_file_name;
-vector<instruction> program;
-
-// prints errors to standard output
-void error(string error_string, string* err_ins=NULL, int ln = 0){
-	cout << "Error: " << error_string << "\n";
-	if(err_ins){
-		cout << "line-" << ln << ">\t" << *err_ins << "\n";
+enum mnemonic_kind : unsigned char { K_NONE, K_DIRECTIVE, K_OPERATION };
+
+// the mnemonic table, indexed by mnemonic_id
+struct mnemonic_info{
+	string_view name;
+	mnemonic_kind kind;
+	int opcode; // operations only
+	int format; // 1, 2 or 3 (3 and 4 in SIC/XE), operations only
+	bool xe; // SIC/XE only, a program using it is assembled as SIC/XE
+};
+constexpr mnemonic_info MNEMONICS[M_COUNT] = {
+	{"", K_NONE, 0, 0, false},
+	{"START", K_DIRECTIVE, 0, 0, false}, {"END", K_DIRECTIVE, 0, 0, false}, 
+	{"BYTE", K_DIRECTIVE, 0, 0, false}, {"WORD", K_DIRECTIVE, 0, 0, false}, 
+	{"RESB", K_DIRECTIVE, 0, 0, false}, {"RESW", K_DIRECTIVE, 0, 0, false},
+	{"BASE", K_DIRECTIVE, 0, 0, true}, {"NOBASE", K_DIRECTIVE, 0, 0, true}, {"LTORG", K_DIRECTIVE, 0, 0, false},
+	{"EQU", K_DIRECTIVE, 0, 0, false}, {"ORG", K_DIRECTIVE, 0, 0, false},
+	{"CSECT", K_DIRECTIVE, 0, 0, true}, {"EXTDEF", K_DIRECTIVE, 0, 0, true}, {"EXTREF", K_DIRECTIVE, 0, 0, true},
+	{"LDA", K_OPERATION, 0x00, 3, false}, {"LDX", K_OPERATION, 0x04, 3, false}, {"LDL", K_OPERATION, 0x08, 3, false},
+	{"STA", K_OPERATION, 0x0c, 3, false}, {"STX", K_OPERATION, 0x10, 3, false}, {"STL", K_OPERATION, 0x14, 3, false},
+	{"LDCH", K_OPERATION, 0x50, 3, false}, {"STCH", K_OPERATION, 0x54, 3, false},
+	{"ADD", K_OPERATION, 0x18, 3, false}, {"SUB", K_OPERATION, 0x1c, 3, false}, 
+	{"MUL", K_OPERATION, 0x20, 3, false}, {"DIV", K_OPERATION, 0x24, 3, false},
+	{"COMP", K_OPERATION, 0x28, 3, false},
+	{"J", K_OPERATION, 0x3c, 3, false}, {"JLT", K_OPERATION, 0x38, 3, false}, 
+	{"JEQ", K_OPERATION, 0x30, 3, false}, {"JGT", K_OPERATION, 0x34, 3, false},
+	{"JSUB", K_OPERATION, 0x48, 3, false}, {"RSUB", K_OPERATION, 0x4c, 3, false},
+	{"TIX", K_OPERATION, 0x2c, 3, false},
+	{"TD", K_OPERATION, 0xe0, 3, false}, {"RD", K_OPERATION, 0xd8, 3, false}, {"WD", K_OPERATION, 0xdc, 3, false},
+	{"LDB", K_OPERATION, 0x68, 3, true}, {"LDS", K_OPERATION, 0x6c, 3, true}, {"LDT", K_OPERATION, 0x74, 3, true},
+	{"LDF", K_OPERATION, 0x70, 3, true}, {"STB", K_OPERATION, 0x78, 3, true}, {"STS", K_OPERATION, 0x7c, 3, true},
+	{"STT", K_OPERATION, 0x84, 3, true}, {"STF", K_OPERATION, 0x80, 3, true}, {"STI", K_OPERATION, 0xd4, 3, true},
+	{"STSW", K_OPERATION, 0xe8, 3, true}, {"AND", K_OPERATION, 0x40, 3, true}, {"OR", K_OPERATION, 0x44, 3, true},
+	{"ADDF", K_OPERATION, 0x58, 3, true}, {"SUBF", K_OPERATION, 0x5c, 3, true}, {"MULF", K_OPERATION, 0x60, 3, true},
+	{"DIVF", K_OPERATION, 0x64, 3, true}, {"COMPF", K_OPERATION, 0x88, 3, true}, {"LPS", K_OPERATION, 0xd0, 3, true},
+	{"SSK", K_OPERATION, 0xec, 3, true},
+	{"ADDR", K_OPERATION, 0x90, 2, true}, {"SUBR", K_OPERATION, 0x94, 2, true}, {"MULR", K_OPERATION, 0x98, 2, true},
+	{"DIVR", K_OPERATION, 0x9c, 2, true}, {"COMPR", K_OPERATION, 0xa0, 2, true}, {"RMO", K_OPERATION, 0xac, 2, true},
+	{"CLEAR", K_OPERATION, 0xb4, 2, true}, {"SHIFTL", K_OPERATION, 0xa4, 2, true}, {"SHIFTR", K_OPERATION, 0xa8, 2, true},
+	{"TIXR", K_OPERATION, 0xb8, 2, true}, {"SVC", K_OPERATION, 0xb0, 2, true},
+	{"FIX", K_OPERATION, 0xc4, 1, true}, {"FLOAT", K_OPERATION, 0xc0, 1, true}, {"NORM", K_OPERATION, 0xc8, 1, true},
+	{"HIO", K_OPERATION, 0xf4, 1, true}, {"SIO", K_OPERATION, 0xf0, 1, true}, {"TIO", K_OPERATION, 0xf8, 1, true}
+};
+
+// registers of SIC/XE by number, as named in format 2 operands (6 is F, 7 has no name)
+constexpr string_view REGISTER_NAMES[10] = {"A", "X", "L", "B", "S", "T", "F", "", "PC", "SW"};
+
+// perfect hash of the mnemonic table, built by the compiler. the seed is searched
+// until every mnemonic lands in its own slot, so a lookup is one hash and one compare
+#define MN_HSIZE 512 // slots in the hash table, a power of 2
+#define MN_MAXLN 6 // longest mnemonic
+
+constexpr unsigned mnemonic_hash(string_view word, unsigned seed){ // FNV-1a
+	unsigned h = 2166136261u ^ seed;
+	for(char c: word) h = (h ^ (unsigned char)c) * 16777619u;
+	return h & (MN_HSIZE-1);
+}
+
+struct mnemonic_hash_table{
+	unsigned seed;
+	mnemonic_id slots[MN_HSIZE]; // M_NONE if empty
+};
+
+constexpr mnemonic_hash_table build_mnemonic_hash_table(){
+	for(unsigned seed = 0; ; seed++){
+		mnemonic_hash_table table = {seed, {}};
+		bool collision = false;
+		for(int id = 1; id<M_COUNT && !collision; id++){
+			unsigned slot = mnemonic_hash(MNEMONICS[id].name, seed);
+			if(table.slots[slot] != M_NONE) collision = true;
+			else table.slots[slot] = (mnemonic_id)id;
+		}
+		if(!collision) return table;
 	}
-	exit(0);
 }
 
-// prints warnings to standard output
-void warning(string warning_string, string* err_ins=NULL, int ln=0){
-	cout << "Warning: " << warning_string << "\n";
-	if(err_ins){
-		cout << "line-" << ln << ">\t" << *err_ins << "\n";
+constexpr mnemonic_hash_table MNEMONIC_HASH = build_mnemonic_hash_table();
+
+// the mnemonic_id of a word, M_NONE if it isn't a mnemonic
+constexpr mnemonic_id find_mnemonic(string_view word){
+	if(word.size() > MN_MAXLN) return M_NONE;
+	mnemonic_id id = MNEMONIC_HASH.slots[mnemonic_hash(word, MNEMONIC_HASH.seed)];
+	return (MNEMONICS[id].name == word) ? id : M_NONE;
+}
+static_assert(find_mnemonic("STCH") == M_STCH && find_mnemonic("SHIFTL") == M_SHIFTL && find_mnemonic("LDD") == M_NONE,
+	"mnemonic hash table is broken");
+
+bool is_operation(mnemonic_id mnemonic){ return MNEMONICS[mnemonic].kind == K_OPERATION; }
+
+// the load of the register a store writes to memory, M_NONE if mnemonic isn't such a store
+mnemonic_id load_of_store(mnemonic_id mnemonic){
+	switch(mnemonic){
+		case M_STA: return M_LDA;
+		case M_STX: return M_LDX;
+		case M_STL: return M_LDL;
+		case M_STCH: return M_LDCH;
+		case M_STB: return M_LDB;
+		case M_STS: return M_LDS;
+		case M_STT: return M_LDT;
+		case M_STF: return M_LDF;
+		default: return M_NONE;
+	}
+}
+
+// an operation writing a register to memory
+bool is_store(mnemonic_id mnemonic){ return load_of_store(mnemonic) != M_NONE || mnemonic == M_STI || mnemonic == M_STSW; }
+
+// an error or warning raised while assembling a program
+struct diagnostic{
+	bool is_error;
+	string message;
+	string line_text; // source text of the offending line (empty if none)
+	int line_number; // source line number of the offending line (0 if none)
+
+	string to_string() const { // same format the assembler has always printed
+		string q = (is_error ? "Error: " : "Warning: ") + message + "\n";
+		if(line_number) q += "line-" + std::to_string(line_number) + ">\t" + line_text + "\n";
+		return q;
+	}
+};
+
+// thrown by error(), caught by assembler::assemble()
+class assembly_error: public exception{
+public:
+	diagnostic diag;
+	assembly_error(diagnostic diag): diag(diag) {}
+	const char* what() const noexcept { return diag.message.c_str(); }
+};
+
+// the outputs of an assembly. which ones are produced is given by a mask of
+// their bits, (1<<OUT_LISTING) etc
+enum output_kind { OUT_INTERMEDIATE, OUT_LISTING, OUT_OBJECT, OUT_BINARY, OUT_COUNT };
+constexpr int EMIT_DEFAULT = (1<<OUT_INTERMEDIATE) | (1<<OUT_LISTING) | (1<<OUT_OBJECT);
+constexpr const char* OUTPUT_NAMES[OUT_COUNT] = {"intermediate", "listing", "obj", "bin"}; // as given to --emit
+
+// everything produced by one run of the assembler, kept in memory
+struct assembly_result{
+	bool success; // false if an error stopped the assembly
+	string intermediate_file;
+	string assembly_listing;
+	string object_program;
+	string object_binary; // the object program in the binary format, see binary_header
+	vector<diagnostic> diagnostics; // warnings, followed by the error if any
+};
+
+// instrumentation. an assembler given an assembly_stats times each phase of the
+// assembly in it, along with the events counted below. without one (the default)
+// the only cost is a test of a flag per phase and per counted event
+
+// phases of an assembly, in the order they run
+enum stats_phase { P_READ, P_TOKENIZE, P_LOCATE, P_SYMBOLS, P_ENCODE, P_FORMAT, P_RECORDS, P_WRITE, P_COUNT };
+constexpr const char* PHASE_NAMES[P_COUNT] = {"read", "tokenize", "locate", "symbols", "encode", "format", "records", "write"};
+
+// allocations are counted by a replaced operator new, only in a build with
+// -DASM_COUNT_ALLOCATIONS (see below). the others report them as null
+#ifdef ASM_COUNT_ALLOCATIONS
+constexpr bool COUNT_ALLOCATIONS = true;
+#else
+constexpr bool COUNT_ALLOCATIONS = false;
+#endif
+
+// events counted while a phase runs, totals over all threads
+struct event_counts{
+	long long allocations; // calls of operator new, in a build with -DASM_COUNT_ALLOCATIONS
+	long long allocated_bytes;
+	long long symtab_probes; // slots of the symbol table looked at
+	long long optab_probes; // lookups in the mnemonic perfect hash, one slot each
+};
+
+struct phase_stats{
+	double wall_seconds;
+	double cpu_seconds; // of the whole process, all threads
+	event_counts events;
+};
+
+// the literal pools of a program
+struct literal_counts{
+	int pools; // LTORGs and END with literals placed after them
+	int literals; // placed, one per distinct content
+	int uses; // operands using a literal
+	int bytes; // of the pools
+	int bytes_used; // of a copy per use, the bytes saved by deduplication are bytes_used-bytes
+};
+
+// the rewrites of the peephole optimizer (-O)
+struct peephole_counts{
+	int loads; // loads of the word just stored from the same register, removed
+	int jumps; // jumps to an unconditional jump, sent to its target instead
+	int tail_calls; // JSUB, LDL, RSUB ending a subroutine, made LDL and J
+	int bytes; // of the lines removed, before any relaxation
+};
+
+struct assembly_stats{
+	phase_stats phases[P_COUNT] = {};
+	long peak_rss_kb = 0; // of the process, at the end of the last phase
+	long long cache_hits = 0, cache_misses = 0; // lookups in the build cache, if one is used
+	literal_counts literals = {};
+	peephole_counts peephole = {};
+
+	string to_json() const {
+		phase_stats total = {};
+		string json = "{\n  \"phases\": {\n";
+		for(int p = 0; p<P_COUNT; p++){
+			json += string("    \"") + PHASE_NAMES[p] + "\": " + phase_json(phases[p]) + (p+1<P_COUNT ? ",\n" : "\n");
+			total.wall_seconds += phases[p].wall_seconds;
+			total.cpu_seconds += phases[p].cpu_seconds;
+			total.events.allocations += phases[p].events.allocations;
+			total.events.allocated_bytes += phases[p].events.allocated_bytes;
+			total.events.symtab_probes += phases[p].events.symtab_probes;
+			total.events.optab_probes += phases[p].events.optab_probes;
+		}
+		json += "  },\n  \"total\": " + phase_json(total) + ",\n";
+		json += "  \"peak_rss_kb\": " + std::to_string(peak_rss_kb) + ",\n";
+		json += "  \"literals\": {\"pools\": " + std::to_string(literals.pools) + ", \"literals\": " + std::to_string(literals.literals)
+			+ ", \"uses\": " + std::to_string(literals.uses) + ", \"bytes\": " + std::to_string(literals.bytes)
+			+ ", \"saved_bytes\": " + std::to_string(literals.bytes_used - literals.bytes) + "},\n";
+		json += "  \"peephole\": {\"loads\": " + std::to_string(peephole.loads) + ", \"jumps\": " + std::to_string(peephole.jumps)
+			+ ", \"tail_calls\": " + std::to_string(peephole.tail_calls) + ", \"saved_bytes\": " + std::to_string(peephole.bytes) + "},\n";
+		json += "  \"cache\": {\"hits\": " + std::to_string(cache_hits) + ", \"misses\": " + std::to_string(cache_misses) + "}\n}\n";
+		return json;
+	}
+
+	static string phase_json(const phase_stats& phase){
+		char allocations[64] = "null, \"allocated_bytes\": null", buffer[256];
+		if(COUNT_ALLOCATIONS){
+			snprintf(allocations, sizeof(allocations), "%lld, \"allocated_bytes\": %lld", phase.events.allocations, phase.events.allocated_bytes);
+		}
+		snprintf(buffer, sizeof(buffer), "{\"wall_s\": %.6f, \"cpu_s\": %.6f, \"allocations\": %s, "
+			"\"symtab_probes\": %lld, \"optab_probes\": %lld}", phase.wall_seconds, phase.cpu_seconds,
+			allocations, phase.events.symtab_probes, phase.events.optab_probes);
+		return buffer;
+	}
+};
+
+// events are counted per thread while a phase is timed (count_events is set on
+// the thread of the timer and on the workers it starts in parallel_for) and added
+// to the process totals by flush_event_counts(), which every thread of a phase
+// calls before the phase ends. threads of other jobs never count, so the totals
+// belong to the timed assembly alone
+thread_local bool count_events = false;
+thread_local event_counts thread_events;
+atomic<long long> total_events[4];
+
+void flush_event_counts(){
+	total_events[0] += thread_events.allocations;
+	total_events[1] += thread_events.allocated_bytes;
+	total_events[2] += thread_events.symtab_probes;
+	total_events[3] += thread_events.optab_probes;
+	thread_events = {};
+}
+
+// allocations are only counted in a build with -DASM_COUNT_ALLOCATIONS, which
+// replaces operator new for the whole process
+#ifdef ASM_COUNT_ALLOCATIONS
+void* operator new(size_t size){
+	if(count_events){
+		thread_events.allocations++;
+		thread_events.allocated_bytes += size;
+	}
+	void* p = malloc(size ? size : 1);
+	if(!p) throw bad_alloc();
+	return p;
+}
+void* operator new[](size_t size){ return operator new(size); }
+// not inlined, so that the compiler sees delete paired with new rather than with malloc
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+#endif
+
+inline double cpu_seconds(){
+	timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// adds the time and events from its construction to its destruction to a phase
+// of stats, or up to next() which moves on to another phase. does nothing if
+// stats is NULL
+class phase_timer{
+public:
+	assembly_stats* stats;
+	stats_phase phase;
+	chrono::steady_clock::time_point wall_begin;
+	double cpu_begin;
+	long long events_begin[4];
+	bool running;
+
+	phase_timer(assembly_stats* stats, stats_phase phase): stats(stats), running(false){ start(phase); }
+	~phase_timer(){ stop(); }
+
+	void next(stats_phase next_phase){
+		stop();
+		start(next_phase);
+	}
+
+	void start(stats_phase start_phase){
+		phase = start_phase;
+		if(!stats) return;
+		running = count_events = true;
+		flush_event_counts();
+		for(int e = 0; e<4; e++) events_begin[e] = total_events[e];
+		cpu_begin = cpu_seconds();
+		wall_begin = chrono::steady_clock::now();
+	}
+
+	void stop(){
+		if(!running) return;
+		running = count_events = false;
+		phase_stats& ps = stats->phases[phase];
+		ps.wall_seconds += chrono::duration<double>(chrono::steady_clock::now() - wall_begin).count();
+		ps.cpu_seconds += cpu_seconds() - cpu_begin;
+		flush_event_counts();
+		ps.events.allocations += total_events[0] - events_begin[0];
+		ps.events.allocated_bytes += total_events[1] - events_begin[1];
+		ps.events.symtab_probes += total_events[2] - events_begin[2];
+		ps.events.optab_probes += total_events[3] - events_begin[3];
+		rusage usage;
+		if(getrusage(RUSAGE_SELF, &usage) == 0) stats->peak_rss_kb = usage.ru_maxrss;
+	}
+};
+
+// aborts the current assembly with an error
+void error(string error_string, const string_view* err_ins=NULL, int ln = 0){
+	if(err_ins) throw assembly_error({true, error_string, string(*err_ins), ln});
+	throw assembly_error({true, error_string, "", 0});
+}
+
+// hexadecimal formatting. every hex digit the assembler writes goes through
+// put_hex/put_hex_bytes, which write fixed width text straight into a buffer
+// owned by the caller and return the position just past what they wrote
+
+// the two hex digits of every byte
+struct hex_pair_table{
+	char pairs[256][2];
+	constexpr hex_pair_table(): pairs(){
+		const char digits[] = "0123456789ABCDEF";
+		for(int b = 0; b<256; b++){
+			pairs[b][0] = digits[b >> 4];
+			pairs[b][1] = digits[b & 15];
+		}
+	}
+};
+constexpr hex_pair_table HEX_PAIRS;
+
+// the value of every hex digit, either case, and -1 for other characters
+struct hex_value_table{
+	signed char values[256];
+	constexpr hex_value_table(): values(){
+		for(int c = 0; c<256; c++) values[c] = -1;
+		for(int d = 0; d<10; d++) values['0'+d] = d;
+		for(int d = 0; d<6; d++) values['A'+d] = values['a'+d] = 10+d;
+	}
+};
+constexpr hex_value_table HEX_VALUES;
+
+// writes num as exactly size hex digits (the high digits are dropped if it doesn't fit)
+inline char* put_hex(char* out, unsigned num, int size){
+	char* p = out + size;
+	while(p - out >= 2){
+		p -= 2;
+		p[0] = HEX_PAIRS.pairs[num & 0xff][0];
+		p[1] = HEX_PAIRS.pairs[num & 0xff][1];
+		num >>= 8;
+	}
+	if(p != out) out[0] = HEX_PAIRS.pairs[num & 15][1];
+	return out + size;
+}
+
+// num as exactly size hex digits, for messages
+inline string hex_string(unsigned num, int size){
+	string out(size, '0');
+	put_hex(&out[0], num, size);
+	return out;
+}
+
+// writes 2*count hex digits, 16 bytes at a time with SSE2 where available
+inline char* put_hex_bytes(char* out, const unsigned char* bytes, size_t count){
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i low_nibble = _mm_set1_epi8(0x0f);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i zero_char = _mm_set1_epi8('0');
+	const __m128i letter_gap = _mm_set1_epi8('A' - '0' - 10);
+	for(; i+16 <= count; i += 16){
+		__m128i in = _mm_loadu_si128((const __m128i*)(bytes+i));
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(in, 4), low_nibble);
+		__m128i lo = _mm_and_si128(in, low_nibble);
+		// digit = nibble + '0', plus the gap up to 'A' for nibbles above 9
+		hi = _mm_add_epi8(_mm_add_epi8(hi, zero_char), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letter_gap));
+		lo = _mm_add_epi8(_mm_add_epi8(lo, zero_char), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letter_gap));
+		_mm_storeu_si128((__m128i*)(out + 2*i), _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i*)(out + 2*i + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+#endif
+	for(; i<count; i++){
+		out[2*i] = HEX_PAIRS.pairs[bytes[i]][0];
+		out[2*i+1] = HEX_PAIRS.pairs[bytes[i]][1];
+	}
+	return out + 2*count;
+}
+
+// reads 2*count hex digits into count bytes, false if one isn't a hex digit
+inline bool get_hex_bytes(const char* hex, size_t count, unsigned char* out){
+	int invalid = 0;
+	for(size_t i = 0; i<count; i++){
+		int hi = HEX_VALUES.values[(unsigned char)hex[2*i]], lo = HEX_VALUES.values[(unsigned char)hex[2*i+1]];
+		invalid |= hi | lo; // negative if either is -1
+		out[i] = ((hi & 15) << 4) | (lo & 15);
+	}
+	return invalid >= 0;
+}
+
+// reserves n more chars at the end of a string and returns where they start
+inline char* grow(string& out, size_t n){
+	size_t old_size = out.size();
+	out.resize(old_size + n);
+	return &out[old_size];
+}
+
+// appends text to a buffer returned by grow()
+inline char* put_text(char* out, string_view text){
+	memcpy(out, text.data(), text.size());
+	return out + text.size();
+}
+
+// parses a whole string as a number in the given base, false if it isn't one
+bool parse_int(string_view str, int base, int& value){
+	const char* last = str.data() + str.size();
+	from_chars_result res = from_chars(str.data(), last, value, base);
+	return res.ec == errc() && res.ptr == last && str.size();
+}
+
+// the bytes of a literal operand into bytes, false if it isn't one. =C'..' holds its
+// characters, =X'..' a byte per two hexadecimal digits, both 1 to 30 bytes, and =value
+// a word of 3 bytes
+bool literal_bytes(string_view literal, string& bytes){
+	bytes.clear();
+	if(literal.size()<2 || literal[0]!='=') return false;
+	string_view body = literal.substr(1);
+	if(isdigit(body[0])){
+		int value;
+		if(!parse_int(body, 10, value) || value >= (1<<24)) return false;
+		for(int shift = 16; shift>=0; shift -= 8) bytes.push_back((value >> shift) & 0xff);
+		return true;
 	}
+	if(body.size()<4 || body[1]!='\'' || body.back()!='\'') return false;
+	string_view data = body.substr(2, body.size()-3);
+	if(body[0]=='C'){
+		if(data.find('\'') != string_view::npos) return false;
+		bytes.assign(data.data(), data.size());
+	}else if(body[0]=='X'){
+		if(data.size()%2) return false;
+		for(size_t j = 0; j<data.size(); j += 2){
+			int byte;
+			if(!parse_int(data.substr(j, 2), 16, byte) || byte<0) return false;
+			bytes.push_back(byte);
+		}
+	}else{
+		return false;
+	}
+	return bytes.size() <= 30;
+}
+
+// if an operand is an expression rather than a single symbol, number or constant
+inline bool is_expression(string_view operand){
+	return operand.find_first_of("+-*/()") != string_view::npos && operand.find('\'') == string_view::npos;
 }
 
-// for conversion of a number to hexadecimal string of specified size
-string to_hex(int num, int size){
-	string q = "";
-	while(num){
-		int rem = num%16;
-		num/=16;
-		if(rem<10) q.push_back('0'+rem);
-		else q.push_back(rem-10+'A');
+// the value of an expression and its type. relative counts the addresses in it, +1 for each
+// added and -1 for each subtracted: an expression is absolute (0), a number, or relative (1),
+// an address in the program that moves with it. anything else is an error. external is set
+// if it has an external symbol (EXTREF), whose address is only known to the linking loader
+struct expression_value{
+	int value;
+	int relative;
+	bool external;
+};
+
+// the external symbols of an expression, each with the sign it is added with (+1 or -1)
+typedef vector<pair<string_view, int>> external_terms;
+
+// recursive descent over an expression: terms are decimal numbers, symbols and * (the
+// location counter), joined by +, - and by * and / (integer division), which bind tighter,
+// with parentheses and unary minus. symbol_value(name, value) looks a symbol up and returns
+// the error, "" if there is none. values are kept within 24 bits, the size of a word.
+// with syntax_only set only the syntax is checked, every symbol is still looked up.
+// a symbol valued as external counts 0 and is added to externals with its sign, it is
+// an error if externals is NULL or the symbol is multiplied or divided
+template<class F> struct expression_parser{
+	string_view text;
+	size_t pos;
+	int star;
+	const F& symbol_value;
+	bool syntax_only;
+	bool uses_star;
+	string err; // the first error
+	external_terms* externals;
+	int sign; // of the term being parsed, flipped by each - it is under
+
+	expression_value fail(string message){
+		if(err.empty()) err = message;
+		pos = text.size();
+		return {0, 0, false};
 	}
-	while(q.size()<size) q.push_back('0');
-	reverse(q.begin(), q.end());
-	return q;
+	expression_value bounded(long long value, int relative, bool external = false){
+		if(!syntax_only && (value <= -(1<<24) || value >= (1<<24))) return fail(E_EXOUT);
+		return {(int)value, relative, external};
+	}
+	expression_value sum(){
+		expression_value a = product();
+		while(pos<text.size() && (text[pos]=='+' || text[pos]=='-')){
+			char op = text[pos++];
+			if(op=='-') sign = -sign;
+			expression_value b = product();
+			if(op=='-') sign = -sign;
+			if(op=='+') a = bounded((long long)a.value + b.value, a.relative + b.relative, a.external || b.external);
+			else a = bounded((long long)a.value - b.value, a.relative - b.relative, a.external || b.external);
+		}
+		return a;
+	}
+	expression_value product(){
+		expression_value a = factor();
+		while(pos<text.size() && (text[pos]=='*' || text[pos]=='/')){
+			char op = text[pos++];
+			expression_value b = factor();
+			if(syntax_only) continue;
+			if(a.relative || b.relative || a.external || b.external) return fail(E_EXREL);
+			if(op=='*') a = bounded((long long)a.value * b.value, 0);
+			else if(b.value == 0) return fail(E_EXDIV);
+			else a.value /= b.value;
+		}
+		return a;
+	}
+	expression_value factor(){
+		if(pos>=text.size()) return fail(E_EXFMT);
+		char c = text[pos];
+		if(c=='-'){
+			pos++;
+			sign = -sign;
+			expression_value a = factor();
+			sign = -sign;
+			return {-a.value, -a.relative, a.external};
+		}
+		if(c=='('){
+			pos++;
+			expression_value a = sum();
+			if(pos>=text.size() || text[pos]!=')') return fail(E_EXFMT);
+			pos++;
+			return a;
+		}
+		if(c=='*'){
+			pos++;
+			uses_star = true;
+			return {star, 1, false};
+		}
+		size_t end = pos;
+		if(isdigit(c)){
+			while(end<text.size() && isdigit(text[end])) end++;
+			int value;
+			if(!parse_int(text.substr(pos, end-pos), 10, value)) return fail(E_EXOUT);
+			pos = end;
+			return bounded(value, 0);
+		}
+		if(isalpha(c)){
+			while(end<text.size() && isalnum(text[end])) end++;
+			expression_value value = {0, 0, false};
+			string_view name = text.substr(pos, end-pos);
+			string message = symbol_value(name, value);
+			if(message.size()) return fail(message);
+			if(value.external){
+				if(!externals) return fail(E_EXUSE);
+				externals->push_back({name, sign});
+			}
+			pos = end;
+			return value;
+		}
+		return fail(E_EXFMT);
+	}
+};
+
+// evaluates an expression into value with * standing for star, returns the error, "" if
+// there is none (see expression_parser)
+template<class F> string evaluate_expression(string_view text, int star, const F& symbol_value, expression_value& value,
+	bool syntax_only = false, bool* uses_star = NULL, external_terms* externals = NULL){
+	expression_parser<F> parser = {text, 0, star, symbol_value, syntax_only, false, "", externals, 1};
+	value = parser.sum();
+	if(parser.pos != text.size()) parser.fail(E_EXFMT);
+	if(!syntax_only && value.relative != 0 && value.relative != 1) parser.fail(E_EXREL);
+	if(uses_star) *uses_star = parser.uses_star;
+	return parser.err;
+}
+
+// runs task(0) .. task(num_tasks-1) on up to num_threads threads, the calling thread
+// included. tasks must not throw
+void parallel_for(int num_tasks, int num_threads, const function<void(int)>& task){
+	atomic<int> next_task(0);
+	bool counting = count_events;
+	auto work = [&](){
+		count_events = counting;
+		for(int t = next_task++; t<num_tasks; t = next_task++) task(t);
+		if(count_events) flush_event_counts();
+	};
+	vector<thread> workers;
+	for(int i = 1; i<min(num_threads, num_tasks); i++) workers.push_back(thread(work));
+	work();
+	for(thread& w: workers) w.join();
+}
+
+// hash of a symbol name, computed once when its line is parsed. FNV-1a
+inline unsigned symbol_hash(string_view name){
+	unsigned h = 2166136261u;
+	for(char c: name) h = (h ^ (unsigned char)c) * 16777619u;
+	return h;
 }
 
+// the symbol table. names are copied once into an arena owned by the table and
+// found by open addressing over a flat array of slots that keep their hashes, so
+// a lookup with a precomputed hash is a single short probe. a symbol found is
+// known by its handle from then on
+class symbol_table{
+public:
+	typedef int handle; // index in symbols, -1 if there is no such symbol
+	struct symbol{
+		string_view name; // view of the arena
+		unsigned hash;
+		int value;
+	};
+	vector<symbol> symbols; // in the order they were inserted
+
+	symbol_table(){ clear(); }
+
+	void clear(){
+		symbols = {};
+		slots.assign(16, {0, -1});
+		arena.clear();
+		arena_left = 0;
+	}
+
+	// makes room for count symbols without growing
+	void reserve(size_t count){
+		symbols.reserve(count);
+		size_t cnt_slots = slots.size();
+		while(cnt_slots < 2*count) cnt_slots *= 2;
+		if(cnt_slots > slots.size()) rehash(cnt_slots);
+	}
+
+	handle find(string_view name, unsigned hash) const {
+		size_t mask = slots.size()-1;
+		size_t i;
+		for(i = hash & mask; slots[i].index>=0; i = (i+1) & mask){
+			if(slots[i].hash == hash && symbols[slots[i].index].name == name) break;
+		}
+		if(count_events) thread_events.symtab_probes += ((i - hash) & mask) + 1;
+		return slots[i].index;
+	}
+	handle find(string_view name) const { return find(name, symbol_hash(name)); }
+
+	// adds a symbol and returns its handle and true, or the handle of the
+	// symbol already named so and false
+	pair<handle, bool> insert(string_view name, unsigned hash, int value){
+		size_t mask = slots.size()-1;
+		size_t i;
+		for(i = hash & mask; slots[i].index>=0; i = (i+1) & mask){
+			if(slots[i].hash == hash && symbols[slots[i].index].name == name) break;
+		}
+		if(count_events) thread_events.symtab_probes += ((i - hash) & mask) + 1;
+		if(slots[i].index>=0) return {slots[i].index, false};
+		handle h = symbols.size();
+		symbols.push_back({intern(name), hash, value});
+		slots[i] = {hash, h};
+		if(2*symbols.size() > slots.size()) rehash(2*slots.size()); // at most half full
+		return {h, true};
+	}
+
+	int value(handle h) const { return symbols[h].value; }
+	void set_value(handle h, int value){ symbols[h].value = value; }
+	size_t size() const { return symbols.size(); }
+
+private:
+	struct slot{
+		unsigned hash;
+		handle index; // -1 if empty
+	};
+	vector<slot> slots; // a power of 2 of them
+	vector<unique_ptr<char[]>> arena; // the names, never moved once copied
+	char* arena_next;
+	size_t arena_left;
+
+	string_view intern(string_view name){
+		if(name.size() > arena_left){
+			size_t block = max<size_t>(SYM_BLOCK, name.size());
+			arena.push_back(unique_ptr<char[]>(new char[block]));
+			arena_next = arena.back().get();
+			arena_left = block;
+		}
+		if(name.size()) memcpy(arena_next, name.data(), name.size());
+		string_view copy(arena_next, name.size());
+		arena_next += name.size();
+		arena_left -= name.size();
+		return copy;
+	}
+
+	void rehash(size_t cnt_slots){
+		slots.assign(cnt_slots, {0, -1});
+		size_t mask = cnt_slots-1;
+		for(handle h = 0; h<(handle)symbols.size(); h++){
+			size_t i = symbols[h].hash & mask;
+			while(slots[i].index>=0) i = (i+1) & mask;
+			slots[i] = {symbols[h].hash, h};
+		}
+	}
+};
+
 // definition of the instruction class
+// the text fields are views of the source buffer passed to assembler::assemble()
 class instruction{
 public:
-	string instruction_text; // source code text of instruction
+	string_view instruction_text; // source code text of instruction
 	int source_line_number; // line number of instruction in source code
 
-	string label;
-	string mnemonic;
-	string operand;
+	string_view label;
+	string_view operand;
+	string_view comment; // text of the comment
 
-	bool has_location; // only time an instruction has location but not size in memory is START
-	int location; // location of ins. in RAM
 	int size_in_memory; // size of ins. in RAM
-	bool has_object_code; // if the ins. has object code in RAM
-	string object_code; // object code of the ins. (set later)
-
+	unsigned label_hash, operand_hash; // symbol_hash of the label and of the symbol in the operand, if any
+	mnemonic_id mnemonic;
+	operand_type type_of_operand; // specifies the type of operand in line, after any addressing prefix
+	addressing_mode addressing; // of a format 3/4 operand
+	bool extended; // format 4, '+' before the mnemonic
+	bool indexed; // ,X after the operand, a label (O_INDXD) or an expression
+	bool is_xe; // uses anything of SIC/XE only
+	unsigned char r1, r2; // operands of format 2, registers or the count of SHIFTL/SHIFTR and the number of SVC
 	bool is_comment; // if the line is a comment
-	string comment; // text of the comment
-	string type_of_operand; /* specifies the type of operand in line. can be - 
-		O_NOOPD => "no operand"
-		O_LABEL => "label"
-		O_INDXD => "indexed"
-		O_DECIM => "decimal"
-		O_HEXAD => "hexadecimal"
-		O_CHRAR => "character array"
-	*/
-
 	bool is_blank; // if its a blank line
+	bool is_literal; // a line of a literal pool, placed by the assembler (see assembler::place_literals())
+	bool removed; // dropped by the peephole optimizer (see assembler::peephole()), listed without location or code
+
+	// the location and object code of a line are set by the passes, and kept by
+	// the assembler in arrays parallel to the program (see class assembler)
+
+	instruction(): source_line_number(0), size_in_memory(0), label_hash(0), operand_hash(0), mnemonic(M_NONE), type_of_operand(O_NOOPD), 
+		addressing(A_SIMPLE), extended(false), indexed(false), is_xe(false), r1(0), r2(0), is_comment(false), is_blank(true), is_literal(false), removed(false) {} // placeholder, to be assigned a parsed line
 
 	// constructor of instruction class
-	instruction(string line, int source_line_number){
+	instruction(string_view line, int source_line_number){
 
 		// set default values for member variables
 		this->source_line_number = source_line_number; instruction_text = line; 
-		label = ""; mnemonic = ""; operand = ""; 
-		has_object_code = false; has_location = false; location = -1; size_in_memory = 0; object_code = "";
+		label = ""; mnemonic = M_NONE; operand = ""; 
+		size_in_memory = 0; label_hash = operand_hash = 0;
 		is_comment = false; comment = ""; type_of_operand = O_NOOPD;
-		is_blank = 0;
+		addressing = A_SIMPLE; extended = false; indexed = false; is_xe = false; r1 = r2 = 0;
+		is_blank = 0; is_literal = false; removed = false;
 		int line_len = line.size();
 
 		// check if comment
 		for(int i = 0; i<line_len; i++){ // O(n) loop
 			if(isspace(line[i])) continue;
 			if(line[i] != '.') break;
-			for(int j = i+1; j<line_len; j++) comment.push_back(line[j]);
+			comment = line.substr(i+1);
 			is_comment = 1;
 			break;
 		}
 		if(is_comment) return;
 
-		// parse the line
-		vector<string> words = {""};
-		for(int i = 0; i<line_len; i++){
-			if(isspace(line[i])){
-				if(words.back().size()==0) continue;
-				words.push_back("");
-			}else{
-				words.back().push_back(line[i]);
-			}
+		// parse the line, only the first 4 words are kept (more than 3 is an error anyway)
+		string_view words[4];
+		int cnt_words = 0;
+		for(int i = 0; i<line_len; ){
+			if(isspace(line[i])){ i++; continue; }
+			int j = i;
+			while(j<line_len && !isspace(line[j])) j++;
+			if(cnt_words<4) words[cnt_words] = line.substr(i, j-i);
+			cnt_words++;
+			i = j;
 		}
-		while(words.size() && words.back().size()==0) words.pop_back();
 
-		if(words.size()==0){ // blank case
+		// a mnemonic, or one with the '+' of format 4
+		auto find_operation = [&](string_view word){
+			if(word.size()<2 || word[0]!='+') return find_mnemonic(word);
+			mnemonic_id id = find_mnemonic(word.substr(1));
+			if(id != M_NONE) extended = true;
+			return id;
+		};
+
+		if(count_events && cnt_words && cnt_words<=3) thread_events.optab_probes += (cnt_words==2) ? 2 : 1; // lookups below
+		if(cnt_words==0){ // blank case
 			is_blank = 1;
-			fl_empty_lines = true;
 			return;
-		}else if(words.size()==1){
+		}else if(cnt_words==1){
 			// it can only be a command (operation or directive)
-			if(DIRECTIVES.count(words[0])){
-				mnemonic = words[0];
-			}else if(OPTAB.count(words[0])){
-				mnemonic = words[0];
-			}else{
-				error(E_INVMN(words[0]), &(this->instruction_text), source_line_number);
-			}
-		}else if(words.size()==2){
-			int keyword_matches = (DIRECTIVES.count(words[0]) || OPTAB.count(words[0])); 
+			mnemonic = find_operation(words[0]);
+			if(mnemonic == M_NONE) error(E_INVMN(words[0]), &(this->instruction_text), source_line_number);
+		}else if(cnt_words==2){
+			mnemonic_id first = find_operation(words[0]);
+			mnemonic_id second = find_operation(words[1]);
+			int keyword_matches = (first != M_NONE); 
 			keyword_matches *= 10;
-			keyword_matches += (DIRECTIVES.count(words[1]) || OPTAB.count(words[1]));
+			keyword_matches += (second != M_NONE);
 			if(keyword_matches == 0) error(E_NOOPN, &(this->instruction_text), source_line_number);
 			else if(keyword_matches == 11) error(E_TWOMN, &(this->instruction_text), source_line_number);
 			else if(keyword_matches == 10){
-				mnemonic = words[0];
+				mnemonic = first;
 				operand = words[1];
 			}else if(keyword_matches == 1){
 				label = words[0];
-				mnemonic = words[1];
+				mnemonic = second;
 			}else{
 				error(E_INTRL, &(this->instruction_text), source_line_number);
 			}
-		}else if(words.size()==3){
+		}else if(cnt_words==3){
 			label = words[0];
-			mnemonic = words[1];
+			mnemonic = find_operation(words[1]);
 			operand = words[2];
-			if(!(OPTAB.count(mnemonic) || DIRECTIVES.count(mnemonic))) 
-				error(E_INVMN(mnemonic), &(this->instruction_text), source_line_number);
+			if(mnemonic == M_NONE) error(E_INVMN(words[1]), &(this->instruction_text), source_line_number);
 		}else{
 			error(E_MANYO, &(this->instruction_text), source_line_number);
 		}
@@ -250,72 +1110,144 @@ public:
 		// sanitizing label
 		if(label.size() && !is_label_format(label)) error(E_NALNM , &(this->instruction_text), source_line_number);
 
+		if(extended && (!is_operation(mnemonic) || MNEMONICS[mnemonic].format != 3))
+			error(E_NOFM4, &(this->instruction_text), source_line_number);
+		const int format = is_operation(mnemonic) ? MNEMONICS[mnemonic].format : 0;
+
+		// the addressing prefix of a format 3/4 operand, the rest is classified below
+		string_view opd = operand;
+		if(format == 3 && opd.size() && (opd[0]=='#' || opd[0]=='@')){
+			addressing = (opd[0]=='#') ? A_IMMEDIATE : A_INDIRECT;
+			opd.remove_prefix(1);
+			if(opd.empty()) error(E_SMFMT, &(this->instruction_text), source_line_number);
+		}
+
 		// sanitizing operand and setting type_of_operand
-		if(operand.size()){
+		if(format == 2){
+			parse_registers();
+		}else if(format == 1){
+			if(operand.size()) error(E_NOOPD(MNEMONICS[mnemonic].name), &(this->instruction_text), source_line_number);
+		}else if(mnemonic == M_EXTDEF || mnemonic == M_EXTREF){
+			if(operand.empty()) error(E_RSNOO(MNEMONICS[mnemonic].name), &(this->instruction_text), source_line_number);
+			for(string_view name: names()){
+				if(name.empty() || !is_label_format(name)) error(E_NALNM, &(this->instruction_text), source_line_number);
+				if(name.size() > 6) error(E_EXNAM, &(this->instruction_text), source_line_number);
+			}
+			type_of_operand = O_NAMES;
+		}else if(opd.size()){
 			int cnt_commas = 0;
 			int cnt_quotes = 0;
-			for(int j = 0; j<operand.size(); j++) cnt_commas += (operand[j] == ',');
-			for(int j = 0; j<operand.size(); j++) cnt_quotes += (operand[j]=='\'');
+			for(int j = 0; j<opd.size(); j++) cnt_commas += (opd[j] == ',');
+			for(int j = 0; j<opd.size(); j++) cnt_quotes += (opd[j]=='\'');
 
-			// first check for comma, then check for quotes, then check for starting letter, then alphanumeric for label
-			if(cnt_commas){ // comma case
-				int len = operand.size();
+			// first check for a literal, then expression, then comma, then quotes, then starting letter, then alphanumeric for label
+			string_view expr = opd;
+			if(format == 3 && expr.size()>2 && expr.substr(expr.size()-2) == ",X") expr.remove_suffix(2);
+			if(format == 3 && opd[0]=='='){ // literal case
+				if(addressing != A_SIMPLE) error(E_LTADR, &(this->instruction_text), source_line_number);
+				string bytes;
+				if(!literal_bytes(opd, bytes)){
+					bool indexed = opd.size()>2 && opd.substr(opd.size()-2) == ",X";
+					error(indexed ? E_LTADR : E_LTFMT, &(this->instruction_text), source_line_number);
+				}
+				type_of_operand = O_LITRL;
+			}else if(is_expression(expr)){ // expression case, its symbols are looked up by the passes
+				if(expr.size() < opd.size()){
+					if(addressing != A_SIMPLE) error(E_XEIDX, &(this->instruction_text), source_line_number);
+					indexed = true;
+				}
+				expression_value value;
+				auto any_symbol = [](string_view, expression_value&){ return string(); };
+				if(evaluate_expression(expr, 0, any_symbol, value, true).size()) error(E_EXFMT, &(this->instruction_text), source_line_number);
+				type_of_operand = O_EXPRS;
+			}else if(cnt_commas){ // comma case
+				int len = opd.size();
 
 				if(cnt_commas>1) error(E_SMFMT, &(this->instruction_text), source_line_number);
-				if(operand.size()<2 || !(operand[len-2]==',' && operand[len-1]=='X'))
+				if(opd.size()<2 || !(opd[len-2]==',' && opd[len-1]=='X'))
 					error(E_WGIDX, &(this->instruction_text), source_line_number);
-				if(!is_label_format(operand.substr(0,len-2))) error(E_NALNM, &(this->instruction_text), source_line_number);
+				if(addressing != A_SIMPLE) error(E_XEIDX, &(this->instruction_text), source_line_number);
+				if(!is_label_format(opd.substr(0,len-2))) error(E_NALNM, &(this->instruction_text), source_line_number);
 
 				type_of_operand = O_INDXD;
+				indexed = true;
 			}else if(cnt_quotes){ // quotes case
-				int len = operand.size();
+				int len = opd.size();
 
-				if(len<4 || (!(operand[1]=='\'' && operand[len-1]=='\''))) 
+				if(len<4 || (!(opd[1]=='\'' && opd[len-1]=='\''))) 
 					error(E_SMFMT, &(this->instruction_text), source_line_number);
 
-				if(operand[0]=='X') { // Hexadecimal case
+				if(opd[0]=='X') { // Hexadecimal case
 					type_of_operand = O_HEXAD;
-					for(char dig: operand) 
+					for(char dig: opd) 
 						if(!(isdigit(dig) || ('A'<=dig || dig<='F') )) 
 							error(E_SMFMT, &(this->instruction_text), source_line_number);
 				}
-				else if(operand[0]=='C') { // Character string case
+				else if(opd[0]=='C') { // Character string case
 					if(cnt_quotes>2) error(E_SMFMT, &(this->instruction_text), source_line_number);
-					for(char x: operand) if(x>255) error(E_SMFMT, &(this->instruction_text), source_line_number);
-					if(operand.size() > 33) error(E_STOUT ,&(this->instruction_text), source_line_number);
+					for(char x: opd) if(x>255) error(E_SMFMT, &(this->instruction_text), source_line_number);
+					if(opd.size() > 33) error(E_STOUT ,&(this->instruction_text), source_line_number);
 					type_of_operand = O_CHRAR;
 				} else {
 					error(E_SMFMT, &(this->instruction_text), source_line_number);
 				}
-			}else if(isdigit(operand[0])){ // decimal case
-				for(char dig: operand) if(!isdigit(dig)) error(E_NALNM, &(this->instruction_text), source_line_number);
+			}else if(isdigit(opd[0])){ // decimal case
+				for(char dig: opd) if(!isdigit(dig)) error(E_NALNM, &(this->instruction_text), source_line_number);
 				type_of_operand = O_DECIM;
 			}else{ // label case
-				if(!is_label_format(operand)) error(E_NALNM, &(this->instruction_text), source_line_number);
+				if(!is_label_format(opd)) error(E_NALNM, &(this->instruction_text), source_line_number);
 				type_of_operand = O_LABEL;
 			}
 		}
 
-		// finding the value of instruction's size in memory
-		if(OPTAB.count(mnemonic)){
-			size_in_memory = 3;
+		is_xe = MNEMONICS[mnemonic].xe || extended || addressing != A_SIMPLE;
+
+		// hashing the symbols here, so that the passes never hash a name
+		if(label.size()) label_hash = symbol_hash(label);
+		if(type_of_operand == O_LABEL || type_of_operand == O_INDXD || type_of_operand == O_LITRL) operand_hash = symbol_hash(operand_symbol());
+
+		// finding the value of instruction's size in memory. an operation of format 3
+		// starts out short, the assembler makes it format 4 if its address is out of
+		// reach (see assembler::relax()). a value too large for format 3 needs 4 at once
+		if(is_operation(mnemonic)){
+			size_in_memory = extended ? 4 : format;
+			if(addressing != A_SIMPLE && type_of_operand == O_DECIM){
+				int value;
+				if(!parse_int(opd, 10, value) || value >= (1<<20)) error(E_IMOUT, &(this->instruction_text), source_line_number);
+				if(value >= (1<<12)) size_in_memory = 4;
+			}
 		}else{
-			if(mnemonic == "START" || mnemonic == "END") return;
-			if(operand.size()==0) error(E_RSNOO(mnemonic), &(this->instruction_text), source_line_number);
-			if(mnemonic == "RESW") {
-				if(type_of_operand == O_HEXAD){
-					string data_hex = operand.substr(2,operand.size()-3);
-					size_in_memory = 3 * stoi(data_hex, NULL, 16);
-				} else 
-					size_in_memory = stoi(operand)*3;
-			} else if(mnemonic == "RESB") {
-				if(type_of_operand == O_HEXAD){
-					string data_hex = operand.substr(2,operand.size()-3);
-					size_in_memory = stoi(data_hex, NULL, 16);
-				} else 
-					size_in_memory = stoi(operand);
-			} else if(mnemonic == "WORD") size_in_memory = 3;
-			else if(mnemonic == "BYTE"){ // byte case
+			if(mnemonic == M_START || mnemonic == M_END || mnemonic == M_EXTDEF || mnemonic == M_EXTREF) return;
+			if(mnemonic == M_CSECT){ // located like START, from 0, see assembler::pass_1()
+				if(label.empty()) error(E_CSLBL, &(this->instruction_text), source_line_number);
+				if(label.size() > 6) error(E_EXNAM, &(this->instruction_text), source_line_number);
+				if(operand.size()) error(E_NOOPD(MNEMONICS[mnemonic].name), &(this->instruction_text), source_line_number);
+				return;
+			}
+			if(mnemonic == M_NOBASE || mnemonic == M_LTORG){
+				if(operand.size()) error(E_NOOPD(MNEMONICS[mnemonic].name), &(this->instruction_text), source_line_number);
+				return;
+			}
+			if(mnemonic == M_EQU || mnemonic == M_ORG){ // valued once the symbols are known, see assembler::resolve_definitions()
+				if(mnemonic == M_EQU && label.empty()) error(E_EQLBL, &(this->instruction_text), source_line_number);
+				if(mnemonic == M_EQU && operand.empty()) error(E_RSNOO(MNEMONICS[mnemonic].name), &(this->instruction_text), source_line_number);
+				if(operand.size() && type_of_operand != O_LABEL && type_of_operand != O_DECIM && type_of_operand != O_EXPRS)
+					error(E_DFOPD, &(this->instruction_text), source_line_number);
+				return;
+			}
+			if(operand.size()==0) error(E_RSNOO(MNEMONICS[mnemonic].name), &(this->instruction_text), source_line_number);
+			if(mnemonic == M_RESW || mnemonic == M_RESB) {
+				int reserved;
+				bool parsed;
+				if(type_of_operand == O_HEXAD) parsed = parse_int(operand.substr(2,operand.size()-3), 16, reserved);
+				else parsed = parse_int(operand, 10, reserved);
+				if(!parsed) error(E_RWNDM, &(this->instruction_text), source_line_number);
+				if(mnemonic == M_RESW) size_in_memory = 3 * reserved;
+				else size_in_memory = reserved;
+			} else if(mnemonic == M_BASE){
+				if(type_of_operand != O_LABEL) error(E_BASOP, &(this->instruction_text), source_line_number);
+			} else if(mnemonic == M_WORD) size_in_memory = 3;
+			else if(mnemonic == M_BYTE){ // byte case
 				if(type_of_operand == O_HEXAD){
 					size_in_memory = 1;
 				}else if(type_of_operand == O_CHRAR){
@@ -329,472 +1261,4663 @@ public:
 		}
 	}
 	
-	bool is_label_format(string str){ // if str is alphanumeric starting with a letter or not
+	// the registers of a format 2 operand into r1 and r2
+	void parse_registers(){
+		const char* form = (mnemonic == M_CLEAR || mnemonic == M_TIXR) ? "r1" : (mnemonic == M_SVC) ? "n"
+			: (mnemonic == M_SHIFTL || mnemonic == M_SHIFTR) ? "r1,n" : "r1,r2";
+		size_t comma = operand.find(',');
+		string_view first = operand.substr(0, comma), second = (comma == string_view::npos) ? "" : operand.substr(comma+1);
+		auto find_register = [](string_view name){
+			for(int r = 0; r<10; r++) if(name.size() && REGISTER_NAMES[r] == name) return r;
+			return -1;
+		};
+		int a = -1, b = 0;
+		if(mnemonic == M_SVC){
+			if(comma != string_view::npos || !parse_int(first, 10, a) || a > 15) a = -1;
+		}else if(form[2] == 0){
+			if(comma == string_view::npos) a = find_register(first);
+		}else if(comma != string_view::npos){
+			a = find_register(first);
+			if(form[3] == 'n'){
+				if(!parse_int(second, 10, b) || b < 1 || b > 16) a = -1;
+				b--; // the count less one is encoded
+			}else{
+				b = find_register(second);
+			}
+		}
+		if(a < 0 || b < 0) error(E_F2OPD(MNEMONICS[mnemonic].name, form), &(this->instruction_text), source_line_number);
+		r1 = a;
+		r2 = b;
+		type_of_operand = O_REGS;
+	}
+
+	// the symbol or expression of an operand, without the addressing prefix and index
+	string_view operand_symbol() const {
+		string_view symbol = operand;
+		if(addressing != A_SIMPLE) symbol.remove_prefix(1);
+		if(indexed) symbol.remove_suffix(2);
+		return symbol;
+	}
+
+	// the names of an EXTDEF or EXTREF operand, in order
+	vector<string_view> names() const {
+		vector<string_view> list;
+		for(size_t begin = 0; begin <= operand.size(); ){
+			size_t end = min(operand.find(',', begin), operand.size());
+			list.push_back(operand.substr(begin, end-begin));
+			begin = end+1;
+		}
+		return list;
+	}
+
+	bool uses_literals() const { return type_of_operand == O_LITRL || mnemonic == M_LTORG; }
+	bool uses_sections() const { return mnemonic == M_CSECT || mnemonic == M_EXTDEF || mnemonic == M_EXTREF; }
+	bool uses_expressions() const {
+		return type_of_operand == O_EXPRS || mnemonic == M_EQU || mnemonic == M_ORG || (mnemonic == M_WORD && type_of_operand == O_LABEL);
+	}
+
+	bool is_label_format(string_view str){ // if str is alphanumeric starting with a letter or not
 		if(str.size()==0) error(E_INTRL);
 		if(!isalpha(str[0])) return 0;
 		for(int j = 1; j<str.size(); j++) if(!isalnum(str[j])) return 0;
 		return 1;
 	}
 
-	string to_string(){ // converts an instruction back to its string, including location
-		string indent = INDENT;
-		if(is_blank) return("\n"); // blank line case
-		else if(is_comment){ // comment case
-			string q = ".";
-			for(char x: indent) q.push_back(x);
-			for(char x: comment) q.push_back(x);
-			q.push_back('\n');
-			return q;
-			//intermediate_file_w << "." << INDENT << comment << "\n";
+	// appends the instruction, including its location (-1 if none), to out
+	void append_to(string& out, int location){
+		const string_view indent = INDENT;
+		if(is_blank){ // blank line case
+			out.push_back('\n');
+		}else if(is_comment){ // comment case
+			char* p = grow(out, 2 + indent.size() + comment.size());
+			*p++ = '.';
+			p = put_text(p, indent);
+			p = put_text(p, comment);
+			*p = '\n';
 		}else{
-			string loc_str = "";
-			if(has_location && location>=0) {// to account for START case haslocation=T,location=F
-				if(location>=(2<<15)) error(E_LOCLG);
-				loc_str = to_hex(location,4); // convert the location to a 4 digit hex string
-			}
-			else loc_str = "None";
-			string q = "";
-			for(char x: string("Loc-")) q.push_back(x);
-			for(char x: loc_str) q.push_back(x);
-			for(char x: indent) q.push_back(x);
-			for(char x: label) q.push_back(x);
-			for(char x: indent) q.push_back(x);
-			for(char x: mnemonic) q.push_back(x);
-			for(char x: indent) q.push_back(x);
-			for(char x: operand) q.push_back(x);
-			q.push_back('\n');
-			return q;
-			//intermediate_file_w << loc_str << INDENT << label << INDENT << mnemonic << INDENT << operand << "\n";
-		}
-		error(E_INTRL);
-		return("");
-	}
-};
-
-// the text record class
-class text_record{
-public:
-	int total_length;
-	int starting_address;
-	vector<string> records; // to be separated by carets
-	text_record(int str_addr){
-		starting_address = str_addr;
-		records = {};
-		total_length = 0;
+			if(location>=(2<<15)) error(E_LOCLG);
+			// a literal pool line is listed as '*' and the literal in place of the mnemonic
+			string_view label_text = is_literal ? "*" : label, name = is_literal ? operand : MNEMONICS[mnemonic].name;
+			string_view operand_text = is_literal ? "" : operand;
+			char* p = grow(out, 9 + extended + 3*indent.size() + label_text.size() + name.size() + operand_text.size());
+			p = put_text(p, "Loc-");
+			if(location>=0) p = put_hex(p, location, 4); // the location as a 4 digit hex string
+			else p = put_text(p, "None");
+			p = put_text(p, indent);
+			p = put_text(p, label_text);
+			p = put_text(p, indent);
+			if(extended) *p++ = '+';
+			p = put_text(p, name);
+			p = put_text(p, indent);
+			p = put_text(p, operand_text);
+			*p = '\n';
+		}
 	}
-	void insert(string object_code){
-		total_length += object_code.size();
-		records.push_back(object_code);
+
+	// moves the text fields that view [text, text+size) by shift bytes, once that
+	// text has been moved. the others (defaults set by START and END) are kept
+	void rebase(const char* text, size_t size, ptrdiff_t shift){
+		for(string_view* field: {&instruction_text, &label, &operand, &comment}){
+			if((uintptr_t)field->data() - (uintptr_t)text <= size) *field = string_view(field->data() + shift, field->size());
+		}
 	}
-	string to_string(){
-		string q = "T";
 
-		// 6 bytes of hexadecimal starting address
-		int data_decimal = starting_address;
-		string data_hex = "";
-		while(data_decimal){
-			int next_dig = data_decimal%16;
-			char next_dig_char;
-			if(next_dig<10) next_dig_char = '0' + next_dig;
-			else next_dig_char = 'A' + (next_dig-10);
-			data_hex.push_back(next_dig_char);
-			data_decimal/=16;
-		}
-		while(data_hex.size()<6) data_hex.push_back('0');
-		reverse(data_hex.begin(), data_hex.end());
-		q.push_back('^');
-		for(char x: data_hex) q.push_back(x);
+	string to_string(int location){ // converts an instruction back to its string, including location (-1 if none)
+		string q = "";
+		append_to(q, location);
+		return q;
+	}
+};
 
-		// 2 bytes of hexadecimal line lenght in bytes
-		data_decimal = total_length/2;
-		data_hex = "";
-		while(data_decimal){
-			int next_dig = data_decimal%16;
-			char next_dig_char;
-			if(next_dig<10) next_dig_char = '0' + next_dig;
-			else next_dig_char = 'A' + (next_dig-10);
-			data_hex.push_back(next_dig_char);
-			data_decimal/=16;
-		}
-		while(data_hex.size()<2) data_hex.push_back('0');
-		reverse(data_hex.begin(), data_hex.end());
-		q.push_back('^');
-		for(char x: data_hex) q.push_back(x);
+// binary object format (--emit=bin). it holds the same records as the text object
+// program: the H and E records as a fixed header and every T record as a segment of
+// raw code tagged with its address, so that a loader can map the file and copy each
+// segment into memory without parsing any hex. integers are 32 bit in the byte order
+// of the host (little endian on the machines this runs on), and the header and
+// every segment start at a multiple of BIN_ALIGN bytes from the start of the file
+#define BIN_MAGIC "SICOBJ01" // 8 bytes, the last two are the version of the format
+#define BIN_ALIGN 8
+#define SIC_MEMORY (2<<15) // bytes of memory a program is loaded into, every location is below it
 
-		for(string object_code: records){
-			q.push_back('^');
-			for(char x: object_code) q.push_back(x);
-		}
+struct binary_header{
+	char magic[8];
+	char program_name[8]; // as in the H record, 6 characters padded with spaces, then 2 zeros
+	uint32_t starting_address;
+	uint32_t length; // of the program
+	uint32_t entry_point; // the first executable instruction, from the E record
+	uint32_t reserved;
+};
 
-		return(q);
+// the header is followed by a segment per T record, in record order, up to the end of the file
+struct binary_segment{
+	uint32_t address;
+	uint32_t length; // bytes of code right after the segment
+	uint32_t cnt_pieces; // object codes in the record, their sizes follow the code, a byte each
+	uint32_t reserved;
+};
 
-	}
+// the H and E record fields of an object program in either format
+struct object_header{
+	string_view program_name; // 6 characters
+	int starting_address, length, entry_point;
 };
 
-void pass_1(){
-	assembly_program.open(input_file_name);
-	intermediate_file_w.open(IMD_FNAME);
-	if(!assembly_program.is_open()) error(E_NOFIL);
+// called for every T record of an object program in order, with its code and the sizes
+// of the object codes the code is made of (the caret separated parts of the record)
+using segment_visitor = function<void(int address, const unsigned char* code, int length,
+	const unsigned char* pieces, int cnt_pieces)>;
 
-	// main code of the first pass
-	// reading and parsing the file
-	program = {};
-	int source_line_number = 1;
-	while(!assembly_program.eof()){
-		string line;
-		getline(assembly_program, line);
-		instruction ins = instruction(line, source_line_number);
-		source_line_number++;
-		program.push_back(ins);
-	}
+inline size_t binary_padding(size_t size){ return (BIN_ALIGN - size%BIN_ALIGN) % BIN_ALIGN; }
 
-	// deal with start instruction
-	int line_number = 0;
-	for(line_number = 0; line_number<program.size() ; line_number++){
-		if(program[line_number].mnemonic=="START") break;
-		if(program[line_number].mnemonic!="") 
-			error(E_NOFST, &(program[line_number].instruction_text), program[line_number].source_line_number);
-	}
-	if(line_number==program.size()) error(E_NOSTT);
-	instruction& start_ins = program[line_number];
-	if(start_ins.label==""){
-		warning(W_NOSTL);
-		start_ins.label=PRG_DFLTN;
-	}
-	if(start_ins.operand==""){
-		warning(W_NOSTO, &(start_ins.instruction_text), start_ins.source_line_number);
-		start_ins.operand="0";
-	}
-	program_starting_address = stoi(start_ins.operand, NULL, 16);
-	program_name = start_ins.label;
+inline bool is_binary_object(string_view object){
+	return object.size() >= sizeof(binary_header) && memcmp(object.data(), BIN_MAGIC, 8) == 0;
+}
 
-	// deal with end instruction
-	for(line_number=0; line_number<program.size();line_number++) if(program[line_number].mnemonic=="END") break;
-	if(line_number==program.size()) error(E_NOEND);
-	instruction& end_ins = program[line_number];
-	if(end_ins.operand==""){
-		warning(W_NOENO, &(end_ins.instruction_text), end_ins.source_line_number);
-		end_ins.operand=start_ins.label;
-	}
+// writes the header into sizeof(binary_header) bytes at out
+void put_binary_header(char* out, const object_header& header){
+	binary_header bh = {};
+	memcpy(bh.magic, BIN_MAGIC, 8);
+	memset(bh.program_name, ' ', 6);
+	memcpy(bh.program_name, header.program_name.data(), min(header.program_name.size(), (size_t)6));
+	bh.starting_address = header.starting_address;
+	bh.length = header.length;
+	bh.entry_point = header.entry_point;
+	memcpy(out, &bh, sizeof(bh));
+}
+
+void append_binary_segment(string& out, int address, const unsigned char* code, int length,
+	const unsigned char* pieces, int cnt_pieces){
+	binary_segment segment = {(uint32_t)address, (uint32_t)length, (uint32_t)cnt_pieces, 0};
+	size_t size = sizeof(segment) + length + cnt_pieces;
+	char* p = grow(out, size + binary_padding(size));
+	memcpy(p, &segment, sizeof(segment));
+	p += sizeof(segment);
+	if(length) memcpy(p, code, length);
+	if(cnt_pieces) memcpy(p + length, pieces, cnt_pieces);
+	memset(p + length + cnt_pieces, 0, binary_padding(size));
+}
 
-	// set the location of every instruction
-	int location_counter = program_starting_address;
-	for(instruction &ins : program){
-		if(ins.mnemonic=="START" && &ins!=&start_ins) error(E_MPLST, &(ins.instruction_text), ins.source_line_number);
-		if(ins.mnemonic=="END") break;
-		if(ins.size_in_memory || ins.mnemonic=="START"){
-			ins.location = location_counter;
-			ins.has_location = true;
-			if(ins.label.size()){
-				if(SYMTAB.count(ins.label)) error(E_SALEX(ins.label), &(ins.instruction_text), ins.source_line_number);
-				SYMTAB.insert({ins.label, ins.location});
+// reads a text object program as written by the assembler, false if it isn't one.
+// header is set before the first call to segment
+bool read_object_text(string_view text, object_header& header, const segment_visitor& segment){
+	unsigned char code[256], pieces[256];
+	auto field = [](string_view record, size_t pos, size_t digits, int& value){ // a caret and a hex number
+		return pos + 1 + digits <= record.size() && record[pos] == '^'
+			&& parse_int(record.substr(pos+1, digits), 16, value) && value >= 0;
+	};
+	bool started = false, ended = false;
+	size_t pos = 0;
+	while(pos < text.size()){
+		size_t end = text.find('\n', pos);
+		if(end == string::npos || ended) return false; // every record ends with a newline, and nothing follows E
+		string_view record = text.substr(pos, end - pos);
+		pos = end + 1;
+		if(!started){ // H^name  ^start ^length
+			if(record.size() != 22 || record[0] != 'H' || record[1] != '^') return false;
+			header.program_name = record.substr(2, 6);
+			if(!field(record, 8, 6, header.starting_address) || !field(record, 15, 6, header.length)) return false;
+			if(header.starting_address + header.length > SIC_MEMORY) return false;
+			started = true;
+		}else if(record.size() && record[0] == 'T'){ // T^address^length^code^code...
+			int address, length;
+			if(record.size() < 11 || !field(record, 1, 6, address) || !field(record, 8, 2, length)) return false;
+			if(address + length > SIC_MEMORY) return false;
+			int cnt_code = 0, cnt_pieces = 0;
+			for(size_t p = 11; p < record.size(); ){
+				size_t next = record.find('^', p+1);
+				if(next == string::npos) next = record.size();
+				size_t size = (next - p - 1)/2;
+				if(record[p] != '^' || size == 0 || (next - p - 1)%2 || cnt_code + size > (size_t)length) return false;
+				if(!get_hex_bytes(record.data() + p + 1, size, code + cnt_code)) return false;
+				cnt_code += size;
+				pieces[cnt_pieces++] = size;
+				p = next;
 			}
-			location_counter += ins.size_in_memory;
-		}
+			if(cnt_code != length) return false;
+			segment(address, code, length, pieces, cnt_pieces);
+		}else if(record.size() == 11 && record[0] == 'M'){ // M^address^half bytes, the program is loaded where it was assembled
+			int address, length;
+			if(!field(record, 1, 6, address) || !field(record, 8, 2, length) || address + (length+1)/2 > SIC_MEMORY) return false;
+		}else if(record.size() == 8 && record[0] == 'E'){ // E^entry
+			if(!field(record, 1, 6, header.entry_point)) return false;
+			ended = true;
+		}else return false;
 	}
+	return ended;
+}
 
-	// set the value of program length
-	length_of_program = location_counter - program_starting_address;
+// reads a binary object program, false if it isn't a valid one. header is set
+// before the first call to segment, the code passed to it points into binary
+bool read_object_binary(string_view binary, object_header& header, const segment_visitor& segment){
+	if(!is_binary_object(binary)) return false;
+	binary_header bh;
+	memcpy(&bh, binary.data(), sizeof(bh));
+	header.program_name = binary.substr(offsetof(binary_header, program_name), 6);
+	header.starting_address = bh.starting_address;
+	header.length = bh.length;
+	header.entry_point = bh.entry_point;
+	if(bh.starting_address > SIC_MEMORY || bh.length > SIC_MEMORY - bh.starting_address) return false;
 
-	// writing back to the intermediate file
-	for(instruction& ins: program){
-		intermediate_file_w << ins.to_string();
+	const unsigned char* data = (const unsigned char*)binary.data();
+	size_t pos = sizeof(binary_header);
+	while(pos < binary.size()){
+		binary_segment seg;
+		if(binary.size() - pos < sizeof(seg)) return false;
+		memcpy(&seg, data + pos, sizeof(seg));
+		size_t size = sizeof(seg) + (size_t)seg.length + seg.cnt_pieces;
+		if(seg.length > SIC_MEMORY || seg.cnt_pieces > seg.length || binary.size() - pos < size) return false;
+		if(seg.address > SIC_MEMORY - seg.length) return false;
+		const unsigned char* code = data + pos + sizeof(seg);
+		const unsigned char* pieces = code + seg.length;
+		unsigned total = 0;
+		for(unsigned i = 0; i<seg.cnt_pieces; i++) total += pieces[i];
+		if(total != seg.length) return false;
+		segment(seg.address, code, seg.length, pieces, seg.cnt_pieces);
+		pos += size + binary_padding(size);
 	}
-	
-	assembly_program.close();
-	intermediate_file_w.close();
-	return;
+	return pos == binary.size();
 }
 
-void pass_2(){
-	intermediate_file_r.open(IMD_FNAME);
-	assembly_listing.open(ALS_FNAME);
-	object_program.open(OBJ_FNAME);
-	if(!intermediate_file_r.is_open()) error(E_NOIMD);
+// converts a text object program to the binary format, false if it isn't valid
+bool object_text_to_binary(string_view text, string& out){
+	out.assign(sizeof(binary_header), '\0'); // written once the E record is read
+	object_header header;
+	bool valid = read_object_text(text, header, [&](int address, const unsigned char* code, int length,
+		const unsigned char* pieces, int cnt_pieces){
+		append_binary_segment(out, address, code, length, pieces, cnt_pieces);
+	});
+	if(valid) put_binary_header(&out[0], header);
+	return valid;
+}
 
-	// main code
-	for(int line_number = 0; line_number < program.size() ; line_number++){
-		// checking for the operand structure
-		// all operations require a single label like structure(or a comma 
-		// type structure) except RSUB (requires nothing)
-		// assembler directives START and END completely sanitized, although multiple ENDs 
-		// can exist in which case the first END is sanitized
-		// other 4 asm directives BYTE, WORD, RESB, RESW have data types that are
-		// completely identified but not sanitized
-		// ** individual sanitization done, only structural 
-		instruction& ins = program[line_number];
-		if(ins.mnemonic == "START" || (ins.is_comment || ins.is_blank)) continue;
-		if(ins.mnemonic == "END") {
-			if(ins.type_of_operand != O_LABEL)
-				error(E_ENDOP, &(ins.instruction_text), ins.source_line_number);
-			if(!SYMTAB.count(ins.operand))
-					error(E_INVSY(ins.operand), &(ins.instruction_text), ins.source_line_number);
-			first_executable_instruction = SYMTAB[ins.operand];
-			break;
+// converts a binary object program back to the text records it holds, false if it isn't valid.
+// converting text written by the assembler to binary and back gives the same text
+bool object_binary_to_text(string_view binary, string& out){
+	string text_records = "";
+	object_header header;
+	bool valid = read_object_binary(binary, header, [&](int address, const unsigned char* code, int length,
+		const unsigned char* pieces, int cnt_pieces){
+		char* p = grow(text_records, 11 + 2*length + cnt_pieces + 1);
+		p = put_text(p, "T^");
+		p = put_hex(p, address, 6);
+		*p++ = '^';
+		p = put_hex(p, length, 2);
+		for(int i = 0; i<cnt_pieces; i++){
+			*p++ = '^';
+			p = put_hex_bytes(p, code, pieces[i]);
+			code += pieces[i];
 		}
+		*p = '\n';
+	});
+	if(!valid) return false;
 
-		if(ins.mnemonic == "RESW" || ins.mnemonic == "RESB"){
-			if(ins.type_of_operand!=O_DECIM && ins.type_of_operand!=O_HEXAD) // structural sanity check
-				error(E_RWNDM, &(ins.instruction_text), ins.source_line_number);
-		}else if(DIRECTIVES.count(ins.mnemonic)){
-			// either word or byte
-			string otyp = ins.type_of_operand;
-			if(ins.mnemonic=="WORD" && otyp!=O_DECIM) // structural sanity check
-				error(E_WDNDM, &(ins.instruction_text), ins.source_line_number);
-			if((otyp!=O_DECIM) && (otyp!=O_HEXAD && otyp!=O_CHRAR)) // structural sanity check
-				error(E_DTERR, &(ins.instruction_text), ins.source_line_number);
-			
-			if(otyp==O_DECIM){
-				int max_data_size;
-				if(ins.mnemonic=="WORD") max_data_size = 3; else max_data_size = 1;
-				int data_decimal = stoi(ins.operand);
-				if(data_decimal > ((1<<(8*max_data_size))-1)) 
-					error(E_DTOUT, &(ins.instruction_text), ins.source_line_number);
-				string data_hex = "";
-				while(data_decimal){
-					int next_dig = data_decimal%16;
-					char next_dig_char;
-					if(next_dig<10) next_dig_char = '0' + next_dig;
-					else next_dig_char = 'A' + (next_dig-10);
-					data_hex.push_back(next_dig_char);
-					data_decimal/=16;
-				}
+	out.clear();
+	char* p = grow(out, 23); // the H record
+	p = put_text(p, "H^");
+	p = put_text(p, header.program_name);
+	*p++ = '^';
+	p = put_hex(p, header.starting_address, 6);
+	*p++ = '^';
+	p = put_hex(p, header.length, 6);
+	*p = '\n';
+	out += text_records;
+	p = grow(out, 9); // the E record
+	p = put_text(p, "E^");
+	p = put_hex(p, header.entry_point, 6);
+	*p = '\n';
+	return true;
+}
 
-				while(data_hex.size() < (2*max_data_size)) data_hex.push_back('0');
-				
-				reverse(data_hex.begin(),data_hex.end());
-				ins.has_object_code = 1;
-				ins.object_code = data_hex;
-			}else if(otyp == O_HEXAD){
-				string data_hex = "";
-				for(int i=(ins.operand.size()-2); i>=2; i--) data_hex.push_back(ins.operand[i]);
-				if(data_hex.size()%2) data_hex.push_back('0');
-				reverse(data_hex.begin(), data_hex.end());
-				if(data_hex.size()!=2)
-					error(E_DTOUT, &(ins.instruction_text), ins.source_line_number);
-				ins.has_object_code = 1;
-				ins.object_code = data_hex;
-			}else if(otyp == O_CHRAR){
-				for(int i = 2; i<(ins.operand.size()-1); i++){
-					int data_decimal = ins.operand[i];
-					string data_hex = "";
-					while(data_decimal){
-						int next_dig = data_decimal%16;
-						char next_dig_char;
-						if(next_dig<10) next_dig_char = '0' + next_dig;
-						else next_dig_char = 'A' + (next_dig-10);
-						data_hex.push_back(next_dig_char);
-						data_decimal/=16;
-					}
-					if(data_hex.size()%2) data_hex.push_back('0');
-					reverse(data_hex.begin(), data_hex.end());
-					ins.object_code.push_back(data_hex[0]);
-					ins.object_code.push_back(data_hex[1]);
-					ins.has_object_code = 1;
-				}
+// a program loaded into memory
+struct memory_image{
+	string program_name;
+	int starting_address, length, entry_point;
+	vector<unsigned char> memory; // SIC_MEMORY bytes, zero where the program puts nothing
+};
+
+// loads an object program in either format, told apart by the magic of the binary
+// one, false if it isn't valid. binary segments are copied straight from object
+bool load_object(string_view object, memory_image& image){
+	image.memory.assign(SIC_MEMORY, 0);
+	unsigned char* memory = image.memory.data();
+	auto copy = [memory](int address, const unsigned char* code, int length, const unsigned char*, int){
+		memcpy(memory + address, code, length);
+	};
+	object_header header;
+	bool valid = is_binary_object(object) ? read_object_binary(object, header, copy) : read_object_text(object, header, copy);
+	if(!valid) return false;
+	image.program_name = string(header.program_name);
+	image.starting_address = header.starting_address;
+	image.length = header.length;
+	image.entry_point = header.entry_point;
+	return true;
+}
+
+// the linking loader (--link). it links the object programs of any number of control
+// sections, each an H record, D records of the symbols it defines, R records of those
+// it refers to, its T and M records and an E record, into one absolute program. the
+// sections are loaded one after another from the starting address of the first, the
+// external symbol table (ESTAB) gives every section name and defined symbol its address,
+// and every M record adds or subtracts the address of its symbol, or that of its own
+// section if it names none, to the field it points at
+
+// a control section as read by the linking loader, the views are of its object program
+struct object_section{
+	struct definition{
+		string_view name; // trailing spaces dropped
+		unsigned hash;
+		int address; // as assembled
+	};
+	struct modification{
+		int address, half_bytes; // the field, the low half_bytes of the bytes from address
+		int sign; // +1 or -1
+		string_view symbol; // empty for the relocation of the section itself
+		unsigned hash;
+	};
+	definition header; // the name and starting address of the H record
+	int length;
+	int entry_point; // of the E record, -1 if it has none
+	vector<definition> definitions; // D records
+	vector<string_view> text_records; // T records, written again once the section is modified
+	vector<modification> modifications; // M records
+	vector<unsigned char> code; // the length bytes of the section, zero where no T record puts any
+	int address; // where it is loaded, CSADDR
+};
+
+// reads the control sections of a text object program as written by the assembler and
+// appends them to sections, false if it isn't one
+bool read_object_sections(string_view text, vector<object_section>& sections){
+	auto field = [](string_view record, size_t pos, size_t digits, int& value){ // a caret and a hex number
+		return pos + 1 + digits <= record.size() && record[pos] == '^'
+			&& parse_int(record.substr(pos+1, digits), 16, value) && value >= 0;
+	};
+	auto name_field = [](string_view record, size_t pos, object_section::definition& name){ // a caret and 6 characters
+		if(pos + 7 > record.size() || record[pos] != '^') return false;
+		name.name = record.substr(pos+1, 6);
+		while(name.name.size() && name.name.back() == ' ') name.name.remove_suffix(1);
+		name.hash = symbol_hash(name.name);
+		return name.name.size() > 0;
+	};
+	object_section* section = NULL; // the one being read, none between an E record and the next H
+	size_t cnt_sections = sections.size(), pos = 0;
+	while(pos < text.size()){
+		size_t end = text.find('\n', pos);
+		if(end == string::npos) return false; // every record ends with a newline
+		string_view record = text.substr(pos, end - pos);
+		pos = end + 1;
+		if(!section){ // H^name  ^start ^length
+			sections.push_back({});
+			section = &sections.back();
+			if(record.size() != 22 || record[0] != 'H' || !name_field(record, 1, section->header)) return false;
+			if(!field(record, 8, 6, section->header.address) || !field(record, 15, 6, section->length)) return false;
+			if(section->header.address + section->length > SIC_MEMORY) return false;
+			section->code.assign(section->length, 0);
+			continue;
+		}
+		int start = section->header.address, address, length;
+		if(record.size() && record[0] == 'D'){ // D^name  ^address, for each symbol
+			if(record.size() == 1 || (record.size() - 1) % 14) return false;
+			for(size_t p = 1; p < record.size(); p += 14){
+				object_section::definition def;
+				if(!name_field(record, p, def) || !field(record, p+7, 6, def.address)) return false;
+				section->definitions.push_back(def);
+			}
+		}else if(record.size() && record[0] == 'R'){ // R^name  , for each symbol, the M records name them again
+			if(record.size() == 1 || (record.size() - 1) % 7) return false;
+			object_section::definition ref;
+			for(size_t p = 1; p < record.size(); p += 7) if(!name_field(record, p, ref)) return false;
+		}else if(record.size() && record[0] == 'T'){ // T^address^length^code^code...
+			if(record.size() < 11 || !field(record, 1, 6, address) || !field(record, 8, 2, length)) return false;
+			if(address < start || address + length > start + section->length) return false;
+			unsigned char* code = section->code.data() + (address - start);
+			int cnt_code = 0;
+			for(size_t p = 11; p < record.size(); ){
+				size_t next = record.find('^', p+1);
+				if(next == string::npos) next = record.size();
+				size_t size = (next - p - 1)/2;
+				if(record[p] != '^' || size == 0 || (next - p - 1)%2 || cnt_code + size > (size_t)length) return false;
+				if(!get_hex_bytes(record.data() + p + 1, size, code + cnt_code)) return false;
+				cnt_code += size;
+				p = next;
+			}
+			if(cnt_code != length) return false;
+			section->text_records.push_back(record);
+		}else if(record.size() && record[0] == 'M'){ // M^address^half bytes, then ^+name or ^-name if it has a symbol
+			object_section::modification mod = {0, 0, 1, "", 0};
+			if(!field(record, 1, 6, mod.address) || !field(record, 8, 2, mod.half_bytes)) return false;
+			if(mod.half_bytes < 1 || mod.half_bytes > 6 || mod.address < start || mod.address + (mod.half_bytes+1)/2 > start + section->length) return false;
+			if(record.size() > 11){
+				if(record.size() < 14 || record.size() > 19 || record[11] != '^' || (record[12] != '+' && record[12] != '-')) return false;
+				mod.sign = (record[12] == '+') ? 1 : -1;
+				mod.symbol = record.substr(13);
+				mod.hash = symbol_hash(mod.symbol);
+			}
+			section->modifications.push_back(mod);
+		}else if(record == "E"){
+			section->entry_point = -1;
+			section = NULL;
+		}else if(record.size() == 8 && record[0] == 'E'){ // E^entry
+			if(!field(record, 1, 6, section->entry_point)) return false;
+			section = NULL;
+		}else return false;
+	}
+	return !section && sections.size() > cnt_sections;
+}
+
+// a linked program, loaded into memory and as an absolute text object program
+struct linked_program{
+	memory_image image;
+	string object_program; // H, T and E records, as the assembler writes them
+	int cnt_sections, cnt_symbols, cnt_modifications;
+};
+
+// links the object programs in order, on up to num_threads threads, and returns the
+// error, "" if there is none (fnames are those of the programs, for the errors). the
+// programs are read in parallel, then ESTAB is built in partitions by the hash of the
+// names, each thread inserting the names of its own partition in link order, so the first
+// name defined twice is reported however the threads run. the sections are then copied
+// into memory, their M records applied and their T records written again in parallel,
+// a section per thread: a field is only ever in its own section
+string link_objects(const vector<string_view>& objects, const vector<string>& fnames, int num_threads, linked_program& linked){
+	vector<vector<object_section>> read(objects.size());
+	vector<char> valid(objects.size());
+	parallel_for(objects.size(), num_threads, [&](int o){ valid[o] = read_object_sections(objects[o], read[o]); });
+	vector<object_section> sections;
+	for(size_t o = 0; o<objects.size(); o++){
+		if(!valid[o]) return E_LKOBJ(fnames[o]);
+		for(object_section& section: read[o]) sections.push_back(move(section));
+	}
+	if(sections.empty()) return E_LKOBJ("");
+
+	// CSADDR, from PROGADDR on
+	int address = sections[0].header.address, cnt_names = 0;
+	for(object_section& section: sections){
+		section.address = address;
+		address += section.length;
+		cnt_names += 1 + section.definitions.size();
+		if(address > SIC_MEMORY) return E_LKMEM;
+	}
+
+	// ESTAB, a symbol table per partition. a section's symbols are at its CSADDR less
+	// the starting address it was assembled at
+	int cnt_partitions = max(1, num_threads);
+	auto partition = [cnt_partitions](unsigned hash){ return (int)(((unsigned long long)hash * cnt_partitions) >> 32); };
+	vector<symbol_table> estab(cnt_partitions);
+	vector<pair<int, int>> duplicate(cnt_partitions, {-1, 0}); // the first name defined twice in each partition, by section and definition
+	parallel_for(cnt_partitions, num_threads, [&](int p){
+		symbol_table& table = estab[p];
+		table.reserve(cnt_names/cnt_partitions + 16);
+		auto define = [&](const object_section::definition& def, int value, int s, int d){
+			if(partition(def.hash) == p && !table.insert(def.name, def.hash, value).second && duplicate[p].first < 0) duplicate[p] = {s, d};
+		};
+		for(int s = 0; s<(int)sections.size(); s++){
+			object_section& section = sections[s];
+			define(section.header, section.address, s, -1);
+			for(int d = 0; d<(int)section.definitions.size(); d++)
+				define(section.definitions[d], section.address + section.definitions[d].address - section.header.address, s, d);
+		}
+	});
+	pair<int, int> first_duplicate = {-1, 0};
+	for(pair<int, int>& dup: duplicate) if(dup.first >= 0 && (first_duplicate.first < 0 || dup < first_duplicate)) first_duplicate = dup;
+	if(first_duplicate.first >= 0){
+		object_section& section = sections[first_duplicate.first];
+		return E_LKDUP((first_duplicate.second < 0) ? section.header.name : section.definitions[first_duplicate.second].name);
+	}
+
+	// loading and modifying the sections, each writing its T records at its CSADDR
+	memory_image& image = linked.image;
+	image.memory.assign(SIC_MEMORY, 0);
+	unsigned char* memory = image.memory.data();
+	vector<string> records(sections.size()), errors(sections.size());
+	parallel_for(sections.size(), num_threads, [&](int s){
+		object_section& section = sections[s];
+		int shift = section.address - section.header.address;
+		if(section.length) memcpy(memory + section.address, section.code.data(), section.length);
+		for(object_section::modification& mod: section.modifications){
+			int value = shift;
+			if(mod.symbol.size()){
+				const symbol_table& table = estab[partition(mod.hash)];
+				symbol_table::handle h = table.find(mod.symbol, mod.hash);
+				if(h < 0){
+					errors[s] = E_LKUND(mod.symbol);
+					return;
+				}
+				value = table.value(h);
+			}
+			unsigned char* p = memory + mod.address + shift;
+			int cnt_bytes = (mod.half_bytes+1)/2;
+			unsigned field = 0, mask = (1u << 4*mod.half_bytes) - 1;
+			for(int b = 0; b<cnt_bytes; b++) field = (field << 8) | p[b];
+			field = (field & ~mask) | ((field + mod.sign*value) & mask);
+			for(int b = cnt_bytes-1; b>=0; b--, field >>= 8) p[b] = field & 0xff;
+		}
+		string& out = records[s];
+		for(string_view record: section.text_records){ // the same pieces, at the new address with the modified code
+			int address;
+			parse_int(record.substr(2, 6), 16, address);
+			const unsigned char* code = memory + address + shift;
+			char* p = grow(out, record.size() + 1);
+			p = put_text(p, "T^");
+			p = put_hex(p, address + shift, 6);
+			p = put_text(p, record.substr(8, 3));
+			for(size_t i = 11; i < record.size(); ){
+				if(record[i] == '^') *p++ = record[i++];
+				else{
+					p = put_hex_bytes(p, code++, 1);
+					i += 2;
+				}
+			}
+			*p = '\n';
+		}
+	});
+	for(string& err: errors) if(err.size()) return err;
+
+	// the entry point is that of the first E record giving one
+	image.program_name = string(sections[0].header.name);
+	image.starting_address = sections[0].address;
+	image.length = address - sections[0].address;
+	image.entry_point = image.starting_address;
+	for(object_section& section: sections){
+		if(section.entry_point < 0) continue;
+		image.entry_point = section.entry_point + section.address - section.header.address;
+		break;
+	}
+	linked.cnt_sections = sections.size();
+	linked.cnt_symbols = linked.cnt_modifications = 0;
+	for(symbol_table& table: estab) linked.cnt_symbols += table.size();
+	for(object_section& section: sections) linked.cnt_modifications += section.modifications.size();
+
+	string& out = linked.object_program;
+	out.clear();
+	size_t total_size = 32;
+	for(string& r: records) total_size += r.size();
+	out.reserve(total_size);
+	char* p = grow(out, 23);
+	p = put_text(p, "H^");
+	p = put_text(p, image.program_name);
+	for(size_t i = image.program_name.size(); i<6; i++) *p++ = ' ';
+	*p++ = '^';
+	p = put_hex(p, image.starting_address, 6);
+	*p++ = '^';
+	p = put_hex(p, image.length, 6);
+	*p = '\n';
+	for(string& r: records) out += r;
+	p = grow(out, 9);
+	p = put_text(p, "E^");
+	p = put_hex(p, image.entry_point, 6);
+	*p = '\n';
+	return "";
+}
+
+// the text record class, a run of consecutive lines whose object code is
+// packed into one T record
+class text_record{
+public:
+	int total_length; // in bytes
+	int starting_address;
+	int first_line, end_line; // lines [first_line, end_line) of the program
+	text_record(int str_addr, int line){
+		starting_address = str_addr;
+		first_line = end_line = line;
+		total_length = 0;
+	}
+	void insert(int line, int object_code_size){
+		total_length += object_code_size;
+		end_line = line+1;
+	}
+	// appends the record and a newline to out. object_offset and object_bytes
+	// are the object code of the program, see class assembler
+	void append_to(string& out, const vector<unsigned>& object_offset, const vector<unsigned char>& object_bytes){
+		int cnt_lines = end_line - first_line;
+		char* p = grow(out, 11 + 2*total_length + cnt_lines + 1); // at most one caret per line
+		*p++ = 'T';
+
+		// 6 bytes of hexadecimal starting address
+		*p++ = '^';
+		p = put_hex(p, starting_address, 6);
+
+		// 2 bytes of hexadecimal line lenght in bytes
+		*p++ = '^';
+		p = put_hex(p, total_length, 2);
+
+		// object code of every line, separated by carets
+		for(int line = first_line; line<end_line; line++){
+			int size = object_offset[line+1] - object_offset[line];
+			if(size == 0) continue; // comments and blank lines in between
+			*p++ = '^';
+			p = put_hex_bytes(p, object_bytes.data()+object_offset[line], size);
+		}
+		*p++ = '\n';
+		out.resize(p - out.data()); // drop the unused carets
+	}
+	// appends the record as a segment of a binary object program
+	void append_binary_to(string& out, const vector<unsigned>& object_offset, const vector<unsigned char>& object_bytes){
+		unsigned char pieces[256];
+		int cnt_pieces = 0;
+		for(int line = first_line; line<end_line; line++){
+			int size = object_offset[line+1] - object_offset[line];
+			if(size) pieces[cnt_pieces++] = size;
+		}
+		append_binary_segment(out, starting_address, object_bytes.data()+object_offset[first_line], total_length, pieces, cnt_pieces);
+	}
+};
+
+// buffered writer of an output file. small pieces of text are gathered in a buffer
+// that is kept from file to file, large ones are written from the caller's memory
+// by the same writev() as the buffered text before them. text can also be
+// formatted straight into buffer, followed by a call to check_full()
+class output_writer{
+public:
+	int fd;
+	string buffer;
+	long long written; // bytes of the file written so far, not counting buffer
+	bool failed; // a write failed, the file is incomplete
+
+	output_writer(): fd(-1), written(0), failed(false) {}
+	~output_writer(){ close(); }
+
+	bool open(string fname){ // truncates the file
+		close();
+		fd = ::open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		written = 0;
+		failed = (fd < 0);
+		buffer.clear();
+		if(buffer.capacity() < OUT_BUFFER) buffer.reserve(OUT_BUFFER);
+		return !failed;
+	}
+
+	long long offset() const { return written + buffer.size(); } // of the next byte written
+
+	void write(string_view text){
+		if(buffer.size() + text.size() <= OUT_BUFFER) buffer.append(text);
+		else if(text.size() < OUT_BUFFER/2){
+			flush();
+			buffer.append(text);
+		}else write_out(text);
+	}
+
+	void check_full(){ if(buffer.size() >= OUT_BUFFER) flush(); }
+	bool flush(){ write_out(string_view()); return !failed; }
+
+	// overwrites text already written at offset
+	bool patch(long long offset, string_view text){
+		flush();
+		if(!failed && pwrite(fd, text.data(), text.size(), offset) != (ssize_t)text.size()) failed = true;
+		return !failed;
+	}
+
+	bool close(){ // false if anything failed
+		if(fd < 0) return !failed;
+		flush();
+		if(::close(fd) != 0) failed = true;
+		fd = -1;
+		return !failed;
+	}
+
+private:
+	// writes buffer and then text
+	void write_out(string_view text){
+		iovec parts[2] = {{(void*)buffer.data(), buffer.size()}, {(void*)text.data(), text.size()}};
+		int first = 0;
+		while(!failed && first<2){
+			if(parts[first].iov_len == 0){
+				first++;
+				continue;
+			}
+			ssize_t cnt_written = writev(fd, parts+first, 2-first);
+			if(cnt_written <= 0){
+				if(cnt_written == 0 || errno != EINTR) failed = true;
+				continue;
+			}
+			for(; cnt_written > 0; first++){ // partly written, moving past what was
+				size_t step = min((size_t)cnt_written, parts[first].iov_len);
+				parts[first].iov_base = (char*)parts[first].iov_base + step;
+				parts[first].iov_len -= step;
+				cnt_written -= step;
+				if(parts[first].iov_len) break;
+			}
+		}
+		written += buffer.size() + text.size();
+		buffer.clear();
+	}
+};
+
+// a batch of whole source lines, handed from stage to stage in the pipelined mode
+struct line_batch{
+	string text; // the lines, each ended by a newline except in the last batch
+	bool last; // the last batch holds the text after the last newline, a line too
+
+	// set by the parser stage
+	vector<instruction> lines; // views of text
+	bool failed; // lines stop before the line that failed to parse
+	diagnostic diag;
+
+	// set by the encoder stage, indexed like lines
+	vector<int> location;
+	vector<unsigned> object_offset; // as in class assembler, with lines.size()+1 entries
+	vector<unsigned char> object_bytes;
+	vector<int> forward_ref_lines; // lines whose address is patched at the end, in order
+
+	line_batch(): last(false), failed(false) {}
+};
+
+// bounded lock-free queue of batches between two stages, one thread pushing
+// and one popping. each side waits by yielding when the queue is full or empty
+class batch_queue{
+public:
+	line_batch* slots[PIPE_DEPTH];
+	atomic<size_t> head, tail; // next slot to pop / to push, never wrapped
+
+	batch_queue(): head(0), tail(0) {}
+
+	void push(line_batch* batch){
+		size_t t = tail.load(memory_order_relaxed);
+		while(t - head.load(memory_order_acquire) == PIPE_DEPTH) this_thread::yield();
+		slots[t % PIPE_DEPTH] = batch;
+		tail.store(t+1, memory_order_release);
+	}
+
+	line_batch* pop(){
+		size_t h = head.load(memory_order_relaxed);
+		while(tail.load(memory_order_acquire) == h) this_thread::yield();
+		line_batch* batch = slots[h % PIPE_DEPTH];
+		head.store(h+1, memory_order_release);
+		return batch;
+	}
+};
+
+// opt-in cache of assembled outputs on disk (--cache=<dir>). an entry holds the whole
+// assembly_result of a source, diagnostics included, and is named after a hash of the
+// source bytes, ASM_VERSION, the mnemonic table, the settings that change the outputs
+// and the outputs emitted. entries are written to a temporary file and renamed into
+// place, so concurrent assemblers never read a partial one. a hit touches the entry's
+// modification time, and once the entries grow past the size limit the least recently
+// used ones are removed
+#define CACHE_MAGIC "SICCACH1" // 8 bytes at the start of every entry
+#define CACHE_FEXTN ".entry"
+
+// hash of the mnemonic table, FNV-1a over every field
+constexpr unsigned long long mnemonic_table_hash(){
+	unsigned long long h = 14695981039346656037ull;
+	auto mix = [&h](unsigned long long v){ h = (h ^ v) * 1099511628211ull; };
+	for(const mnemonic_info& info: MNEMONICS){
+		for(char c: info.name) mix((unsigned char)c);
+		mix(info.kind);
+		mix(info.opcode);
+		mix(info.format);
+		mix(info.xe);
+	}
+	return h;
+}
+
+// a 128 bit hash of a source and everything else its outputs depend on
+struct cache_key{
+	unsigned long long hi, lo;
+	string to_string() const { return hex_string(hi >> 32, 8) + hex_string(hi, 8) + hex_string(lo >> 32, 8) + hex_string(lo, 8); }
+};
+
+// two independent 64 bit lanes over 8 byte words, each finished with the murmur3 mix
+inline cache_key content_hash(string_view data, unsigned long long seed){
+	auto finish = [](unsigned long long h){
+		h ^= h >> 33; h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ull;
+		return h ^ (h >> 33);
+	};
+	unsigned long long a = seed ^ 0x9e3779b97f4a7c15ull, b = ~seed ^ data.size();
+	size_t i = 0;
+	for(; i+8 <= data.size(); i += 8){
+		unsigned long long word;
+		memcpy(&word, data.data()+i, 8);
+		a = (a ^ word) * 0x87c37b91114253d5ull;
+		a = (a << 31) | (a >> 33);
+		b = (b + word) * 0x4cf5ad432745937full;
+		b ^= b >> 29;
+	}
+	unsigned long long tail = 0;
+	if(i < data.size()) memcpy(&tail, data.data()+i, data.size()-i);
+	a = (a ^ tail) * 0x87c37b91114253d5ull;
+	b = (b + tail) * 0x4cf5ad432745937full;
+	return {finish(a + b), finish(b ^ (a << 1))};
+}
+
+class build_cache{
+public:
+	string dir;
+	long long size_limit; // bytes of entries kept
+	atomic<long long> hits, misses;
+
+	build_cache(string dir, long long size_limit = CACHE_LIMIT): dir(dir), size_limit(size_limit), hits(0), misses(0), known_size(-1) {}
+
+	// false if the directory can't be created or used
+	bool open(){
+		mkdir(dir.c_str(), 0755);
+		return access(dir.c_str(), R_OK | W_OK | X_OK) == 0;
+	}
+
+	static cache_key key(string_view source, int emit, bool optimize){
+		string settings = string(ASM_VERSION "|" INDENT "|" PRG_DFLTN "|") + std::to_string(SHOW_W_LINBL) + "|"
+			+ std::to_string(mnemonic_table_hash()) + "|" + std::to_string(emit) + "|" + std::to_string(optimize);
+		return content_hash(source, content_hash(settings, 0).lo);
+	}
+
+	// fills result from the entry of key, false on a miss
+	bool lookup(const cache_key& key, assembly_result& result){
+		string fname = entry_fname(key), entry;
+		if(!read_entry(fname, entry) || !parse_entry(entry, result)){
+			misses++;
+			return false;
+		}
+		utimensat(AT_FDCWD, fname.c_str(), NULL, 0); // most recently used
+		hits++;
+		return true;
+	}
+
+	// stores result as the entry of key. the cache is only an optimization, so failures are ignored
+	void store(const cache_key& key, const assembly_result& result){
+		string entry = CACHE_MAGIC;
+		entry.push_back(result.success);
+		append_number(entry, result.diagnostics.size());
+		for(const diagnostic& diag: result.diagnostics){
+			entry.push_back(diag.is_error);
+			append_string(entry, diag.message);
+			append_string(entry, diag.line_text);
+			append_number(entry, diag.line_number);
+		}
+		for(const string* output: {&result.intermediate_file, &result.assembly_listing, &result.object_program, &result.object_binary}){
+			append_string(entry, *output);
+		}
+
+		// written under a name of its own, then renamed over the entry at once
+		static atomic<int> cnt_temporary(0);
+		string temporary = dir + "/tmp." + std::to_string(getpid()) + "." + std::to_string(cnt_temporary++);
+		output_writer writer;
+		if(!writer.open(temporary)) return;
+		writer.write(entry);
+		if(!writer.close() || rename(temporary.c_str(), entry_fname(key).c_str()) != 0){
+			unlink(temporary.c_str());
+			return;
+		}
+		long long size = (known_size += entry.size());
+		if(size > size_limit || size < (long long)entry.size()) evict(); // over the limit, or never counted
+	}
+
+private:
+	atomic<long long> known_size; // of the entries, as last counted plus those stored since. below 0 until counted
+	mutex evict_lock;
+
+	string entry_fname(const cache_key& key){ return dir + "/" + key.to_string() + CACHE_FEXTN; }
+
+	static void append_number(string& out, unsigned long long value){
+		char* p = grow(out, 8);
+		memcpy(p, &value, 8);
+	}
+	static void append_string(string& out, const string& text){
+		append_number(out, text.size());
+		out += text;
+	}
+
+	static bool read_entry(string fname, string& entry){
+		int fd = ::open(fname.c_str(), O_RDONLY);
+		if(fd < 0) return false;
+		struct stat st;
+		bool read_all = (fstat(fd, &st) == 0);
+		if(read_all){
+			entry.resize(st.st_size);
+			for(size_t done = 0; read_all && done < entry.size(); ){
+				ssize_t cnt_read = read(fd, &entry[done], entry.size() - done);
+				if(cnt_read < 0 && errno == EINTR) continue;
+				read_all = (cnt_read > 0);
+				done += max(cnt_read, (ssize_t)0);
+			}
+		}
+		::close(fd);
+		return read_all;
+	}
+
+	// false if the entry is damaged
+	static bool parse_entry(string_view entry, assembly_result& result){
+		size_t pos = 8;
+		auto number = [&](unsigned long long& value){
+			if(entry.size() - pos < 8) return false;
+			memcpy(&value, entry.data()+pos, 8);
+			pos += 8;
+			return true;
+		};
+		auto text = [&](string& value){
+			unsigned long long size;
+			if(!number(size) || entry.size() - pos < size) return false;
+			value = string(entry.substr(pos, size));
+			pos += size;
+			return true;
+		};
+		unsigned long long cnt_diagnostics;
+		if(entry.size() < 9 || entry.compare(0, 8, CACHE_MAGIC) != 0) return false;
+		result.success = entry[pos++];
+		if(!number(cnt_diagnostics)) return false;
+		result.diagnostics.clear();
+		for(unsigned long long d = 0; d<cnt_diagnostics; d++){
+			diagnostic diag;
+			unsigned long long line;
+			if(pos == entry.size()) return false;
+			diag.is_error = entry[pos++];
+			if(!text(diag.message) || !text(diag.line_text) || !number(line)) return false;
+			diag.line_number = line;
+			result.diagnostics.push_back(diag);
+		}
+		for(string* output: {&result.intermediate_file, &result.assembly_listing, &result.object_program, &result.object_binary}){
+			if(!text(*output)) return false;
+		}
+		return pos == entry.size();
+	}
+
+	// counts the entries and removes the least recently used until they take up at most
+	// 90% of the limit, so that the next few stores don't evict again
+	void evict(){
+		lock_guard<mutex> lock(evict_lock);
+		DIR* d = opendir(dir.c_str());
+		if(!d) return;
+		struct entry_info{ timespec used; long long size; string fname; };
+		vector<entry_info> entries;
+		long long total = 0;
+		while(dirent* e = readdir(d)){
+			string name = e->d_name;
+			if(name.size() <= strlen(CACHE_FEXTN) || name.compare(name.size()-strlen(CACHE_FEXTN), string::npos, CACHE_FEXTN) != 0) continue;
+			struct stat st;
+			string fname = dir + "/" + name;
+			if(stat(fname.c_str(), &st) != 0) continue;
+			entries.push_back({st.st_mtim, (long long)st.st_size, fname});
+			total += st.st_size;
+		}
+		closedir(d);
+		sort(entries.begin(), entries.end(), [](const entry_info& a, const entry_info& b){
+			return a.used.tv_sec != b.used.tv_sec ? a.used.tv_sec < b.used.tv_sec : a.used.tv_nsec < b.used.tv_nsec;
+		});
+		for(size_t i = 0; i<entries.size() && total > size_limit/10*9; i++){
+			if(unlink(entries[i].fname.c_str()) == 0) total -= entries[i].size;
+		}
+		known_size = total;
+	}
+};
+
+// the assembler, holds the state of one assembly job so that it can be reused
+class assembler{
+public:
+	// data structures
+	symbol_table SYMTAB;
+
+	// program information variables
+	int program_starting_address;
+	int first_executable_instruction;
+	int length_of_program;
+	string program_name;
+	vector<instruction> program;
+
+	// results of the passes, stored as arrays parallel to program so that each
+	// pass streams through contiguous memory
+	vector<int> location; // location of every line in RAM, -1 if it has none
+	vector<unsigned> object_offset; // object code of line i is object_bytes[object_offset[i], object_offset[i+1])
+	vector<unsigned char> object_bytes; // object code of the whole program, in line order
+
+	// warning flags
+	bool fl_empty_lines;
+
+	bool xe; // a SIC/XE program, see instruction::is_xe. the others are encoded for SIC as they always were
+	bool literals; // the program uses literals or LTORG
+	bool expressions; // the program uses expressions, EQU or ORG
+	bool definitions; // the program has EQU or ORG lines, see resolve_definitions()
+	literal_counts literal_count; // of the pools placed by pass 1
+	bool optimize; // -O, pass 1 ends with the peephole optimizer, see peephole()
+	peephole_counts peephole_count; // of the rewrites it made
+
+	// control sections, the first from START and one from each CSECT, to the next or to END.
+	// each has a location counter from 0 (the first from the starting address) and symbols
+	// of its own, and is written as an object program of its own with its D, R and M
+	// records (see write_object_program()). a program without CSECT is a single section
+	struct control_section{
+		string_view name;
+		int first_line, end_line; // lines [first_line, end_line) of the program, from the START or CSECT
+		int origin; // its location counter at first_line
+		int length;
+		int address; // where the binary object, linked by the assembler itself, loads it
+		vector<int> extdef_lines, extref_lines; // its EXTDEF and EXTREF lines
+		// the symbols of the section while SYMTAB holds another's, see enter_section()
+		symbol_table symbols;
+		vector<bool> absolute_symbols, external_symbols;
+	};
+	vector<control_section> sections;
+	bool linking; // the program has CSECT, EXTDEF or EXTREF
+
+	int num_threads; // threads used by the passes on large sources
+	assembly_stats* stats; // if set, assemble() adds the time and events of each phase to it
+	build_cache* cache; // if set, assemble() returns the cached result of a source it has seen
+	int emit; // outputs produced, a mask of output_kind bits. the others are never formatted
+
+	assembler(int num_threads = 1): optimize(false), num_threads(num_threads), stats(NULL), cache(NULL), emit(EMIT_DEFAULT),
+		cnt_parsed_lines(0), incremental(false) {}
+
+	// assembles a whole source text held in memory. program refers into
+	// source, which must outlive any use of it after this returns
+	assembly_result assemble(string_view source);
+
+	// one-pass (load-and-go) assembly. only the symbols are kept, not the lines:
+	// text records are emitted as soon as their lines are encoded and every forward
+	// reference is patched with an extra T record once its symbol is defined.
+	// if sink is given the records are written to it as they are completed (the
+	// header is rewritten at the end, so it must be seekable), otherwise they are
+	// returned in object_program. no listing or intermediate file is produced
+	assembly_result assemble_one_pass(string_view source, ostream* sink = NULL);
+
+	// pipelined assembly of a file, with the outputs written to the files named in
+	// output_fnames (indexed by output_kind). a reader, a parser, an encoder and a
+	// writer run at once on batches of lines. backward references are encoded at
+	// once, forward ones are patched into the files after END. the files are the
+	// same as those of assemble(); errors are reported in source order like
+	// assemble_one_pass() and leave no files behind. the binary object is not produced
+	assembly_result assemble_pipelined(string input_fname, const string* output_fnames);
+
+	// incremental assembly of a source edited between calls, as --watch does. the
+	// first call assembles source in full. later ones re-parse only the lines between
+	// the unchanged lines at its start and end, locate again only from the first
+	// changed line on, update SYMTAB in place, encode again only the changed lines and
+	// those whose symbols moved, and patch the outputs where their lines changed.
+	// a change it can't follow (to START or END, any error, or in a SIC/XE program,
+	// whose sizes depend on its addresses, or one with literals, whose pools move
+	// lines, or with expressions, EQU or ORG, or any change with optimize set) is assembled in full,
+	// so the results are always those of assemble(). source is copied and needn't
+	// outlive the call. the outputs stay in result, for the next call to patch.
+	// the cache isn't used
+	const assembly_result& reassemble(string_view source);
+	int cnt_parsed_lines; // lines parsed by the last reassemble()
+
+	// the steps of assemble(), in order, filling result. the passes throw
+	// assembly_error. public so that the benchmarks can run and time each one
+	assembly_result result; // outputs of the assembly in progress
+	void reset();
+	void pass_1(string_view source); // parses, locates and builds SYMTAB, writes the intermediate file
+	void pass_2(); // encodes the object code, writes the assembly listing
+	void write_object_program(); // packs the object code into records
+
+private:
+
+	// one-pass mode state
+	struct forward_reference{
+		int patch_location; // location of the 2 byte address field to patch
+		bool indexed;
+		string_view instruction_text; // for the error if the symbol is never defined
+		int source_line_number;
+	};
+	bool one_pass;
+	unordered_map <string_view, vector<forward_reference>> forward_refs; // by undefined symbol
+	ostream* object_sink;
+	int record_start; // location of the pending text record, held in object_offset/object_bytes
+
+	void flush_text_record();
+
+	// pipelined mode state
+	struct pipeline_reference{
+		string symbol; // copied, the batch holding the line is gone when it is resolved
+		unsigned hash;
+		int object_code; // of the line without the address
+		string instruction_text;
+		int source_line_number;
+	};
+	bool pipelined;
+	vector<pipeline_reference> pipeline_refs; // in line order
+	atomic<bool> pipeline_cancelled; // stops the reader and parser after an error
+	struct pipeline_output{ // written by the writer stage
+		output_writer files[OUT_COUNT]; // only those emitted are open
+		vector<long long> listing_patches, object_patches; // file offsets of forward referencing code
+	};
+	void read_batches(int fd, batch_queue& out);
+	void parse_batches(batch_queue& in, batch_queue& out);
+	void encode_batch(line_batch& batch, bool& started, bool& ended, int& location_counter);
+	void write_batches(batch_queue& in, pipeline_output& out);
+	void resolve_pipeline_refs(); // the address of every forward reference, at END
+
+	// incremental mode state, kept by reassemble() from one call to the next
+	bool incremental; // the state is that of the last assembly, which succeeded
+	int incremental_emit; // emit of that assembly
+	string incremental_source; // program refers into it
+	int start_line, end_line;
+	vector<int> label_lines; // located lines with a label, in order
+	vector<int> reference_lines; // lines encoded with the address of a symbol, in order
+	vector<unsigned> output_offset[2]; // line i of the intermediate file / listing starts at output_offset[f][i]
+	void keep_incremental_state(); // after a full assembly
+	bool reassemble_lines(string_view source); // false if source must be assembled in full
+	// replaces the cnt_old formatted lines of out from line first on with the cnt_new
+	// lines there now, then formats the lines in dirty (sorted, after those) again in
+	// place. false if one of those changed its length
+	bool patch_output(string& out, vector<unsigned>& offset, int first, int cnt_old, int cnt_new,
+		const vector<int>& dirty, const function<void(int, string&)>& format);
+
+	// an EQU or ORG line, with the location counter there as located before any ORG moved it
+	struct definition{
+		int line;
+		int counter;
+	};
+
+	// pass 1 splits the source into chunks of whole lines that are parsed, located
+	// and scanned for symbols in parallel, pass 2 then encodes and lists the same chunks
+	struct source_chunk{
+		string_view text;
+		int first_line, cnt_lines; // lines [first_line, first_line+cnt_lines) of program
+		bool has_blank;
+		bool has_xe;
+		bool has_literals;
+		bool has_expressions, has_definitions;
+		bool has_sections;
+		int first_statement, first_end; // first line with a mnemonic / with END, -1 if none
+		int size_in_memory; // total size of the located lines in the chunk
+		int location_counter; // location of its first located line
+		int base; // the base register assumed at its first line, -1 if none
+		vector<int> label_lines; // located lines with a label and EQU lines, in order
+		vector<definition> definitions; // EQU and ORG lines, in order
+		bool failed; // the first error in the chunk, lines are handled in order
+		diagnostic diag;
+		int error_line;
+		vector<unsigned char> object_bytes; // object code of the chunk's lines, see pass_2
+		string output; // the chunk's part of the file being formatted
+	};
+	vector<source_chunk> chunks;
+	void split_source(string_view source);
+	int locate(int start_line, int end_line); // sets location and the label lines of the chunks, returns the end of the section
+	// grows the SIC/XE instructions out of reach to format 4, returns the end of the program, end if none grew
+	int relax(int start_line, int end_line, int end);
+	// locates the program again once sizes changed, along with SYMTAB, the definitions and the literals. returns its end
+	int relocate(int start_line, int end_line);
+	// rewrites the located program with the rewrites counted in peephole_counts, a note on each
+	// in rewrites. false if no line was removed, so that the locations still hold
+	bool peephole(int start_line, int end_line);
+	vector<pair<int, string>> rewrites; // a line rewritten by peephole() and the note listed after it, by line
+	int base_after(const instruction& ins, int base); // the base register assumed after ins, given the one before it
+	symbol_table LITTAB; // the bytes of every literal placed, valued with the line of the pool holding them
+	vector<pair<int, symbol_table::handle>> literal_names; // a line spelling a literal first, with its bytes in LITTAB
+	void place_literals(int start_line, int& end_line); // inserts the literal pools into program, moving END to end_line
+	void define_literals(int start_line, int end_line); // values the literal names of the lines in SYMTAB with the locations of their pool lines
+	vector<bool> absolute_symbols; // by SYMTAB handle, set for the EQUs of absolute expressions, the rest are addresses
+	bool is_absolute(symbol_table::handle sym){ return sym < (int)absolute_symbols.size() && absolute_symbols[sym]; }
+	vector<bool> external_symbols; // by SYMTAB handle, set for the names of EXTREF
+	bool is_external(symbol_table::handle sym){ return sym < (int)external_symbols.size() && external_symbols[sym]; }
+	int current_section; // the section whose symbols are in SYMTAB
+	void enter_section(int s); // swaps the symbols of section s into SYMTAB, and those there back into their section
+	void find_sections(int start_line, int end_line); // splits the program into sections at its CSECTs
+	// values the EQUs and moves the lines after each ORG, given the end of the program as
+	// located without them. returns the end of the program, the highest location reached
+	int resolve_definitions(int end);
+	// the value of a symbol, literal or expression operand of ins at location, relative is
+	// set if it is an address and cleared if it is a number. the external symbols it adds
+	// are appended to externals, an error if that is NULL
+	int operand_value(instruction& ins, int location, bool& relative, external_terms* externals = NULL);
+	void chunk_error(source_chunk& chunk, const assembly_error& err, int line); // keeps the chunk's first error
+	void throw_first_error(); // rethrows the error of the earliest failed chunk, if any
+	// formats the lines of every chunk in parallel with format(line, chunk_output)
+	// and appends the chunk outputs to out in order
+	void format_chunks(string& out, const function<void(int, string&)>& format);
+
+	void warning(string warning_string, const string_view* err_ins=NULL, int ln=0);
+
+	// shared by both passes and the one-pass mode
+	void start_program(instruction& start_ins); // applies START defaults, sets name and starting address
+	void end_program(instruction& end_ins); // applies the default END operand
+	void finish_program(instruction& end_ins); // checks the END operand, sets the first executable instruction
+	// checks a line's operand and appends its object code to out. base is the value
+	// the base register is assumed to hold, -1 if none
+	void encode(instruction& ins, int location, vector<unsigned char>& out, int base = -1);
+	void encode_xe(instruction& ins, int location, vector<unsigned char>& out, int base); // operations of a SIC/XE program
+	void add_object_code(vector<unsigned char>& out, int value, int size); // appends size bytes of value to out
+	void define_symbol(instruction& ins, int value); // adds the label of ins to SYMTAB
+	void append_header_record(string& out, string_view name, int starting_address, int length);
+	void append_end_record(string& out);
+	// address of a symbol used by ins. in one-pass mode an undefined symbol is recorded as
+	// a forward reference to the address field at patch_location and 0 is returned
+	int address_of(string_view symbol, instruction& ins, bool indexed, int patch_location);
+};
+
+void assembler::start_program(instruction& start_ins){
+	if(start_ins.label==""){
+		warning(W_NOSTL);
+		start_ins.label=PRG_DFLTN;
+		start_ins.label_hash=symbol_hash(start_ins.label);
+	}
+	if(start_ins.operand==""){
+		warning(W_NOSTO, &(start_ins.instruction_text), start_ins.source_line_number);
+		start_ins.operand="0";
+	}
+	if(!parse_int(start_ins.operand, 16, program_starting_address))
+		error(E_NALNM, &(start_ins.instruction_text), start_ins.source_line_number);
+	program_name = string(start_ins.label);
+}
+
+void assembler::end_program(instruction& end_ins){
+	if(end_ins.operand=="" && !linking){ // a module of a program with sections may have no entry point
+		warning(W_NOENO, &(end_ins.instruction_text), end_ins.source_line_number);
+		end_ins.operand=program_name;
+	}
+}
+
+void assembler::split_source(string_view source){
+	int cnt_chunks = 1;
+	if(num_threads > 1) cnt_chunks = max<size_t>(1, min<size_t>(4*num_threads, source.size()/SRC_CHUNK));
+	chunks.assign(cnt_chunks, source_chunk());
+
+	// chunk boundaries, each one just after a newline
+	size_t chunk_begin = 0;
+	for(int c = 0; c<cnt_chunks; c++){
+		size_t chunk_end = source.size();
+		if(c+1 < cnt_chunks){
+			chunk_end = max(chunk_begin, source.size()*(c+1)/cnt_chunks);
+			chunk_end = source.find('\n', chunk_end);
+			chunk_end = (chunk_end == string_view::npos) ? source.size() : chunk_end+1;
+		}
+		chunks[c].text = source.substr(chunk_begin, chunk_end-chunk_begin);
+		chunk_begin = chunk_end;
+	}
+
+	// every newline ends a line, and the text after the last one is a line too
+	parallel_for(cnt_chunks, num_threads, [&](int c){
+		chunks[c].cnt_lines = count(chunks[c].text.begin(), chunks[c].text.end(), '\n');
+	});
+	chunks.back().cnt_lines++;
+	int first_line = 0;
+	for(source_chunk& chunk: chunks){
+		chunk.first_line = first_line;
+		first_line += chunk.cnt_lines;
+		chunk.failed = false;
+	}
+}
+
+void assembler::chunk_error(source_chunk& chunk, const assembly_error& err, int line){
+	if(chunk.failed && chunk.error_line <= line) return;
+	chunk.failed = true;
+	chunk.diag = err.diag;
+	chunk.error_line = line;
+}
+
+void assembler::throw_first_error(){
+	for(source_chunk& chunk: chunks) if(chunk.failed) throw assembly_error(chunk.diag);
+}
+
+void assembler::pass_1(string_view source){
+	// main code of the first pass
+	// splitting the source into lines and parsing them in place, a chunk per thread
+	phase_timer timer(stats, P_TOKENIZE);
+	split_source(source);
+	program.assign(chunks.back().first_line + chunks.back().cnt_lines, instruction());
+	parallel_for(chunks.size(), num_threads, [&](int c){
+		source_chunk& chunk = chunks[c];
+		chunk.has_blank = chunk.has_xe = chunk.has_literals = chunk.has_expressions = chunk.has_definitions = chunk.has_sections = false;
+		chunk.first_statement = chunk.first_end = -1;
+		size_t line_begin = 0;
+		for(int i = chunk.first_line; i<chunk.first_line+chunk.cnt_lines; i++){
+			size_t line_end = chunk.text.find('\n', line_begin);
+			if(line_end == string_view::npos) line_end = chunk.text.size();
+			try{
+				program[i] = instruction(chunk.text.substr(line_begin, line_end-line_begin), i+1);
+			}catch(assembly_error& err){
+				chunk_error(chunk, err, i);
+				return;
+			}
+			line_begin = line_end+1;
+			if(program[i].is_blank) chunk.has_blank = true;
+			if(program[i].is_xe) chunk.has_xe = true;
+			if(program[i].uses_literals()) chunk.has_literals = true;
+			if(program[i].uses_expressions()) chunk.has_expressions = true;
+			if(program[i].mnemonic==M_EQU || program[i].mnemonic==M_ORG) chunk.has_definitions = true;
+			if(program[i].uses_sections()) chunk.has_sections = true;
+			if(program[i].mnemonic!=M_NONE && chunk.first_statement<0) chunk.first_statement = i;
+			if(program[i].mnemonic==M_END && chunk.first_end<0) chunk.first_end = i;
+		}
+	});
+	throw_first_error();
+
+	// deal with start instruction
+	timer.next(P_LOCATE);
+	int start_line = -1, end_line = -1;
+	for(source_chunk& chunk: chunks){
+		if(chunk.has_blank) fl_empty_lines = true;
+		if(chunk.has_xe) xe = true;
+		if(chunk.has_literals) literals = true;
+		if(chunk.has_expressions) expressions = true;
+		if(chunk.has_definitions) definitions = true;
+		if(chunk.has_sections) linking = true;
+		if(start_line<0) start_line = chunk.first_statement;
+		if(end_line<0) end_line = chunk.first_end;
+	}
+	if(start_line<0) error(E_NOSTT);
+	instruction& start_ins = program[start_line];
+	if(start_ins.mnemonic!=M_START) error(E_NOFST, &(start_ins.instruction_text), start_ins.source_line_number);
+	start_program(start_ins);
+
+	// deal with end instruction
+	if(end_line<0) error(E_NOEND);
+	end_program(program[end_line]);
+	if(literals) place_literals(start_line, end_line);
+	find_sections(start_line, end_line);
+
+	// each section is located, gets its symbol table and is relaxed on its own
+	location.assign(program.size(), -1);
+	for(int s = 0; s<(int)sections.size(); s++){
+		control_section& section = sections[s];
+		enter_section(s);
+		timer.next(P_LOCATE);
+		int location_counter = locate(section.first_line, section.end_line);
+
+		// building the symbol table from the labels in line order, the first clash is
+		// the error unless the chunk failed earlier. the names are already hashed
+		timer.next(P_SYMBOLS);
+		size_t cnt_labels = 0;
+		for(source_chunk& chunk: chunks) cnt_labels += chunk.label_lines.size();
+		SYMTAB.reserve(cnt_labels + literal_names.size());
+		for(source_chunk& chunk: chunks){
+			for(int i: chunk.label_lines){
+				instruction& ins = program[i];
+				if(!SYMTAB.insert(ins.label, ins.label_hash, location[i]).second){
+					chunk_error(chunk, assembly_error({true, E_SALEX(ins.label), string(ins.instruction_text), ins.source_line_number}), i);
+					break;
+				}
+			}
+			if(chunk.failed) throw_first_error();
+		}
+		for(int i: section.extref_lines){ // the external symbols, valued by the linking loader
+			instruction& ins = program[i];
+			for(string_view name: ins.names()){
+				auto [sym, added] = SYMTAB.insert(name, symbol_hash(name), 0);
+				if(!added) error(E_SALEX(name), &(ins.instruction_text), ins.source_line_number);
+				external_symbols.resize(SYMTAB.size());
+				external_symbols[sym] = true;
+			}
+		}
+		if(definitions) location_counter = resolve_definitions(location_counter);
+		define_literals(section.first_line, section.end_line);
+		if(optimize && peephole(section.first_line, section.end_line)) location_counter = relocate(section.first_line, section.end_line);
+		if(xe) location_counter = relax(section.first_line, section.end_line, location_counter);
+		section.length = location_counter - section.origin;
+	}
+	enter_section(0);
+
+	// set the value of program length, that of the first section
+	length_of_program = sections[0].length;
+	for(int s = 0, address = program_starting_address; s<(int)sections.size(); s++){
+		sections[s].address = address;
+		address += sections[s].length;
+	}
+
+	// writing the intermediate file, each chunk formatted on its own
+	timer.next(P_FORMAT);
+	if(emit & (1<<OUT_INTERMEDIATE)){
+		format_chunks(result.intermediate_file, [&](int i, string& out){
+			program[i].append_to(out, location[i]);
+		});
+	}else{ // only the check done while formatting, on the highest location
+		for(int i = end_line-1; i>=start_line; i--){
+			if(location[i]<0) continue;
+			if(location[i]>=(2<<15)) error(E_LOCLG);
+			break;
+		}
+	}
+	return;
+}
+
+// collects the literals used from START to END in LITTAB by their bytes, and places each
+// in the first pool after its first use: the lines after an LTORG, or those just before
+// a CSECT or END. a literal whose bytes are already placed in the same control section
+// uses that copy, however it is spelled. the pool lines are inserted into program, the
+// chunks and END move along
+void assembler::place_literals(int start_line, int& end_line){
+	vector<instruction> placed;
+	placed.reserve(program.size() + 64);
+	vector<symbol_table::handle> pending; // literals to place in the next pool, in order of first use
+	symbol_table spellings; // of the section
+	string bytes, key; // LITTAB is keyed by the number of the section and the bytes
+	int section = 0;
+	literal_count = {};
+	auto place_pool = [&](const instruction& at){
+		if(pending.size()) literal_count.pools++;
+		for(symbol_table::handle h: pending){
+			instruction literal;
+			literal.instruction_text = at.instruction_text; // errors are reported against the LTORG or END
+			literal.source_line_number = at.source_line_number;
+			literal.operand = program[LITTAB.value(h)].operand;
+			literal.operand_hash = program[LITTAB.value(h)].operand_hash;
+			literal.mnemonic = M_BYTE;
+			literal.type_of_operand = O_LITRL;
+			literal.is_blank = false;
+			literal.is_literal = true;
+			literal.size_in_memory = LITTAB.symbols[h].name.size() - sizeof(section);
+			LITTAB.set_value(h, placed.size());
+			placed.push_back(literal);
+		}
+		pending.clear();
+	};
+	for(source_chunk& chunk: chunks){
+		int first_line = placed.size(), first_end = -1, first_statement = -1;
+		for(int i = chunk.first_line; i<chunk.first_line+chunk.cnt_lines; i++){
+			instruction& ins = program[i];
+			if(i == end_line) place_pool(ins);
+			if(ins.mnemonic == M_CSECT && i > start_line && i < end_line){
+				place_pool(ins);
+				section++;
+				spellings.clear();
+			}
+			if(i == chunk.first_end) first_end = placed.size();
+			if(i == chunk.first_statement) first_statement = placed.size();
+			placed.push_back(ins);
+			if(i <= start_line || i >= end_line) continue;
+			if(ins.mnemonic == M_LTORG) place_pool(ins);
+			if(ins.type_of_operand != O_LITRL) continue;
+
+			// LITTAB is valued with the line first using a literal until it is placed
+			literal_bytes(ins.operand, bytes); // checked by the parser
+			key.assign((const char*)&section, sizeof(section));
+			key += bytes;
+			auto [h, added] = LITTAB.insert(key, symbol_hash(key), i);
+			if(added){
+				pending.push_back(h);
+				literal_count.literals++;
+				literal_count.bytes += bytes.size();
+			}
+			literal_count.uses++;
+			literal_count.bytes_used += bytes.size();
+			if(spellings.insert(ins.operand, ins.operand_hash, 0).second) literal_names.push_back({placed.size()-1, h});
+		}
+		chunk.first_line = first_line;
+		chunk.cnt_lines = placed.size()-first_line;
+		chunk.first_end = first_end;
+		chunk.first_statement = first_statement;
+	}
+	end_line = -1;
+	for(source_chunk& chunk: chunks) if(end_line<0) end_line = chunk.first_end;
+	program = move(placed);
+	if(stats) stats->literals = literal_count;
+}
+
+void assembler::define_literals(int start_line, int end_line){
+	for(auto [line, h]: literal_names){
+		if(line < start_line || line >= end_line) continue;
+		instruction& ins = program[line];
+		int value = location[LITTAB.value(h)];
+		symbol_table::handle sym = SYMTAB.find(ins.operand, ins.operand_hash);
+		if(sym<0) SYMTAB.insert(ins.operand, ins.operand_hash, value);
+		else SYMTAB.set_value(sym, value);
+	}
+}
+
+// the sections of the program, split at its CSECTs, with SYMTAB that of the first
+void assembler::find_sections(int start_line, int end_line){
+	sections.clear();
+	auto add_section = [&](string_view name, int line, int origin){
+		if(sections.size()) sections.back().end_line = line;
+		sections.emplace_back();
+		control_section& section = sections.back();
+		section.name = name;
+		section.first_line = line;
+		section.origin = origin;
+		section.length = section.address = 0;
+	};
+	add_section(program[start_line].label, start_line, program_starting_address);
+	for(int i = start_line+1; linking && i<end_line; i++){
+		instruction& ins = program[i];
+		if(ins.mnemonic == M_CSECT) add_section(ins.label, i, 0);
+		else if(ins.mnemonic == M_EXTDEF) sections.back().extdef_lines.push_back(i);
+		else if(ins.mnemonic == M_EXTREF) sections.back().extref_lines.push_back(i);
+	}
+	sections.back().end_line = end_line;
+	current_section = 0;
+}
+
+void assembler::enter_section(int s){
+	if(s == current_section) return;
+	for(control_section* section: {&sections[current_section], &sections[s]}){
+		swap(SYMTAB, section->symbols);
+		swap(absolute_symbols, section->absolute_symbols);
+		swap(external_symbols, section->external_symbols);
+	}
+	current_section = s;
+}
+
+// the EQU and ORG lines form a dependency graph with the symbols of their expressions: an
+// EQU depends on the symbols and * in its expression, a label on the ORG before it, and an
+// ORG on its expression, or without one on the ORG before the previous one, whose location
+// it restores. each is valued once, in a topological order found by a depth first search,
+// and a cycle is an error. the ORGs split the program into segments, the first from START,
+// and the lines of each move by its value less the location counter it was located at
+int assembler::resolve_definitions(int end){
+	vector<definition> defs;
+	for(source_chunk& chunk: chunks) defs.insert(defs.end(), chunk.definitions.begin(), chunk.definitions.end());
+	int cnt_defs = defs.size();
+	auto is_equ = [&](int d){ return program[defs[d].line].mnemonic == M_EQU; };
+
+	// a line of segment s is at base[s] + its location counter - origin[s]
+	vector<int> org_defs = {-1}; // the ORG starting each segment
+	vector<int> org_lines; // their lines, from segment 1 on
+	vector<int> segment(cnt_defs); // the segment the line of each definition is in
+	for(int d = 0; d<cnt_defs; d++){
+		segment[d] = org_defs.size()-1;
+		if(!is_equ(d)){
+			org_defs.push_back(d);
+			org_lines.push_back(defs[d].line);
+		}
+	}
+	int cnt_segments = org_defs.size();
+	vector<int> base(cnt_segments), origin(cnt_segments);
+	base[0] = origin[0] = sections[current_section].origin;
+	for(int s = 1; s<cnt_segments; s++) origin[s] = defs[org_defs[s]].counter;
+	auto location_counter = [&](int s, int counter){ return base[s] + counter - origin[s]; };
+
+	// the definition each symbol depends on, that of an EQU symbol or the ORG starting the
+	// segment of a label, -1 for the labels before any ORG and the literals
+	vector<int> symbol_node(SYMTAB.size(), -1);
+	for(source_chunk& chunk: chunks){
+		for(int i: chunk.label_lines){
+			symbol_table::handle sym = SYMTAB.find(program[i].label, program[i].label_hash);
+			if(program[i].mnemonic == M_EQU){
+				symbol_node[sym] = lower_bound(defs.begin(), defs.end(), i, [](const definition& d, int line){ return d.line < line; }) - defs.begin();
 			}else{
-				// should never reach here as sanitization alreaady done while parsing the line
+				symbol_node[sym] = org_defs[upper_bound(org_lines.begin(), org_lines.end(), i) - org_lines.begin()];
+			}
+		}
+	}
+
+	// the edges of the graph, from each definition to those it depends on
+	vector<vector<int>> deps(cnt_defs);
+	for(int d = 0; d<cnt_defs; d++){
+		instruction& ins = program[defs[d].line];
+		int s = segment[d];
+		if(ins.operand.empty()){ // an ORG restoring the location before the previous one
+			if(s < 1) error(E_ORGRS, &(ins.instruction_text), ins.source_line_number);
+			if(s >= 2) deps[d].push_back(org_defs[s-1]);
+			continue;
+		}
+		auto depend = [&](string_view name, expression_value&){
+			symbol_table::handle sym = SYMTAB.find(name);
+			if(sym>=0 && symbol_node[sym]>=0) deps[d].push_back(symbol_node[sym]);
+			return string(); // an undefined symbol is reported when the expression is valued
+		};
+		expression_value value;
+		bool uses_star;
+		evaluate_expression(ins.operand, 0, depend, value, true, &uses_star);
+		if(uses_star && s >= 1) deps[d].push_back(org_defs[s]);
+	}
+
+	// the topological order, the dependencies of each definition come before it
+	vector<int> order;
+	order.reserve(cnt_defs);
+	vector<char> state(cnt_defs, 0); // 0 not visited, 1 on the path, 2 in the order
+	vector<pair<int, size_t>> path; // definitions being visited, with the next dependency to visit
+	for(int root = 0; root<cnt_defs; root++){
+		if(state[root]) continue;
+		state[root] = 1;
+		path.push_back({root, 0});
+		while(path.size()){
+			int d = path.back().first;
+			if(path.back().second == deps[d].size()){
+				state[d] = 2;
+				order.push_back(d);
+				path.pop_back();
+				continue;
+			}
+			int dep = deps[d][path.back().second++];
+			if(state[dep] == 1){ // a cycle, the path back to dep, reported on its earliest line
+				int line = defs[dep].line;
+				for(size_t k = path.size(); path[k-1].first != dep; k--) line = min(line, defs[path[k-1].first].line);
+				error(E_DFCYC, &(program[line].instruction_text), program[line].source_line_number);
+			}
+			if(state[dep] == 0){
+				state[dep] = 1;
+				path.push_back({dep, 0});
+			}
+		}
+	}
+
+	// valuing the definitions in order, a label is valued with the base of its segment
+	absolute_symbols.assign(SYMTAB.size(), false);
+	auto symbol_value = [&](string_view name, expression_value& value){
+		symbol_table::handle sym = SYMTAB.find(name);
+		if(sym<0) return E_INVSY(name);
+		if(is_external(sym)) return string(E_EXUSE); // not known until linking
+		int node = symbol_node[sym];
+		if(node>=0 && is_equ(node)){
+			value = {SYMTAB.value(sym), !is_absolute(sym), false};
+		}else{
+			int s = (node<0) ? 0 : segment[node]+1;
+			value = {location_counter(s, SYMTAB.value(sym)), 1, false};
+		}
+		return string();
+	};
+	for(int d: order){
+		instruction& ins = program[defs[d].line];
+		int s = segment[d];
+		if(ins.operand.empty()){
+			base[s+1] = location_counter(s-1, defs[org_defs[s]].counter);
+			continue;
+		}
+		expression_value value;
+		string err = evaluate_expression(ins.operand, location_counter(s, defs[d].counter), symbol_value, value);
+		if(err.size()) error(err, &(ins.instruction_text), ins.source_line_number);
+		if(is_equ(d)){
+			symbol_table::handle sym = SYMTAB.find(ins.label, ins.label_hash);
+			SYMTAB.set_value(sym, value.value);
+			absolute_symbols[sym] = !value.relative;
+		}else{
+			if(value.value < 0 || value.value >= SIC_MEMORY) error(E_EXOUT, &(ins.instruction_text), ins.source_line_number);
+			base[s+1] = value.value;
+		}
+	}
+
+	// moving the segments, the end of the program is the highest location of any
+	int highest = location_counter(0, (cnt_segments > 1) ? origin[1] : end);
+	for(int s = 1; s<cnt_segments; s++){
+		int first = org_lines[s-1], last = (s+1 < cnt_segments) ? org_lines[s] : program.size();
+		int shift = base[s] - origin[s];
+		highest = max(highest, ((s+1 < cnt_segments) ? origin[s+1] : end) + shift);
+		if(shift) for(int i = first; i<last; i++) if(location[i]>=0) location[i] += shift;
+	}
+	for(source_chunk& chunk: chunks){
+		for(int i: chunk.label_lines){
+			if(program[i].mnemonic != M_EQU) SYMTAB.set_value(SYMTAB.find(program[i].label, program[i].label_hash), location[i]);
+		}
+	}
+	return highest;
+}
+
+// sets the location of every instruction. the locations are a prefix sum of the
+// sizes of the lines from START to END, summed per chunk then spread within each
+int assembler::locate(int start_line, int end_line){
+	parallel_for(chunks.size(), num_threads, [&](int c){
+		source_chunk& chunk = chunks[c];
+		chunk.size_in_memory = 0;
+		int first = max(chunk.first_line, start_line), last = min(chunk.first_line+chunk.cnt_lines, end_line);
+		for(int i = first; i<last; i++) chunk.size_in_memory += program[i].size_in_memory;
+	});
+	int location_counter = sections[current_section].origin;
+	for(source_chunk& chunk: chunks){
+		chunk.location_counter = location_counter;
+		location_counter += chunk.size_in_memory;
+	}
+	parallel_for(chunks.size(), num_threads, [&](int c){
+		source_chunk& chunk = chunks[c];
+		int location_counter = chunk.location_counter;
+		int first = max(chunk.first_line, start_line), last = min(chunk.first_line+chunk.cnt_lines, end_line);
+		chunk.label_lines = {};
+		chunk.definitions = {};
+		for(int i = first; i<last; i++){
+			instruction& ins = program[i];
+			if(ins.mnemonic==M_START && i!=start_line){
+				chunk_error(chunk, assembly_error({true, E_MPLST, string(ins.instruction_text), ins.source_line_number}), i);
+				return;
+			}
+			if(ins.size_in_memory || ins.mnemonic==M_START || ins.mnemonic==M_CSECT){
+				location[i] = location_counter;
+				location_counter += ins.size_in_memory;
+				if(ins.label.size()) chunk.label_lines.push_back(i);
+			}else if(ins.mnemonic==M_EQU || ins.mnemonic==M_ORG){
+				if(ins.mnemonic==M_EQU) chunk.label_lines.push_back(i);
+				chunk.definitions.push_back({i, location_counter});
+			}
+		}
+	});
+	return location_counter;
+}
+
+// an address reached by format 3 from the instruction before pc, relative to pc or to base
+inline bool reaches(int address, int pc, int base){
+	return (address-pc >= -2048 && address-pc < 2048) || (base >= 0 && address-base >= 0 && address-base < 4096);
+}
+
+int assembler::base_after(const instruction& ins, int base){
+	if(ins.mnemonic == M_NOBASE) return -1;
+	if(ins.mnemonic != M_BASE) return base;
+	symbol_table::handle sym = SYMTAB.find(ins.operand, ins.operand_hash);
+	return (sym>=0) ? SYMTAB.value(sym) : -1; // an error in pass 2
+}
+
+// every operation of format 3 starts out short. one whose address is out of reach of
+// both PC and base relative addressing, or whose number doesn't fit 12 bits, grows to
+// format 4, as does one using an external symbol, whose address only the linking loader
+// knows. once a pass over the program has grown any the program is located again, along
+// with SYMTAB. sizes only grow, so this ends, in a pass or two for most programs
+int assembler::relax(int start_line, int end_line, int end){
+	int location_counter = end;
+	external_terms externals;
+	while(true){
+		bool grown = false;
+		int base = -1;
+		for(int i = start_line; i<end_line; i++){
+			instruction& ins = program[i];
+			base = base_after(ins, base);
+			if(ins.size_in_memory != 3 || !is_operation(ins.mnemonic) || (ins.type_of_operand != O_LABEL
+				&& ins.type_of_operand != O_INDXD && ins.type_of_operand != O_LITRL && ins.type_of_operand != O_EXPRS))
+				continue;
+			bool relative;
+			int value;
+			externals.clear();
+			try{
+				value = operand_value(ins, location[i], relative, &externals);
+			}catch(assembly_error& err){
+				continue; // reported by pass 2
+			}
+			// an address is reached relative to PC or base, a number is the displacement itself
+			if(externals.size() || (relative ? !reaches(value, location[i]+3, base) : (value < 0 || value >= (1<<12)))){
+				ins.size_in_memory = 4;
+				grown = true;
+			}
+		}
+		if(!grown) return location_counter;
+		location_counter = relocate(start_line, end_line);
+	}
+}
+
+int assembler::relocate(int start_line, int end_line){
+	int location_counter = locate(start_line, end_line);
+	for(source_chunk& chunk: chunks){
+		for(int i: chunk.label_lines) SYMTAB.set_value(SYMTAB.find(program[i].label, program[i].label_hash), location[i]);
+	}
+	if(definitions) location_counter = resolve_definitions(location_counter);
+	define_literals(start_line, end_line);
+	return location_counter;
+}
+
+// the peephole optimizer (-O), run on the located program once SYMTAB is built. a label
+// starts a basic block that jumps may enter, so a line is only rewritten along with the
+// statements before it if it has no label itself:
+//	STA BUF; LDA BUF	the load is removed, the register already holds the word (for
+//				any store and the load of its register)
+//	JSUB SUB; LDL RET; RSUB	becomes LDL RET; J SUB, so that SUB returns to the caller. RET
+//				must be stored by a single STL only, and nothing indirectly or indexed
+//	J NEXT, NEXT J FAR	the first jump goes to FAR, as does a conditional jump or a
+//				JSUB to a J, or a conditional jump to the same one
+// a removed line keeps its place in program without a size, so that the lines known to
+// pass 1 stay put. programs with expressions are never shortened, their values could
+// depend on the lines between two addresses
+bool assembler::peephole(int start_line, int end_line){
+	vector<int> label_line(SYMTAB.symbols.size(), -1); // the line of every label, by handle
+	for(source_chunk& chunk: chunks){
+		for(int i: chunk.label_lines) if(program[i].mnemonic != M_EQU) label_line[SYMTAB.find(program[i].label, program[i].label_hash)] = i;
+	}
+	auto symbol_of = [&](const instruction& ins){ // the handle of a symbol operand, -1 if it has none
+		if(ins.type_of_operand != O_LABEL && ins.type_of_operand != O_INDXD) return -1;
+		return SYMTAB.find(ins.operand_symbol(), ins.operand_hash);
+	};
+	auto remove = [&](int i){
+		peephole_count.bytes += program[i].size_in_memory;
+		program[i].size_in_memory = 0;
+		program[i].removed = true;
+		location[i] = -1;
+	};
+
+	// the stores into every symbol, and whether any could write anywhere
+	vector<int> stores(SYMTAB.symbols.size(), 0), saves(SYMTAB.symbols.size(), 0);
+	bool stores_anywhere = false;
+	for(int i = start_line+1; i<end_line; i++){
+		instruction& ins = program[i];
+		if(!is_store(ins.mnemonic)) continue;
+		if(ins.addressing == A_INDIRECT || ins.indexed) stores_anywhere = true; // may write past the symbol, into another
+		int sym = symbol_of(ins);
+		if(sym < 0) continue;
+		stores[sym]++;
+		if(ins.mnemonic == M_STL && ins.addressing == A_SIMPLE && !ins.indexed) saves[sym]++;
+	}
+
+	int last = -1, before_last = -1; // the statements kept before line i, -1 past a label
+	for(int i = start_line+1; !expressions && i<end_line; i++){
+		instruction& ins = program[i];
+		if(ins.mnemonic == M_NONE) continue; // comments and blank lines
+		if(ins.label.size()) last = before_last = -1;
+		if(last >= 0 && ins.mnemonic == load_of_store(program[last].mnemonic) && ins.operand == program[last].operand
+			&& (ins.type_of_operand == O_LABEL || ins.type_of_operand == O_INDXD) && ins.addressing != A_IMMEDIATE){
+			remove(i);
+			peephole_count.loads++;
+			rewrites.push_back({i, "-O: removed, the register already holds what " + string(MNEMONICS[program[last].mnemonic].name)
+				+ " " + string(program[last].operand) + " stored"});
+			continue; // the store is still the last statement
+		}
+		if(ins.mnemonic == M_RSUB && before_last >= 0 && program[last].mnemonic == M_LDL && program[before_last].mnemonic == M_JSUB
+			&& program[before_last].type_of_operand != O_LITRL && program[last].type_of_operand == O_LABEL
+			&& program[last].addressing == A_SIMPLE && !stores_anywhere){
+			int sym = symbol_of(program[last]);
+			if(sym >= 0 && stores[sym] == 1 && saves[sym] == 1){
+				// the JSUB line becomes the LDL, keeping its label, and the LDL line the J. errors
+				// are still reported on the source line of each operand
+				instruction call = program[before_last], restore = program[last];
+				rewrites.push_back({before_last, "-O: tail call, JSUB " + string(call.operand) + "; LDL " + string(restore.operand)
+					+ "; RSUB made LDL " + string(restore.operand) + "; J " + string(call.operand)});
+				program[before_last] = restore;
+				program[before_last].label = call.label;
+				program[before_last].label_hash = call.label_hash;
+				program[last] = call;
+				program[last].mnemonic = M_J;
+				program[last].label = "";
+				program[last].label_hash = 0;
+				remove(i);
+				peephole_count.tail_calls++;
+				continue;
+			}
+		}
+		before_last = last;
+		last = i;
+	}
+
+	// jumps are threaded once the tail calls are jumps too
+	for(int i = start_line+1; i<end_line; i++){
+		instruction& ins = program[i];
+		mnemonic_id op = ins.mnemonic;
+		if((op != M_J && op != M_JEQ && op != M_JLT && op != M_JGT && op != M_JSUB) || ins.removed) continue;
+		if(ins.type_of_operand != O_LABEL || ins.addressing != A_SIMPLE) continue;
+		vector<int> path = {i}; // the jumps passed, a cycle of them is left where it closes
+		while(true){
+			const instruction& jump = program[path.back()];
+			int sym = SYMTAB.find(jump.operand, jump.operand_hash);
+			int next = (sym >= 0) ? label_line[sym] : -1;
+			if(next < 0 || find(path.begin(), path.end(), next) != path.end()) break;
+			const instruction& target = program[next];
+			if(target.mnemonic != M_J && (target.mnemonic != op || op == M_JSUB)) break;
+			if(target.type_of_operand != O_LABEL || target.addressing != A_SIMPLE) break;
+			path.push_back(next);
+		}
+		if(path.size() < 2) continue;
+		string_view went_to = ins.operand;
+		ins.operand = program[path.back()].operand;
+		ins.operand_hash = program[path.back()].operand_hash;
+		peephole_count.jumps++;
+		rewrites.push_back({i, "-O: threaded through " + std::to_string(path.size()-1) + " jump" + (path.size() > 2 ? "s" : "")
+			+ ", went to " + string(went_to)});
+	}
+	stable_sort(rewrites.begin(), rewrites.end(), [](const pair<int, string>& a, const pair<int, string>& b){ return a.first < b.first; });
+	if(stats) stats->peephole = peephole_count;
+	return peephole_count.bytes > 0;
+}
+
+void assembler::format_chunks(string& out, const function<void(int, string&)>& format){
+	parallel_for(chunks.size(), num_threads, [&](int c){
+		source_chunk& chunk = chunks[c];
+		chunk.output = "";
+		try{
+			for(int i = chunk.first_line; i<chunk.first_line+chunk.cnt_lines; i++) format(i, chunk.output);
+		}catch(assembly_error& err){
+			chunk_error(chunk, err, chunk.first_line);
+		}
+	});
+	throw_first_error();
+	size_t total_size = out.size();
+	for(source_chunk& chunk: chunks) total_size += chunk.output.size();
+	out.reserve(total_size);
+	for(source_chunk& chunk: chunks){
+		out += chunk.output;
+		chunk.output = string();
+	}
+}
+
+void assembler::add_object_code(vector<unsigned char>& out, int value, int size){
+	for(int shift = 8*(size-1); shift>=0; shift -= 8) out.push_back((value >> shift) & 0xff);
+}
+
+void assembler::define_symbol(instruction& ins, int value){
+	if(ins.label.size()==0) return;
+	if(!SYMTAB.insert(ins.label, ins.label_hash, value).second)
+		error(E_SALEX(ins.label), &(ins.instruction_text), ins.source_line_number);
+	if(!one_pass) return;
+
+	// patching the forward references to it
+	auto refs = forward_refs.find(ins.label);
+	if(refs == forward_refs.end()) return;
+	for(forward_reference& ref: refs->second){ // the patched code must already be emitted
+		if(ref.patch_location >= record_start && object_bytes.size()){
+			flush_text_record();
+			break;
+		}
+	}
+	for(forward_reference& ref: refs->second){
+		char* p = grow(result.object_program, 17);
+		p = put_text(p, "T^");
+		p = put_hex(p, ref.patch_location, 6);
+		p = put_text(p, "^02^");
+		p = put_hex(p, (ref.indexed << 15) + value, 4);
+		*p = '\n';
+	}
+	forward_refs.erase(refs);
+}
+
+int assembler::address_of(string_view symbol, instruction& ins, bool indexed, int patch_location){
+	symbol_table::handle sym = SYMTAB.find(symbol, ins.operand_hash);
+	if(sym>=0) return SYMTAB.value(sym);
+	if(pipelined){ // patched at END, the object code is filled in by the encoder stage
+		pipeline_refs.push_back({string(symbol), ins.operand_hash, 0, string(ins.instruction_text), ins.source_line_number});
+		return 0;
+	}
+	if(!one_pass) error(E_INVSY(symbol), &(ins.instruction_text), ins.source_line_number);
+	forward_refs[symbol].push_back({patch_location, indexed, ins.instruction_text, ins.source_line_number});
+	return 0;
+}
+
+int assembler::operand_value(instruction& ins, int location, bool& relative, external_terms* externals){
+	if(ins.type_of_operand == O_EXPRS){
+		auto symbol_value = [&](string_view name, expression_value& value){
+			symbol_table::handle sym = SYMTAB.find(name);
+			if(sym<0) return E_INVSY(name);
+			if(is_external(sym)) value = {0, 0, true};
+			else value = {SYMTAB.value(sym), !is_absolute(sym), false};
+			return string();
+		};
+		expression_value value;
+		string err = evaluate_expression(ins.operand_symbol(), location, symbol_value, value, false, NULL, externals);
+		if(err.size()) error(err, &(ins.instruction_text), ins.source_line_number);
+		relative = value.relative;
+		return value.value;
+	}
+	symbol_table::handle sym = SYMTAB.find(ins.operand_symbol(), ins.operand_hash);
+	if(sym<0) error(E_INVSY(ins.operand_symbol()), &(ins.instruction_text), ins.source_line_number);
+	if(is_external(sym)){
+		if(!externals) error(E_EXUSE, &(ins.instruction_text), ins.source_line_number);
+		externals->push_back({ins.operand_symbol(), 1});
+		relative = false;
+		return 0;
+	}
+	relative = !is_absolute(sym);
+	return SYMTAB.value(sym);
+}
+
+void assembler::encode(instruction& ins, int location, vector<unsigned char>& out, int base){
+	// checking for the operand structure
+	// all operations require a single label like structure(or a comma 
+	// type structure) except RSUB (requires nothing)
+	// assembler directives START and END completely sanitized, although multiple ENDs 
+	// can exist in which case the first END is sanitized
+	// other 4 asm directives BYTE, WORD, RESB, RESW have data types that are
+	// completely identified but not sanitized
+	// ** individual sanitization done, only structural 
+	if(ins.is_literal){ // a line of a literal pool
+		string bytes;
+		literal_bytes(ins.operand, bytes);
+		out.insert(out.end(), bytes.begin(), bytes.end());
+	}else if(ins.mnemonic == M_BASE){ // no object code, its symbol must exist
+		address_of(ins.operand, ins, false, 0);
+		if(is_external(SYMTAB.find(ins.operand, ins.operand_hash))) error(E_EXUSE, &(ins.instruction_text), ins.source_line_number);
+	}else if(ins.mnemonic == M_EXTDEF){ // no object code, its symbols must be addresses of the section
+		for(string_view name: ins.names()){
+			symbol_table::handle sym = SYMTAB.find(name);
+			if(sym<0) error(E_INVSY(name), &(ins.instruction_text), ins.source_line_number);
+			if(is_external(sym) || is_absolute(sym)) error(E_EXDEF(name), &(ins.instruction_text), ins.source_line_number);
+		}
+	}else if(ins.mnemonic == M_NOBASE || ins.mnemonic == M_LTORG || ins.mnemonic == M_EQU || ins.mnemonic == M_ORG
+		|| ins.mnemonic == M_CSECT || ins.mnemonic == M_EXTREF){
+		return; // no object code, an EQU or ORG is checked as it is valued
+	}else if(is_operation(ins.mnemonic) && xe){
+		encode_xe(ins, location, out, base);
+	}else if(ins.mnemonic == M_RESW || ins.mnemonic == M_RESB){
+		if(ins.type_of_operand!=O_DECIM && ins.type_of_operand!=O_HEXAD) // structural sanity check
+			error(E_RWNDM, &(ins.instruction_text), ins.source_line_number);
+	}else if(!is_operation(ins.mnemonic)){
+		// either word or byte
+		operand_type otyp = ins.type_of_operand;
+		if(ins.mnemonic==M_WORD && (otyp==O_LABEL || otyp==O_EXPRS)){ // an address or number, negative ones in two's complement
+			bool relative;
+			external_terms externals; // added by the linking loader
+			add_object_code(out, operand_value(ins, location, relative, &externals) & 0xffffff, 3);
+			return;
+		}
+		if(ins.mnemonic==M_WORD && otyp!=O_DECIM) // structural sanity check
+			error(E_WDNDM, &(ins.instruction_text), ins.source_line_number);
+		if((otyp!=O_DECIM) && (otyp!=O_HEXAD && otyp!=O_CHRAR)) // structural sanity check
+			error(E_DTERR, &(ins.instruction_text), ins.source_line_number);
+		
+		if(otyp==O_DECIM){
+			int max_data_size;
+			if(ins.mnemonic==M_WORD) max_data_size = 3; else max_data_size = 1;
+			int data_decimal;
+			if(!parse_int(ins.operand, 10, data_decimal)) 
+				error(E_DTOUT, &(ins.instruction_text), ins.source_line_number);
+			if(data_decimal > ((1<<(8*max_data_size))-1)) 
+				error(E_DTOUT, &(ins.instruction_text), ins.source_line_number);
+			add_object_code(out, data_decimal, max_data_size);
+		}else if(otyp == O_HEXAD){
+			// a single byte, given as one or two hexadecimal digits
+			string_view data_hex = ins.operand.substr(2, ins.operand.size()-3);
+			if(data_hex.size()>2)
+				error(E_DTOUT, &(ins.instruction_text), ins.source_line_number);
+			int data_decimal;
+			if(!parse_int(data_hex, 16, data_decimal))
 				error(E_DTERR, &(ins.instruction_text), ins.source_line_number);
+			add_object_code(out, data_decimal, 1);
+		}else if(otyp == O_CHRAR){
+			for(int i = 2; i<(ins.operand.size()-1); i++) out.push_back(ins.operand[i]);
+		}else{
+			// should never reach here as sanitization alreaady done while parsing the line
+			error(E_DTERR, &(ins.instruction_text), ins.source_line_number);
+		}
+	}else{
+		if(ins.mnemonic==M_RSUB){
+			if(ins.operand.size())  // structural sanity check
+				error(E_RSUBO, &(ins.instruction_text), ins.source_line_number);
+			add_object_code(out, MNEMONICS[M_RSUB].opcode << 16, 3);
+		}else{ // all operations other than RSUB expect a memory address 'm' (as label, buffer,x, a literal or an expression)
+			if(ins.type_of_operand!=O_LABEL && ins.type_of_operand!=O_INDXD && ins.type_of_operand!=O_LITRL && ins.type_of_operand!=O_EXPRS) // structural sanity check
+				error(E_DNALW, &(ins.instruction_text), ins.source_line_number);
+			int data_decimal = MNEMONICS[ins.mnemonic].opcode << 16;
+			string_view final_opd = ins.operand;
+			bool indexed = ins.indexed;
+			if(indexed) {
+				final_opd = final_opd.substr(0,(final_opd.size()-2));
+				data_decimal += (1<<15);
+			}
+			if(ins.type_of_operand==O_EXPRS){
+				bool relative;
+				int address = operand_value(ins, location, relative);
+				if(address < 0 || address >= SIC_MEMORY) error(E_EXOUT, &(ins.instruction_text), ins.source_line_number);
+				data_decimal += address;
+			}else{
+				data_decimal += address_of(final_opd, ins, indexed, location+1);
+			}
+			if(data_decimal >= (1<<24)) error(E_INTRL);
+			add_object_code(out, data_decimal, 3);
+		}
+	}
+}
+
+// the object code of an operation of a SIC/XE program, for formats 1 and 2 the
+// opcode and registers. format 3 has the flags n and i of its addressing, x, b and p
+// of an address relative to the base register or to the next instruction (PC) and a 12
+// bit displacement. format 4 has the flag e and a 20 bit address. a value given with #
+// or @ is an address of its own, the displacement if it fits in 12 bits
+void assembler::encode_xe(instruction& ins, int location, vector<unsigned char>& out, int base){
+	const mnemonic_info& info = MNEMONICS[ins.mnemonic];
+	if(info.format == 1){
+		add_object_code(out, info.opcode, 1);
+		return;
+	}
+	if(info.format == 2){
+		add_object_code(out, (info.opcode << 8) | (ins.r1 << 4) | ins.r2, 2);
+		return;
+	}
+	int ni = (ins.addressing == A_IMMEDIATE) ? 1 : (ins.addressing == A_INDIRECT) ? 2 : 3;
+	int code = info.opcode | ni;
+	bool format_4 = (ins.size_in_memory == 4);
+	if(ins.mnemonic == M_RSUB){
+		if(ins.operand.size()) error(E_RSUBO, &(ins.instruction_text), ins.source_line_number);
+		if(format_4) add_object_code(out, (code << 24) | (1 << 20), 4);
+		else add_object_code(out, code << 16, 3);
+		return;
+	}
+	bool number = (ins.type_of_operand == O_DECIM && ins.addressing != A_SIMPLE);
+	if(ins.type_of_operand!=O_LABEL && ins.type_of_operand!=O_INDXD && ins.type_of_operand!=O_LITRL
+		&& ins.type_of_operand!=O_EXPRS && !number) // structural sanity check
+		error(E_DNALW, &(ins.instruction_text), ins.source_line_number);
+	int x = ins.indexed;
+	int address;
+	bool relative = false; // a number (an absolute symbol or expression) is encoded as it is
+	external_terms externals; // added to the address by the linking loader, relax() made it format 4
+	if(number) parse_int(ins.operand.substr(1), 10, address); // checked by the parser
+	else address = operand_value(ins, location, relative, &externals);
+	if(externals.size()) address &= (1<<20)-1;
+	if(!relative && (address < 0 || address >= (1<<20))) error(E_IMOUT, &(ins.instruction_text), ins.source_line_number);
+	if(format_4){
+		if(address >= (1<<20)) error(E_INTRL);
+		add_object_code(out, (code << 24) | (x << 23) | (1 << 20) | address, 4);
+		return;
+	}
+	int flags, displacement;
+	if(!relative){
+		flags = 0;
+		displacement = address; // below 4096, or relax() made it format 4
+	}else if(address-(location+3) >= -2048 && address-(location+3) < 2048){
+		flags = 1 << 13;
+		displacement = (address-(location+3)) & 0xfff;
+	}else if(base >= 0 && address-base >= 0 && address-base < 4096){
+		flags = 1 << 14;
+		displacement = address-base;
+	}else{
+		error(E_NORCH(ins.operand_symbol()), &(ins.instruction_text), ins.source_line_number);
+	}
+	add_object_code(out, (code << 16) | (x << 15) | flags | displacement, 3);
+}
+
+void assembler::finish_program(instruction& end_ins){
+	if(end_ins.operand=="" && linking){
+		first_executable_instruction = -1;
+		return;
+	}
+	if(end_ins.type_of_operand != O_LABEL)
+		error(E_ENDOP, &(end_ins.instruction_text), end_ins.source_line_number);
+	symbol_table::handle sym = SYMTAB.find(end_ins.operand, end_ins.operand_hash);
+	if(sym<0) error(E_INVSY(end_ins.operand), &(end_ins.instruction_text), end_ins.source_line_number);
+	if(is_external(sym)) error(E_ENDOP, &(end_ins.instruction_text), end_ins.source_line_number);
+	first_executable_instruction = SYMTAB.value(sym);
+}
+
+void assembler::append_header_record(string& out, string_view name, int starting_address, int length){
+	char* p = grow(out, 23);
+	*p++ = 'H';
+
+	*p++ = '^';
+	for(int i = 0; i<6; i++) {
+		if(i<name.size()) *p++ = name[i];
+		else *p++ = ' ';
+	}
+
+	// 6 bytes of hexadecimal starting address
+	*p++ = '^';
+	p = put_hex(p, starting_address, 6);
+
+	// 6 bytes of hexadecimal length of program
+	*p++ = '^';
+	p = put_hex(p, length, 6);
+	*p = '\n';
+}
+
+void assembler::append_end_record(string& out){
+	if(first_executable_instruction < 0){ // a module without an entry point
+		out += "E\n";
+		return;
+	}
+	char* p = grow(out, 9);
+	*p++ = 'E';
+	*p++ = '^';
+	// 6 bytes of hexadecimal first executable instruction
+	p = put_hex(p, first_executable_instruction, 6);
+	*p = '\n';
+}
+
+void assembler::pass_2(){
+	// main code
+	// SYMTAB is final, so the lines before END are encoded in parallel, each chunk
+	// into its own buffer with object_offset holding offsets within the chunk
+	phase_timer timer(stats, P_ENCODE);
+	int end_line = -1;
+	for(source_chunk& chunk: chunks) if(end_line<0) end_line = chunk.first_end;
+	object_offset.assign(program.size()+1, 0);
+	for(source_chunk& chunk: chunks) chunk.object_bytes = {};
+
+	// a control section at a time, against its own symbols. the lines before START are
+	// encoded with the first and those from END on with the last, none of them has code
+	for(int s = 0; s<(int)sections.size(); s++){
+		enter_section(s);
+		int first = s ? sections[s].first_line : 0, last = (s+1 < (int)sections.size()) ? sections[s+1].first_line : program.size();
+		int base = -1;
+		for(source_chunk& chunk: chunks){ // the base register assumed where each chunk's part of the section starts
+			chunk.base = base;
+			int chunk_last = min(chunk.first_line+chunk.cnt_lines, last);
+			if(xe) for(int i = max(chunk.first_line, first); i<chunk_last; i++) base = base_after(program[i], base);
+		}
+		parallel_for(chunks.size(), num_threads, [&](int c){
+			source_chunk& chunk = chunks[c];
+			int base = chunk.base;
+			int chunk_last = min(chunk.first_line+chunk.cnt_lines, last);
+			for(int i = max(chunk.first_line, first); i<chunk_last; i++){
+				object_offset[i] = chunk.object_bytes.size();
+				instruction& ins = program[i];
+				if(i >= end_line || ins.mnemonic == M_START || (ins.is_comment || ins.is_blank) || ins.removed) continue;
+				try{
+					encode(ins, location[i], chunk.object_bytes, base);
+					base = base_after(ins, base);
+				}catch(assembly_error& err){
+					chunk_error(chunk, err, i);
+					return;
+				}
+			}
+		});
+		throw_first_error();
+	}
+	enter_section(0);
+	finish_program(program[end_line]);
+
+	// merging the chunks in order, offsets are made absolute and the code copied
+	vector<size_t> chunk_offset(chunks.size()+1, 0);
+	for(int c = 0; c<(int)chunks.size(); c++) chunk_offset[c+1] = chunk_offset[c] + chunks[c].object_bytes.size();
+	object_bytes.resize(chunk_offset.back());
+	parallel_for(chunks.size(), num_threads, [&](int c){
+		source_chunk& chunk = chunks[c];
+		for(int i = chunk.first_line; i<chunk.first_line+chunk.cnt_lines; i++) object_offset[i] += chunk_offset[c];
+		if(chunk.object_bytes.size()) memcpy(object_bytes.data()+chunk_offset[c], chunk.object_bytes.data(), chunk.object_bytes.size());
+		chunk.object_bytes = {};
+	});
+	object_offset[program.size()] = object_bytes.size();
+
+	// writing the assembly listing
+	if(!(emit & (1<<OUT_LISTING))) return;
+	timer.next(P_FORMAT);
+	result.assembly_listing += ALS_HEADER;
+	format_chunks(result.assembly_listing, [&](int i, string& out){
+		int size = object_offset[i+1] - object_offset[i];
+		char* p = grow(out, 2*size + string_view(INDENT).size());
+		p = put_hex_bytes(p, object_bytes.data()+object_offset[i], size);
+		put_text(p, INDENT);
+		program[i].append_to(out, location[i]);
+		auto note = lower_bound(rewrites.begin(), rewrites.end(), i, [](const pair<int, string>& r, int line){ return r.first < line; });
+		for(; note != rewrites.end() && note->first == i; note++) out += INDENT "." INDENT + note->second + "\n";
+	});
+	if(literal_count.literals){
+		const literal_counts& lc = literal_count;
+		char summary[192];
+		snprintf(summary, sizeof(summary), "%s.%sliterals: %d in %d pool%s, %d bytes for %d use%s, %d bytes saved by deduplication\n",
+			INDENT, INDENT, lc.literals, lc.pools, (lc.pools==1 ? "" : "s"), lc.bytes, lc.uses, (lc.uses==1 ? "" : "s"), lc.bytes_used-lc.bytes);
+		result.assembly_listing += summary;
+	}
+	if(optimize){
+		const peephole_counts& pc = peephole_count;
+		char summary[192];
+		snprintf(summary, sizeof(summary), "%s.%speephole: %d load%s removed, %d jump%s threaded, %d tail call%s, %d bytes saved\n",
+			INDENT, INDENT, pc.loads, (pc.loads==1 ? "" : "s"), pc.jumps, (pc.jumps==1 ? "" : "s"), pc.tail_calls, (pc.tail_calls==1 ? "" : "s"), pc.bytes);
+		result.assembly_listing += summary;
+	}
+	return;
+}
+
+void assembler::write_object_program(){
+	// generating the object code records, an object program per control section: its H
+	// record, the D and R records of its EXTDEF and EXTREF, its T and M records and an E
+	// record, with the entry point in that of the first only
+	phase_timer timer(stats, P_RECORDS);
+	string linked_text = ""; // the records of a program with sections, linked for the binary object
+	string& out = (emit & (1<<OUT_OBJECT)) ? result.object_program : linked_text;
+	bool text = (emit & (1<<OUT_OBJECT)) || (linking && (emit & (1<<OUT_BINARY)));
+	vector<text_record> text_records = {};
+	external_terms externals;
+	for(int s = 0; s<(int)sections.size(); s++){
+		control_section& section = sections[s];
+		enter_section(s);
+		size_t first_record = text_records.size();
+		bool insert_new = 1;
+		string modification_records = "";
+		for(int i = section.first_line+1; i<section.end_line; i++){
+			instruction& ins = program[i];
+			if(ins.is_comment || ins.is_blank) continue;
+			// time to write to text records
+			int object_code_size = object_offset[i+1] - object_offset[i];
+			if(ins.mnemonic == M_RESW || ins.mnemonic == M_RESB){
+				insert_new = true;
+				continue;
+			}
+			if(object_code_size == 0) continue; // nothing to load, like BASE or EQU
+			if(insert_new || (text_records.back().total_length + object_code_size) > 30
+				|| location[i] != text_records.back().starting_address + text_records.back().total_length){ // moved by ORG
+				text_records.push_back(text_record(location[i], i));
+				insert_new = false;
+			}
+			text_records.back().insert(i, object_code_size);
+
+			// the addresses a SIC/XE program holds are relocated by its loader: the 20 bit address
+			// of format 4 and a WORD, when they are relative (see resolve_definitions()), and the
+			// linking loader adds or subtracts the address of every external symbol in them
+			if(text && xe && ((is_operation(ins.mnemonic) && ins.size_in_memory == 4) || ins.mnemonic == M_WORD) && (ins.type_of_operand == O_LABEL
+				|| ins.type_of_operand == O_INDXD || ins.type_of_operand == O_LITRL || ins.type_of_operand == O_EXPRS)){
+				bool relative;
+				externals.clear();
+				operand_value(ins, location[i], relative, &externals);
+				bool word = (ins.mnemonic == M_WORD);
+				if(relative){
+					char* p = grow(modification_records, 12);
+					p = put_text(p, "M^");
+					p = put_hex(p, location[i] + !word, 6);
+					p = put_text(p, word ? "^06" : "^05");
+					*p = '\n';
+				}
+				for(auto [name, sign]: externals){
+					char* p = grow(modification_records, 14 + name.size());
+					p = put_text(p, "M^");
+					p = put_hex(p, location[i] + !word, 6);
+					p = put_text(p, word ? "^06^" : "^05^");
+					*p++ = (sign > 0) ? '+' : '-';
+					p = put_text(p, name);
+					*p = '\n';
+				}
+			}
+		}
+		if(!text) continue;
+
+		// writing the object program of the section
+		append_header_record(out, section.name, section.origin, section.length);
+		for(char kind: {'D', 'R'}){ // the names of its EXTDEF and EXTREF, at most OBJ_NAMES a record
+			vector<string_view> names;
+			for(int i: (kind == 'D') ? section.extdef_lines : section.extref_lines){
+				for(string_view name: program[i].names()) names.push_back(name);
+			}
+			for(size_t first = 0; first < names.size(); first += OBJ_NAMES){
+				size_t last = min(names.size(), first + OBJ_NAMES);
+				char* p = grow(out, 2 + (last-first)*((kind == 'D') ? 14 : 7));
+				*p++ = kind;
+				for(size_t k = first; k<last; k++){
+					*p++ = '^';
+					p = put_text(p, names[k]);
+					for(size_t pad = names[k].size(); pad<6; pad++) *p++ = ' ';
+					if(kind == 'R') continue;
+					*p++ = '^';
+					p = put_hex(p, SYMTAB.value(SYMTAB.find(names[k])), 6);
+				}
+				*p = '\n';
+			}
+		}
+		for(size_t r = first_record; r<text_records.size(); r++) text_records[r].append_to(out, object_offset, object_bytes);
+		out += modification_records;
+		if(s == 0) append_end_record(out);
+		else out += "E\n";
+	}
+	enter_section(0);
+
+	// the binary object is absolute, a program with sections is linked by the assembler
+	// itself first, from its starting address on. its external symbols must all be defined
+	if(emit & (1<<OUT_BINARY)){
+		if(linking){
+			linked_program linked;
+			string err = link_objects({out}, {program_name}, num_threads, linked);
+			if(err.size()) error(err);
+			object_text_to_binary(linked.object_program, result.object_binary);
+			return;
+		}
+		put_binary_header(grow(result.object_binary, sizeof(binary_header)),
+			{program_name, program_starting_address, length_of_program, first_executable_instruction});
+		for(text_record& tr: text_records){
+			tr.append_binary_to(result.object_binary, object_offset, object_bytes);
+		}
+	}
+	return;
+}
+
+// records a warning against the current assembly
+void assembler::warning(string warning_string, const string_view* err_ins, int ln){
+	if(err_ins) result.diagnostics.push_back({false, warning_string, string(*err_ins), ln});
+	else result.diagnostics.push_back({false, warning_string, "", 0});
+}
+
+// resets the state left by any previous assembly
+void assembler::reset(){
+	result = assembly_result();
+	result.success = false;
+	SYMTAB.clear();
+	program = {};
+	location = {};
+	object_offset = {};
+	object_bytes = {};
+	program_starting_address = 0;
+	first_executable_instruction = 0;
+	length_of_program = 0;
+	program_name = PRG_DFLTN;
+	fl_empty_lines = false;
+	xe = false;
+	literals = false;
+	expressions = false;
+	definitions = false;
+	absolute_symbols = {};
+	external_symbols = {};
+	sections.clear();
+	current_section = 0;
+	linking = false;
+	literal_count = {};
+	LITTAB.clear();
+	literal_names = {};
+	peephole_count = {};
+	rewrites = {};
+	one_pass = false;
+	forward_refs = {};
+	pipelined = false;
+	pipeline_refs = {};
+	pipeline_cancelled = false;
+	object_sink = NULL;
+	record_start = 0;
+	incremental = false;
+}
+
+assembly_result assembler::assemble(string_view source){
+	reset();
+	cache_key key;
+	if(cache){
+		key = build_cache::key(source, emit, optimize);
+		bool hit = cache->lookup(key, result);
+		if(stats) (hit ? stats->cache_hits : stats->cache_misses)++;
+		if(hit) return result;
+	}
+
+	// Assembling starts here
+	try{
+		pass_1(source);
+		pass_2();
+		if(emit & ((1<<OUT_OBJECT) | (1<<OUT_BINARY))) write_object_program();
+
+		// show warning of empty lines if flag is ON
+		if(fl_empty_lines && SHOW_W_LINBL) warning(W_LINBL);
+		result.success = true;
+	}catch(assembly_error& err){
+		result.diagnostics.push_back(err.diag);
+		result.intermediate_file = result.assembly_listing = result.object_program = result.object_binary = "";
+	}
+	if(cache) cache->store(key, result); // errors are as repeatable as outputs
+	return result;
+}
+
+// length of the longest common prefix of a and b, compared a block at a time
+size_t common_prefix(string_view a, string_view b){
+	size_t n = min(a.size(), b.size()), i = 0;
+	while(i+4096 <= n && memcmp(a.data()+i, b.data()+i, 4096) == 0) i += 4096;
+	while(i<n && a[i]==b[i]) i++;
+	return i;
+}
+
+// length of the longest common suffix of a and b, at most limit
+size_t common_suffix(string_view a, string_view b, size_t limit){
+	const char* x = a.data()+a.size();
+	const char* y = b.data()+b.size();
+	size_t i = 0;
+	while(i+4096 <= limit && memcmp(x-i-4096, y-i-4096, 4096) == 0) i += 4096;
+	while(i<limit && x[-1-(ptrdiff_t)i]==y[-1-(ptrdiff_t)i]) i++;
+	return i;
+}
+
+// replaces the cnt_old elements of v from first on with those of with
+template<class T> void splice_vector(vector<T>& v, size_t first, size_t cnt_old, const vector<T>& with){
+	size_t cnt_common = min(cnt_old, with.size());
+	copy(with.begin(), with.begin()+cnt_common, v.begin()+first);
+	if(cnt_old > with.size()) v.erase(v.begin()+first+cnt_common, v.begin()+first+cnt_old);
+	else v.insert(v.begin()+first+cnt_common, with.begin()+cnt_common, with.end());
+}
+
+const assembly_result& assembler::reassemble(string_view source){
+	if(incremental && emit == incremental_emit && !xe && !literals && !expressions && !optimize && !linking){
+		try{
+			if(reassemble_lines(source)) return result;
+		}catch(assembly_error& err){} // assembled in full below, which reports it
+	}
+
+	// a full assembly of a copy of source, with room for edits to grow it
+	build_cache* no_cache = NULL;
+	swap(cache, no_cache);
+	incremental_source.reserve(source.size() + source.size()/16 + 4096);
+	incremental_source.assign(source.data(), source.size());
+	assemble(incremental_source);
+	swap(cache, no_cache);
+	cnt_parsed_lines = program.size();
+	incremental = result.success;
+	incremental_emit = emit;
+	if(incremental) keep_incremental_state();
+	return result;
+}
+
+void assembler::keep_incremental_state(){
+	start_line = end_line = -1;
+	for(source_chunk& chunk: chunks){
+		if(start_line<0) start_line = chunk.first_statement;
+		if(end_line<0) end_line = chunk.first_end;
+	}
+	// room for edits to grow the program and outputs without moving them
+	size_t cnt_lines = program.size() + program.size()/16 + 64;
+	program.reserve(cnt_lines);
+	location.reserve(cnt_lines);
+	object_offset.reserve(cnt_lines+1);
+	result.intermediate_file.reserve(result.intermediate_file.size() + result.intermediate_file.size()/16 + 4096);
+	result.assembly_listing.reserve(result.assembly_listing.size() + result.assembly_listing.size()/16 + 4096);
+
+	label_lines.clear();
+	reference_lines.clear();
+	for(int i = start_line; i<end_line; i++){
+		instruction& ins = program[i];
+		if(location[i]>=0 && ins.label.size()) label_lines.push_back(i);
+		if(ins.type_of_operand == O_LABEL || ins.type_of_operand == O_INDXD) reference_lines.push_back(i);
+	}
+
+	// every formatted line ends with its only newline
+	const string* outputs[2] = {&result.intermediate_file, &result.assembly_listing};
+	for(int f = 0; f<2; f++){
+		output_offset[f].clear();
+		if(!(emit & (1<<f))) continue;
+		const string& out = *outputs[f];
+		size_t begin = (f == OUT_LISTING) ? string_view(ALS_HEADER).size() : 0;
+		output_offset[f].reserve(cnt_lines+1);
+		output_offset[f].push_back(begin);
+		for(const char* p = out.data()+begin; (p = (const char*)memchr(p, '\n', out.data()+out.size()-p)); p++){
+			output_offset[f].push_back(p+1 - out.data());
+		}
+	}
+}
+
+bool assembler::reassemble_lines(string_view source){
+	// the changed lines are [first, last) of the program, those between the longest
+	// runs of unchanged lines at the start and at the end of the source
+	phase_timer timer(stats, P_TOKENIZE);
+	string_view old = incremental_source;
+	size_t same_begin = common_prefix(old, source);
+	if(same_begin == old.size() && same_begin == source.size()){
+		cnt_parsed_lines = 0;
+		return true;
+	}
+	int cnt_lines = program.size();
+	auto line_start = [&](int i){ return (size_t)(program[i].instruction_text.data() - old.data()); };
+	auto line_at = [&](size_t pos){ // the line holding byte pos of the old source
+		return int(upper_bound(program.begin(), program.end(), old.data()+pos,
+			[](const char* p, const instruction& ins){ return p < ins.instruction_text.data(); }) - program.begin()) - 1;
+	};
+	int first = line_at(same_begin);
+	size_t begin = line_start(first);
+	size_t same_end = common_suffix(old, source, min(old.size(), source.size()) - begin);
+	ptrdiff_t growth = source.size() - old.size();
+	int last = line_at(old.size() - same_end);
+	if(line_start(last) < old.size()-same_end || (line_start(last)+growth > 0 && source[line_start(last)+growth-1] != '\n')) last++;
+	size_t end = (last < cnt_lines) ? line_start(last) : old.size(); // the changed text is [begin, end) of the old source
+	int cnt_old = last - first;
+	for(int i = first; i<last; i++) if(program[i].mnemonic == M_START || program[i].mnemonic == M_END) return false;
+	bool before = (first <= start_line), after = (first > end_line); // the changed lines aren't located
+
+	// what the changed lines held, before their text is replaced
+	int old_size_in_memory = 0;
+	bool had_blank = false;
+	vector<symbol_table::handle> old_labels;
+	for(int i = first; i<last; i++){
+		if(location[i]>=0) old_size_in_memory += program[i].size_in_memory;
+		if(location[i]>=0 && program[i].label.size()) old_labels.push_back(SYMTAB.find(program[i].label, program[i].label_hash));
+		had_blank |= program[i].is_blank;
+	}
+
+	// the source is patched in place, and the new lines parsed from it. a parse
+	// error is reported by the full assembly
+	const char* old_text = old.data();
+	size_t old_size = old.size();
+	incremental_source.replace(begin, end-begin, source.substr(begin, end+growth-begin));
+	string_view text = string_view(incremental_source).substr(begin, end+growth-begin);
+	vector<instruction> lines;
+	for(size_t line_begin = 0; ; ){
+		size_t line_end = text.find('\n', line_begin);
+		if(line_end == string_view::npos){
+			if(last < cnt_lines) break; // the text ends with the newline of its last line
+			line_end = text.size();
+		}
+		lines.push_back(instruction(text.substr(line_begin, line_end-line_begin), first+lines.size()+1));
+		if(line_end == text.size()) break;
+		line_begin = line_end+1;
+	}
+	int cnt_new = lines.size(), line_delta = cnt_new - cnt_old;
+	cnt_parsed_lines = cnt_new;
+	bool has_blank = false;
+	for(instruction& ins: lines){
+		if(ins.mnemonic == M_START || ins.mnemonic == M_END || ins.is_xe || ins.uses_literals() || ins.uses_expressions() || ins.uses_sections()
+			|| (before && ins.mnemonic != M_NONE)) return false;
+		has_blank |= ins.is_blank;
+	}
+
+	// the unchanged lines follow their text, and those after the new lines their numbers
+	ptrdiff_t moved = incremental_source.data() - old_text;
+	if(moved) for(int i = 0; i<first; i++) program[i].rebase(old_text, old_size, moved);
+	if(moved+growth || line_delta){
+		for(int i = last; i<cnt_lines; i++){
+			program[i].rebase(old_text, old_size, moved+growth);
+			program[i].source_line_number += line_delta;
+		}
+	}
+	for(diagnostic& diag: result.diagnostics) if(diag.line_number > last) diag.line_number += line_delta;
+	splice_vector(program, first, cnt_old, lines);
+	if(before) start_line += line_delta;
+	if(!after) end_line += line_delta;
+	if(has_blank) fl_empty_lines = true;
+	else if(had_blank && fl_empty_lines){
+		fl_empty_lines = false;
+		for(instruction& ins: program) if(ins.is_blank) fl_empty_lines = true;
+	}
+
+	// locating the new lines after the last located line before them, the lines
+	// after them move by the change in size
+	timer.next(P_LOCATE);
+	vector<int> new_location(cnt_new, -1);
+	int size_delta = -old_size_in_memory;
+	if(!before && !after){
+		int i = first-1;
+		while(location[i]<0) i--;
+		int location_counter = location[i] + program[i].size_in_memory;
+		for(int k = 0; k<cnt_new; k++){
+			if(!lines[k].size_in_memory) continue;
+			new_location[k] = location_counter;
+			location_counter += lines[k].size_in_memory;
+			size_delta += lines[k].size_in_memory;
+		}
+	}
+	splice_vector(location, first, cnt_old, new_location);
+	vector<int> relocated; // unchanged lines whose location changed
+	if(size_delta){
+		for(int i = first+cnt_new; i<end_line; i++){
+			if(location[i]<0) continue;
+			location[i] += size_delta;
+			relocated.push_back(i);
+		}
+		if(relocated.size() && location[relocated.back()]>=(2<<15)) return false;
+	}
+	length_of_program += size_delta;
+	// the program is its only section, written from these by write_object_program()
+	sections[0].name = program[start_line].label;
+	sections[0].first_line = start_line;
+	sections[0].end_line = end_line;
+	sections[0].length = length_of_program;
+
+	// the labels and references of the new lines replace those of the old ones
+	timer.next(P_SYMBOLS);
+	vector<int> new_labels, new_references;
+	for(int k = 0; k<cnt_new; k++){
+		if(new_location[k]>=0 && lines[k].label.size()) new_labels.push_back(first+k);
+		if(!before && !after && (lines[k].type_of_operand == O_LABEL || lines[k].type_of_operand == O_INDXD)) new_references.push_back(first+k);
+	}
+	auto splice_lines = [&](vector<int>& v, const vector<int>& with){
+		auto lo = lower_bound(v.begin(), v.end(), first), hi = lower_bound(v.begin(), v.end(), last);
+		for(auto it = hi; it != v.end(); it++) *it += line_delta;
+		splice_vector(v, lo-v.begin(), hi-lo, with);
+	};
+	splice_lines(label_lines, new_labels);
+	splice_lines(reference_lines, new_references);
+
+	// the same labels in the same order only change their values, otherwise the
+	// table is built again and every reference is encoded again
+	bool same_labels = (old_labels.size() == new_labels.size());
+	for(int k = 0; same_labels && k<(int)new_labels.size(); k++){
+		same_labels = (old_labels[k]>=0 && SYMTAB.symbols[old_labels[k]].name == program[new_labels[k]].label);
+	}
+	vector<char> symbol_moved;
+	if(same_labels){
+		symbol_moved.assign(SYMTAB.size(), 0);
+		for(int k = 0; k<(int)new_labels.size(); k++){
+			if(SYMTAB.value(old_labels[k]) == location[new_labels[k]]) continue;
+			SYMTAB.set_value(old_labels[k], location[new_labels[k]]);
+			symbol_moved[old_labels[k]] = 1;
+		}
+		if(size_delta){
+			for(auto it = upper_bound(label_lines.begin(), label_lines.end(), first+cnt_new-1); it != label_lines.end(); it++){
+				instruction& ins = program[*it];
+				symbol_table::handle h = SYMTAB.find(ins.label, ins.label_hash);
+				SYMTAB.set_value(h, location[*it]);
+				symbol_moved[h] = 1;
+			}
+		}
+	}else{
+		SYMTAB.clear();
+		SYMTAB.reserve(label_lines.size());
+		for(int i: label_lines){
+			if(!SYMTAB.insert(program[i].label, program[i].label_hash, location[i]).second) return false;
+		}
+	}
+
+	// encoding the new lines, their code replaces that of the old ones
+	timer.next(P_ENCODE);
+	vector<unsigned char> code;
+	vector<unsigned> new_offset;
+	for(int k = 0; k<cnt_new; k++){
+		instruction& ins = program[first+k];
+		if(!before && !after && !ins.is_comment && !ins.is_blank) encode(ins, location[first+k], code);
+		new_offset.push_back(object_offset[first] + code.size());
+	}
+	unsigned old_code_end = object_offset[last];
+	long long code_delta = (long long)(object_offset[first] + code.size()) - old_code_end;
+	object_bytes.erase(object_bytes.begin()+object_offset[first], object_bytes.begin()+old_code_end);
+	object_bytes.insert(object_bytes.begin()+object_offset[first], code.begin(), code.end());
+	splice_vector(object_offset, first+1, cnt_old, new_offset);
+	if(code_delta) for(size_t i = first+cnt_new+1; i<object_offset.size(); i++) object_offset[i] += code_delta;
+
+	// and the unchanged lines using a symbol that moved, the code keeps its size
+	vector<int> encoded; // unchanged lines encoded again
+	for(int i: reference_lines){
+		if(i >= first && i < first+cnt_new) continue;
+		instruction& ins = program[i];
+		string_view symbol = ins.operand;
+		if(ins.type_of_operand == O_INDXD) symbol = symbol.substr(0, symbol.size()-2);
+		symbol_table::handle h = SYMTAB.find(symbol, ins.operand_hash);
+		if(h<0) return false;
+		if(same_labels && !symbol_moved[h]) continue;
+		code.clear();
+		encode(ins, location[i], code);
+		if(code.size() != object_offset[i+1]-object_offset[i]) return false;
+		memcpy(object_bytes.data()+object_offset[i], code.data(), code.size());
+		encoded.push_back(i);
+	}
+	finish_program(program[end_line]);
+
+	// patching the outputs
+	timer.next(P_FORMAT);
+	if(emit & (1<<OUT_INTERMEDIATE)){
+		if(!patch_output(result.intermediate_file, output_offset[OUT_INTERMEDIATE], first, cnt_old, cnt_new, relocated,
+			[&](int i, string& out){ program[i].append_to(out, location[i]); })) return false;
+	}
+	if(emit & (1<<OUT_LISTING)){
+		vector<int> dirty;
+		set_union(relocated.begin(), relocated.end(), encoded.begin(), encoded.end(), back_inserter(dirty));
+		if(!patch_output(result.assembly_listing, output_offset[OUT_LISTING], first, cnt_old, cnt_new, dirty, [&](int i, string& out){
+			int size = object_offset[i+1] - object_offset[i];
+			char* p = grow(out, 2*size + string_view(INDENT).size());
+			p = put_hex_bytes(p, object_bytes.data()+object_offset[i], size);
+			put_text(p, INDENT);
+			program[i].append_to(out, location[i]);
+		})) return false;
+	}
+	timer.stop();
+	result.object_program.clear();
+	result.object_binary.clear();
+	if(emit & ((1<<OUT_OBJECT) | (1<<OUT_BINARY))) write_object_program();
+	return true;
+}
+
+bool assembler::patch_output(string& out, vector<unsigned>& offset, int first, int cnt_old, int cnt_new,
+	const vector<int>& dirty, const function<void(int, string&)>& format){
+	string lines;
+	vector<unsigned> new_offset;
+	unsigned begin = offset[first], end = offset[first+cnt_old];
+	for(int i = first; i<first+cnt_new; i++){
+		format(i, lines);
+		new_offset.push_back(begin + lines.size());
+	}
+	long long growth = (long long)lines.size() - (end-begin);
+	out.replace(begin, end-begin, lines);
+	splice_vector(offset, first+1, cnt_old, new_offset);
+	if(growth) for(size_t i = first+cnt_new+1; i<offset.size(); i++) offset[i] += growth;
+
+	string line;
+	for(int i: dirty){
+		line.clear();
+		format(i, line);
+		if(line.size() != offset[i+1]-offset[i]) return false;
+		memcpy(&out[offset[i]], line.data(), line.size());
+	}
+	return true;
+}
+
+// emits the pending text record of the one-pass mode
+void assembler::flush_text_record(){
+	if(object_bytes.size()){
+		text_record tr(record_start, 0);
+		for(int line = 0; line+1<(int)object_offset.size(); line++) tr.insert(line, object_offset[line+1]-object_offset[line]);
+		tr.append_to(result.object_program, object_offset, object_bytes);
+	}
+	object_offset = {0};
+	object_bytes.clear();
+	if(object_sink && result.object_program.size() >= OBJ_CHUNK){
+		object_sink->write(result.object_program.data(), result.object_program.size());
+		result.object_program.clear();
+	}
+}
+
+assembly_result assembler::assemble_one_pass(string_view source, ostream* sink){
+	reset();
+	one_pass = true;
+	object_sink = sink;
+	object_offset = {0};
+
+	try{
+		bool started = false, ended = false;
+		int location_counter = 0;
+		int source_line_number = 1;
+		size_t line_begin = 0;
+		while(true){
+			size_t line_end = source.find('\n', line_begin);
+			if(line_end == string_view::npos) line_end = source.size();
+			instruction ins(source.substr(line_begin, line_end-line_begin), source_line_number);
+			source_line_number++;
+			line_begin = line_end+1;
+			if(ins.is_blank) fl_empty_lines = true;
+
+			// lines after END are only checked for syntax
+			if(ended || ins.mnemonic == M_NONE){
+				if(line_end == source.size()) break;
+				continue;
+			}
+			if(ins.is_xe) error(E_XEMOD, &(ins.instruction_text), ins.source_line_number);
+			if(ins.uses_literals()) error(E_LTMOD, &(ins.instruction_text), ins.source_line_number);
+			if(ins.uses_expressions()) error(E_EXMOD, &(ins.instruction_text), ins.source_line_number);
+
+			if(!started){ // deal with start instruction
+				if(ins.mnemonic != M_START) error(E_NOFST, &(ins.instruction_text), ins.source_line_number);
+				start_program(ins);
+				started = true;
+				location_counter = program_starting_address;
+				define_symbol(ins, location_counter);
+				result.object_program.append(23, ' '); // the header record, written at the end
+			}else if(ins.mnemonic == M_START){
+				error(E_MPLST, &(ins.instruction_text), ins.source_line_number);
+			}else if(ins.mnemonic == M_END){ // deal with end instruction
+				end_program(ins);
+				if(forward_refs.size()){ // the earliest reference to a symbol that was never defined
+					const forward_reference* first = NULL;
+					string_view symbol;
+					for(auto& refs: forward_refs) for(forward_reference& ref: refs.second){
+						if(first && first->source_line_number <= ref.source_line_number) continue;
+						first = &ref;
+						symbol = refs.first;
+					}
+					error(E_INVSY(symbol), &(first->instruction_text), first->source_line_number);
+				}
+				finish_program(ins);
+				ended = true;
+			}else{
+				if(ins.size_in_memory){
+					if(location_counter>=(2<<15)) error(E_LOCLG);
+					define_symbol(ins, location_counter);
+				}
+				if(ins.mnemonic == M_RESW || ins.mnemonic == M_RESB){
+					encode(ins, location_counter, object_bytes);
+					flush_text_record();
+				}else{
+					if(object_bytes.size() + ins.size_in_memory > 30) flush_text_record();
+					if(object_bytes.empty()) record_start = location_counter;
+					encode(ins, location_counter, object_bytes);
+					object_offset.push_back(object_bytes.size());
+				}
+				location_counter += ins.size_in_memory;
+			}
+			if(line_end == source.size()) break;
+		}
+		if(!started) error(E_NOSTT);
+		if(!ended) error(E_NOEND);
+		length_of_program = location_counter - program_starting_address;
+
+		flush_text_record();
+		append_end_record(result.object_program);
+
+		// header record, over the space left for it
+		string header = "";
+		append_header_record(header, program_name, program_starting_address, length_of_program);
+		if(object_sink){
+			object_sink->write(result.object_program.data(), result.object_program.size());
+			result.object_program.clear();
+			object_sink->seekp(0);
+			object_sink->write(header.data(), header.size());
+			object_sink->seekp(0, ios::end);
+		}else{
+			result.object_program.replace(0, header.size(), header);
+		}
+	}catch(assembly_error& err){
+		result.diagnostics.push_back(err.diag);
+		result.object_program = "";
+		return result;
+	}
+
+	// show warning of empty lines if flag is ON
+	if(fl_empty_lines && SHOW_W_LINBL) warning(W_LINBL);
+
+	result.success = true;
+	return result;
+}
+
+// reader stage of the pipelined mode, splits the file into batches of whole lines
+void assembler::read_batches(int fd, batch_queue& out){
+	string carry = ""; // a partial line, continued by the next read
+	while(!pipeline_cancelled){
+		line_batch* batch = new line_batch();
+		batch->text = move(carry);
+		carry = "";
+		size_t old_size = batch->text.size();
+		batch->text.resize(old_size + PIPE_BATCH);
+		ssize_t cnt_read = read(fd, &batch->text[old_size], PIPE_BATCH);
+		while(cnt_read < 0 && errno == EINTR) cnt_read = read(fd, &batch->text[old_size], PIPE_BATCH);
+		batch->text.resize(old_size + max<ssize_t>(cnt_read, 0));
+		if(cnt_read <= 0){ // end of file, what is left is the last line
+			batch->last = true;
+			if(cnt_read < 0){ // the rest of the source is lost, the encoder reports it
+				batch->failed = true;
+				batch->diag = {true, E_NORED, "", 0};
+			}
+			out.push(batch);
+			return;
+		}
+		size_t cut = batch->text.rfind('\n');
+		if(cut == string::npos){
+			carry = move(batch->text);
+			delete batch;
+			continue;
+		}
+		carry = batch->text.substr(cut+1);
+		batch->text.resize(cut+1);
+		out.push(batch);
+	}
+	line_batch* batch = new line_batch(); // cancelled, the encoder is only waiting for the end
+	batch->last = true;
+	out.push(batch);
+}
+
+// parser stage of the pipelined mode
+void assembler::parse_batches(batch_queue& in, batch_queue& out){
+	int source_line_number = 1;
+	while(true){
+		line_batch* batch = in.pop();
+		string_view text = batch->text;
+		size_t line_begin = 0;
+		while(!pipeline_cancelled && !batch->failed && (line_begin < text.size() || (batch->last && line_begin == text.size()))){
+			size_t line_end = batch->last ? text.size() : text.find('\n', line_begin);
+			try{
+				batch->lines.push_back(instruction(text.substr(line_begin, line_end-line_begin), source_line_number++));
+			}catch(assembly_error& err){ // the rest of the source is never used
+				batch->failed = true;
+				batch->diag = err.diag;
+				pipeline_cancelled = true;
+			}
+			line_begin = line_end+1;
+		}
+		bool last = batch->last;
+		out.push(batch);
+		if(last) return;
+	}
+}
+
+// encoder stage of the pipelined mode, locates and encodes a batch in source order.
+// the state of the program so far is kept by the caller
+void assembler::encode_batch(line_batch& batch, bool& started, bool& ended, int& location_counter){
+	batch.location.assign(batch.lines.size(), -1);
+	batch.object_offset.assign(batch.lines.size()+1, 0);
+	for(int k = 0; k<(int)batch.lines.size(); k++){
+		instruction& ins = batch.lines[k];
+		batch.object_offset[k] = batch.object_bytes.size();
+		if(ins.is_blank) fl_empty_lines = true;
+		if(ended || ins.mnemonic == M_NONE) continue;
+		if(ins.is_xe) error(E_XEMOD, &(ins.instruction_text), ins.source_line_number);
+		if(ins.uses_literals()) error(E_LTMOD, &(ins.instruction_text), ins.source_line_number);
+		if(ins.uses_expressions()) error(E_EXMOD, &(ins.instruction_text), ins.source_line_number);
+
+		if(!started){ // deal with start instruction
+			if(ins.mnemonic != M_START) error(E_NOFST, &(ins.instruction_text), ins.source_line_number);
+			start_program(ins);
+			started = true;
+			location_counter = program_starting_address;
+		}else if(ins.mnemonic == M_START){
+			error(E_MPLST, &(ins.instruction_text), ins.source_line_number);
+		}else if(ins.mnemonic == M_END){ // deal with end instruction, every symbol is known now
+			end_program(ins);
+			resolve_pipeline_refs();
+			finish_program(ins);
+			ended = true;
+			continue;
+		}
+		if(ins.size_in_memory || ins.mnemonic == M_START){
+			if(location_counter>=(2<<15)) error(E_LOCLG);
+			batch.location[k] = location_counter;
+			define_symbol(ins, location_counter);
+		}
+		if(ins.mnemonic == M_START) continue;
+		size_t cnt_refs = pipeline_refs.size();
+		encode(ins, location_counter, batch.object_bytes);
+		if(pipeline_refs.size() > cnt_refs){ // a forward reference, its code so far is kept to patch
+			const unsigned char* code = batch.object_bytes.data() + batch.object_offset[k];
+			pipeline_refs.back().object_code = (code[0] << 16) + (code[1] << 8) + code[2];
+			batch.forward_ref_lines.push_back(k);
+		}
+		location_counter += ins.size_in_memory;
+	}
+	batch.object_offset[batch.lines.size()] = batch.object_bytes.size();
+	if(batch.failed) throw assembly_error(batch.diag);
+}
+
+void assembler::resolve_pipeline_refs(){
+	for(pipeline_reference& ref: pipeline_refs){
+		symbol_table::handle sym = SYMTAB.find(ref.symbol, ref.hash);
+		if(sym<0) throw assembly_error({true, E_INVSY(ref.symbol), ref.instruction_text, ref.source_line_number});
+		ref.object_code += SYMTAB.value(sym);
+		if(ref.object_code >= (1<<24)) error(E_INTRL);
+	}
+}
+
+// writer stage of the pipelined mode. formats the emitted outputs of each batch,
+// intermediate file, listing and text records, and writes them. the header
+// record, end record and forward references are written after END by
+// assemble_pipelined()
+void assembler::write_batches(batch_queue& in, pipeline_output& out){
+	const string_view indent = INDENT;
+	output_writer& imd = out.files[OUT_INTERMEDIATE];
+	output_writer& lst = out.files[OUT_LISTING];
+	output_writer& obj = out.files[OUT_OBJECT];
+	bool ended = false;
+	bool insert_new = true;
+	int record_address = 0, record_length = 0;
+	string record = ""; // code of the pending text record, after its address and length
+	vector<size_t> record_patches; // positions in record of forward referencing code
+	auto close_record = [&](){
+		if(insert_new) return;
+		char* p = grow(obj.buffer, 11 + record.size() + 1);
+		*p++ = 'T';
+		*p++ = '^';
+		p = put_hex(p, record_address, 6);
+		*p++ = '^';
+		p = put_hex(p, record_length, 2);
+		long long record_offset = obj.written + (p - obj.buffer.data());
+		p = put_text(p, record);
+		*p = '\n';
+		for(size_t pos: record_patches) out.object_patches.push_back(record_offset + pos);
+		record = "";
+		record_patches.clear();
+		insert_new = true;
+	};
+
+	if(emit & (1<<OUT_LISTING)) lst.write(ALS_HEADER);
+	while(true){
+		line_batch* batch = in.pop();
+		size_t next_ref = 0;
+		for(int k = 0; k<(int)batch->lines.size(); k++){
+			instruction& ins = batch->lines[k];
+			int location = batch->location[k];
+			const unsigned char* code = batch->object_bytes.data() + batch->object_offset[k];
+			int size = batch->object_offset[k+1] - batch->object_offset[k];
+			bool patched = (next_ref < batch->forward_ref_lines.size() && batch->forward_ref_lines[next_ref] == k);
+			if(patched) next_ref++;
+
+			if(emit & (1<<OUT_INTERMEDIATE)) ins.append_to(imd.buffer, location);
+
+			// assembly listing line
+			if(emit & (1<<OUT_LISTING)){
+				if(patched) out.listing_patches.push_back(lst.offset());
+				char* p = grow(lst.buffer, 2*size + indent.size());
+				p = put_hex_bytes(p, code, size);
+				put_text(p, indent);
+				ins.append_to(lst.buffer, location);
+			}
+
+			// text records, as in write_object_program()
+			if(!(emit & (1<<OUT_OBJECT)) || ended || ins.is_comment || ins.is_blank) continue;
+			if(ins.mnemonic == M_START){
+				obj.buffer.append(23, ' '); // the header record, written at the end
+				continue;
+			}
+			if(ins.mnemonic == M_END){
+				close_record();
+				ended = true;
+				continue;
+			}
+			if(ins.mnemonic == M_RESW || ins.mnemonic == M_RESB){
+				close_record();
+				continue;
+			}
+			if(insert_new || record_length + size > 30){
+				close_record();
+				record_address = location;
+				record_length = 0;
+				insert_new = false;
+			}
+			record_length += size;
+			if(size == 0) continue;
+			if(patched) record_patches.push_back(record.size() + 1);
+			char* p = grow(record, 1 + 2*size);
+			*p++ = '^';
+			put_hex_bytes(p, code, size);
+		}
+		bool last = batch->last;
+		delete batch;
+		for(output_writer& file: out.files) if(file.fd >= 0) file.check_full();
+		if(last) return;
+	}
+}
+
+assembly_result assembler::assemble_pipelined(string input_fname, const string* output_fnames){
+	reset();
+	pipelined = true;
+	int in_fd = ::open(input_fname.c_str(), O_RDONLY);
+	if(in_fd < 0){
+		result.diagnostics.push_back({true, E_NOFIL, "", 0});
+		return result;
+	}
+	pipeline_output out;
+	output_writer* files = out.files;
+	int file_mask = emit & ~(1<<OUT_BINARY); // the files written
+	int failed_file = -1; // the first output that can't be written
+	auto finish = [&](bool keep_files){ // closes the files, removing them after an error
+		::close(in_fd);
+		for(int f = 0; f<OUT_COUNT; f++){
+			if(files[f].fd < 0) continue;
+			if(!files[f].close() && failed_file < 0) failed_file = f;
+		}
+		if(failed_file >= 0){
+			result.diagnostics.push_back({true, E_NOWRT(output_fnames[failed_file]), "", 0});
+			keep_files = false;
+		}
+		if(!keep_files) for(int f = 0; f<OUT_COUNT; f++) if(file_mask & (1<<f)) remove(output_fnames[f].c_str());
+		return keep_files;
+	};
+	for(int f = 0; f<OUT_COUNT && failed_file < 0; f++){
+		if((file_mask & (1<<f)) && !files[f].open(output_fnames[f])) failed_file = f;
+	}
+	if(failed_file >= 0){
+		finish(false);
+		return result;
+	}
+
+	// the reader, parser and writer stages run on their own threads, the encoder on this one
+	batch_queue read_queue, parse_queue, write_queue;
+	thread reader(&assembler::read_batches, this, in_fd, ref(read_queue));
+	thread parser(&assembler::parse_batches, this, ref(read_queue), ref(parse_queue));
+	thread writer(&assembler::write_batches, this, ref(write_queue), ref(out));
+	bool parsed_all = false, written_all = false;
+	try{
+		bool started = false, ended = false;
+		int location_counter = 0;
+		while(!parsed_all){
+			line_batch* batch = parse_queue.pop();
+			parsed_all = batch->last;
+			try{
+				encode_batch(*batch, started, ended, location_counter);
+			}catch(assembly_error& err){
+				delete batch;
+				throw;
+			}
+			written_all = batch->last;
+			write_queue.push(batch);
+		}
+		if(!started) error(E_NOSTT);
+		if(!ended) error(E_NOEND);
+		length_of_program = location_counter - program_starting_address;
+	}catch(assembly_error& err){
+		result.diagnostics.push_back(err.diag);
+		pipeline_cancelled = true;
+		while(!parsed_all){ // letting the reader and parser finish
+			line_batch* batch = parse_queue.pop();
+			parsed_all = batch->last;
+			delete batch;
+		}
+		if(!written_all){
+			line_batch* batch = new line_batch();
+			batch->last = true;
+			write_queue.push(batch);
+		}
+	}
+	reader.join();
+	parser.join();
+	writer.join();
+	if(pipeline_cancelled){
+		finish(false);
+		return result;
+	}
+
+	// the final patch step, forward references and the header and end records
+	char hex[6];
+	for(size_t i = 0; i<pipeline_refs.size(); i++){
+		put_hex(hex, pipeline_refs[i].object_code, 6);
+		if(emit & (1<<OUT_LISTING)) files[OUT_LISTING].patch(out.listing_patches[i], string_view(hex, 6));
+		if(emit & (1<<OUT_OBJECT)) files[OUT_OBJECT].patch(out.object_patches[i], string_view(hex, 6));
+	}
+	if(emit & (1<<OUT_OBJECT)){
+		string header = "", end_record = "";
+		append_header_record(header, program_name, program_starting_address, length_of_program);
+		append_end_record(end_record);
+		files[OUT_OBJECT].patch(0, header);
+		files[OUT_OBJECT].write(end_record);
+	}
+	if(!finish(true)) return result;
+
+	// show warning of empty lines if flag is ON
+	if(fl_empty_lines && SHOW_W_LINBL) warning(W_LINBL);
+
+	result.success = true;
+	return result;
+}
+
+// prints an error which stops the command line tool
+void fatal(string error_string){
+	cout << "Error: " << error_string << "\n";
+	exit(0);
+}
+
+// a whole input file mapped into memory once, read in place by the assembler
+class source_file{
+public:
+	const char* data;
+	size_t size;
+
+	source_file(): data(NULL), size(0) {}
+	~source_file(){ close(); }
+
+	bool open(string fname){ // false if the file can't be opened or mapped
+		close();
+		int fd = ::open(fname.c_str(), O_RDONLY);
+		if(fd < 0) return false;
+		struct stat st;
+		bool mapped = (fstat(fd, &st) == 0);
+		if(mapped && st.st_size > 0){
+			void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(addr == MAP_FAILED) mapped = false;
+			else{
+				data = (const char*)addr;
+				size = st.st_size;
+				madvise(addr, size, MADV_SEQUENTIAL);
 			}
+		}
+		::close(fd);
+		return mapped;
+	}
+
+	void close(){
+		if(size) munmap((void*)data, size);
+		data = NULL; size = 0;
+	}
+
+	string_view text() const { return size ? string_view(data, size) : string_view(); }
+};
+
+// writes an in-memory output to a file, false if it can't be written
+bool write_file(string fname, const string& contents){
+	static thread_local output_writer writer; // one per thread, its buffer is reused for every file
+	if(!writer.open(fname)) return false;
+	writer.write(contents);
+	return writer.close();
+}
+
+// the SIC machine simulator, which runs SIC/XE programs too. a program is loaded
+// from a memory_image into the 32K memory and run from its entry point with L holding
+// SIM_HALT, so that returning from the program halts the machine. a jump to itself
+// halts it too.
+// instructions are decoded once, on their first execution, into a table indexed by
+// address, and dispatched through a table of label addresses (computed goto) so that
+// every handler jumps straight to the next one. decoding resolves everything about
+// the target address but the index and base registers, PC relative addresses
+// included. a store clears the decoded instructions it overlaps, so code that
+// modifies itself still runs correctly.
+// the devices of TD/RD/WD are files: the first RD or WD of a device opens its file for
+// reading or writing. TD always reports ready and RD past the end of a file reads 0.
+// the floating point operations and those of the operating system (SVC, SIO, LPS and
+// the like) aren't simulated, running one stops the program
+
+// the operation of every opcode, M_NONE if there is none. the flags n and i of
+// SIC/XE are in the low 2 bits of the opcode byte, every opcode is a multiple of 4
+struct opcode_table{
+	mnemonic_id ids[256];
+	constexpr opcode_table(): ids(){
+		for(int id = 0; id<M_COUNT; id++) if(MNEMONICS[id].kind == K_OPERATION) ids[MNEMONICS[id].opcode] = (mnemonic_id)id;
+	}
+};
+constexpr opcode_table OPCODES;
+
+// estimated cycles of an operation, on a machine taking a cycle per byte of memory
+// read or written (the bytes of the instruction included) and longer to multiply,
+// divide and reach a device. 0 for those that aren't simulated
+constexpr int sim_cycles(mnemonic_id operation){
+	switch(operation){
+		case M_LDA: case M_LDX: case M_LDL: case M_STA: case M_STX: case M_STL:
+		case M_LDB: case M_LDS: case M_LDT: case M_STB: case M_STS: case M_STT: return 6; // loads and stores
+		case M_LDCH: case M_STCH: return 4;
+		case M_ADD: case M_SUB: case M_COMP: case M_AND: case M_OR: return 6;
+		case M_MUL: return 12;
+		case M_DIV: return 24;
+		case M_J: case M_JLT: case M_JEQ: case M_JGT: case M_JSUB: case M_RSUB: return 3;
+		case M_TIX: return 7;
+		case M_TD: return 8;
+		case M_RD: case M_WD: return 10;
+		case M_ADDR: case M_SUBR: case M_COMPR: case M_RMO: case M_SHIFTL: case M_SHIFTR: return 3; // registers only
+		case M_CLEAR: return 2;
+		case M_TIXR: return 4;
+		case M_MULR: return 8;
+		case M_DIVR: return 20;
+		default: return 0;
+	}
+}
+
+class sic_machine{
+public:
+	// registers, 24 bits each
+	int A, X, L, B, S, T, PC;
+	int CC; // condition code, the sign of the last comparison, read and written as SW
+	vector<unsigned char> memory; // SIM_MEMORY bytes
+	unsigned long long cnt_instructions; // executed since the program was loaded
+	string fault; // why the last run() failed
+	string device_fnames[256]; // files standing in for the devices, XX.dev if empty
+	bool profiling = false; // if set, run() counts the executions of every address
+	vector<unsigned long long> executions; // by address, since the program was loaded
+
+	sic_machine(): memory(SIM_MEMORY, 0), decoded(SIM_MEMORY) { reset(); }
+
+	// loads a program and sets the registers to run it, false if it doesn't fit in memory
+	bool load(const memory_image& image){
+		if(image.starting_address + image.length > SIM_MEMORY || image.entry_point >= SIM_MEMORY) return false;
+		close_devices();
+		memcpy(memory.data(), image.memory.data(), SIM_MEMORY);
+		reset();
+		PC = image.entry_point;
+		return true;
+	}
+
+	// runs until the program halts (true) or fails (false, with fault set). stops after
+	// about max_instructions more instructions if it isn't 0, the limit is checked at
+	// jumps only. a run stopped by the limit can be resumed by calling run() again
+	bool run(unsigned long long max_instructions = 0);
+
+	// the operation at an address, as decoded if it was executed
+	mnemonic_id operation_at(int address) const {
+		if(decoded[address].operation != M_NONE) return (mnemonic_id)decoded[address].operation;
+		return OPCODES.ids[memory[address] & 0xfc];
+	}
+
+	// the instruction at an address as it would be written in a source, with the
+	// address it uses in hexadecimal (that of a PC relative one made absolute)
+	string disassemble(int address) const {
+		mnemonic_id operation = OPCODES.ids[memory[address] & 0xfc];
+		const mnemonic_info& info = MNEMONICS[operation];
+		auto byte = [&](int k){ return (address+k < SIM_MEMORY) ? memory[address+k] : 0; };
+		string text = string(info.name);
+		if(operation == M_NONE) return "BYTE" INDENT "X'" + hex_string(byte(0), 2) + "'";
+		if(info.format == 1) return text;
+		if(info.format == 2){
+			string_view r1 = REGISTER_NAMES[byte(1) >> 4], r2 = REGISTER_NAMES[byte(1) & 15];
+			if(operation == M_SVC) return text + INDENT + to_string(byte(1) >> 4);
+			if(operation == M_CLEAR || operation == M_TIXR) return text + INDENT + string(r1);
+			if(operation == M_SHIFTL || operation == M_SHIFTR) return text + INDENT + string(r1) + "," + to_string((byte(1) & 15) + 1);
+			return text + INDENT + string(r1) + "," + string(r2);
+		}
+		int ni = byte(0) & 3, flags = byte(1) >> 4;
+		string target;
+		if(ni == 0){ // SIC, a 15 bit address
+			target = hex_string(((byte(1) & 0x7f) << 8) | byte(2), 4);
+			flags &= 8;
+		}else if(flags & 1){
+			text = "+" + text;
+			target = hex_string(((byte(1) & 15) << 16) | (byte(2) << 8) | byte(3), 5);
 		}else{
-			if(ins.mnemonic=="RSUB"){
-				if(ins.operand.size())  // structural sanity check
-					error(E_RSUBO, &(ins.instruction_text), ins.source_line_number);
-				ins.object_code = "4C0000";
-				ins.has_object_code = 1;
-			}else{ // all operations other than RSUB expect a memory address 'm' (as label or buffer,x)
-				if(ins.type_of_operand!=O_LABEL && ins.type_of_operand!=O_INDXD) // structural sanity check
-					error(E_DNALW, &(ins.instruction_text), ins.source_line_number);
-				int data_decimal = OPTAB[ins.mnemonic] << 16;
-				string final_opd = ins.operand;
-				if(ins.type_of_operand==O_INDXD) {
-					final_opd = final_opd.substr(0,(final_opd.size()-2));
-					data_decimal += (1<<15);
-				}
-				if(!SYMTAB.count(final_opd))
-					error(E_INVSY(final_opd), &(ins.instruction_text), ins.source_line_number);
-				data_decimal += SYMTAB[final_opd];
-				string data_hex = "";
-				while(data_decimal){
-					int next_dig = data_decimal%16;
-					char next_dig_char;
-					if(next_dig<10) next_dig_char = '0' + next_dig;
-					else next_dig_char = 'A' + (next_dig-10);
-					data_hex.push_back(next_dig_char);
-					data_decimal/=16;
-				}
-				if(data_hex.size()>6) error(E_INTRL);
-				while(data_hex.size()<6) data_hex.push_back('0');
-				reverse(data_hex.begin(), data_hex.end());
-				ins.object_code = data_hex;
-				ins.has_object_code = 1;
+			int displacement = ((byte(1) & 15) << 8) | byte(2);
+			if(flags & 2) target = hex_string(address + 3 + ((displacement ^ 0x800) - 0x800), 4);
+			else target = hex_string(displacement, 3) + ((flags & 4) ? "(B)" : "");
+		}
+		if(operation == M_RSUB) return text;
+		return text + INDENT + ((ni == 1) ? "#" : (ni == 2) ? "@" : "") + target + ((flags & 8) ? ",X" : "");
+	}
+
+	// flushes and closes the output devices, false if one couldn't be written
+	bool close_devices(){
+		bool written = true;
+		for(int d = 0; d<256; d++){
+			if(devices[d].mode == DEV_WRITE && !devices[d].output.close()){
+				if(written) fault = E_SIMDEV(d, device_fname(d));
+				written = false;
 			}
+			devices[d].input.close();
+			devices[d].mode = DEV_UNUSED;
 		}
+		return written;
 	}
 
-	// writing to the final file
-	assembly_listing << "Obj" << INDENT << "Location\n\n";
-	for(instruction &ins: program){
-		assembly_listing << ins.object_code << INDENT << ins.to_string();
+private:
+	// how the target address of a decoded instruction is found
+	enum target_mode : unsigned char {
+		T_INDEXED = 1, // X is added
+		T_BASED = 2, // B is added
+		T_INDIRECT = 4, // the address is read from the target
+		T_IMMEDIATE = 8 // the target is the operand itself
+	};
+	struct decoded_instruction{
+		unsigned char operation; // a mnemonic_id, M_NONE until decoded
+		unsigned char handler; // run() jumps to, the operation or M_COUNT for the addressing of SIC/XE
+		unsigned char mode; // target_mode bits
+		unsigned char size; // in bytes
+		int address; // of the target, before the registers are added. PC relative ones are made absolute. for
+			// format 2 the byte of registers r1 << 4 | r2, r2 less one being the count of SHIFTL/SHIFTR
+	};
+	vector<decoded_instruction> decoded; // by address
+
+	enum device_mode { DEV_UNUSED, DEV_READ, DEV_WRITE };
+	struct device{
+		device_mode mode = DEV_UNUSED;
+		source_file input;
+		size_t next = 0; // of input
+		output_writer output;
+	};
+	device devices[256];
+
+	void reset(){
+		A = X = L = B = S = T = CC = PC = 0;
+		L = SIM_HALT;
+		cnt_instructions = 0;
+		executions.assign(SIM_MEMORY, 0);
+		fault = "";
+		fill(decoded.begin(), decoded.end(), decoded_instruction{M_NONE, M_NONE, 0, 0, 0});
 	}
 
-	// generating the object code records
-	string header_record = "";
-	bool insert_new = 1;
-	vector<text_record> text_records = {};
-	string end_record = "";
-	for(instruction &ins: program){
-		if(ins.is_comment || ins.is_blank) continue;
-		if(ins.mnemonic == "START"){// write header record
-			header_record.push_back('H');
-
-			header_record.push_back('^');
-			for(int i = 0; i<6; i++) {
-				if(i<program_name.size()) header_record.push_back(program_name[i]);
-				else header_record.push_back(' ');
-			}
-
-			// 6 bytes of hexadecimal starting address
-			string data_hex = "";
-			int data_decimal = program_starting_address;
-			while(data_decimal){
-				int next_dig = data_decimal%16;
-				char next_dig_char;
-				if(next_dig<10) next_dig_char = '0' + next_dig;
-				else next_dig_char = 'A' + (next_dig-10);
-				data_hex.push_back(next_dig_char);
-				data_decimal/=16;
-			}
-			while(data_hex.size()<6) data_hex.push_back('0');
-			reverse(data_hex.begin(), data_hex.end());
-			header_record.push_back('^');
-			for(char x: data_hex) header_record.push_back(x);
-
-			// 6 bytes of hexadecimal length of program
-			data_hex = "";
-			data_decimal = length_of_program;
-			while(data_decimal){
-				int next_dig = data_decimal%16;
-				char next_dig_char;
-				if(next_dig<10) next_dig_char = '0' + next_dig;
-				else next_dig_char = 'A' + (next_dig-10);
-				data_hex.push_back(next_dig_char);
-				data_decimal/=16;
-			}
-			while(data_hex.size()<6) data_hex.push_back('0');
-			reverse(data_hex.begin(), data_hex.end());
-			header_record.push_back('^');
-			for(char x: data_hex) header_record.push_back(x);
+	string device_fname(int d){
+		return device_fnames[d].size() ? device_fnames[d] : hex_string(d, 2) + DEV_FEXTN;
+	}
 
-			continue;
+	// opens device d in mode on its first use, false if it can't be
+	bool open_device(int d, device_mode mode){
+		device& dev = devices[d];
+		if(dev.mode == mode) return true;
+		if(dev.mode != DEV_UNUSED) return false; // read and written
+		bool opened = (mode == DEV_READ) ? dev.input.open(device_fname(d)) : dev.output.open(device_fname(d));
+		if(opened){
+			dev.mode = mode;
+			dev.next = 0;
 		}
-		if(ins.mnemonic == "END"){// write end record
-			end_record.push_back('E');
-			end_record.push_back('^');
-			// 6 bytes of hexadecimal first executable instruction
-			string data_hex = "";
-			int data_decimal = first_executable_instruction;
-			while(data_decimal){
-				int next_dig = data_decimal%16;
-				char next_dig_char;
-				if(next_dig<10) next_dig_char = '0' + next_dig;
-				else next_dig_char = 'A' + (next_dig-10);
-				data_hex.push_back(next_dig_char);
-				data_decimal/=16;
-			}
-			while(data_hex.size()<6) data_hex.push_back('0');
-			reverse(data_hex.begin(), data_hex.end());
-			for(char x: data_hex) end_record.push_back(x);
+		return opened;
+	}
 
-			break;
+	// forgets the decoded instructions overlapping bytes [address, address+size)
+	void stored(int address, int size){
+		for(int a = max(0, address-3); a<address+size; a++) decoded[a].operation = decoded[a].handler = M_NONE;
+	}
+
+	// decodes the instruction at address into ins, false if it isn't one or doesn't
+	// fit in memory
+	bool decode(int address, decoded_instruction& ins){
+		const unsigned char* code = memory.data() + address;
+		mnemonic_id operation = OPCODES.ids[code[0] & 0xfc];
+		if(operation == M_NONE) return false;
+		int format = MNEMONICS[operation].format, ni = code[0] & 3;
+		int size = (format == 3 && ni && address+1 < SIM_MEMORY && (code[1] & 0x10)) ? 4 : format;
+		if(address + size > SIM_MEMORY || (format != 3 && ni)) return false;
+		ins = {(unsigned char)operation, (unsigned char)operation, 0, (unsigned char)size, 0};
+		if(format == 2){
+			ins.address = code[1];
+		}else if(format == 3 && ni == 0){ // SIC, a 15 bit address
+			ins.mode = (code[1] & 0x80) ? T_INDEXED : 0;
+			ins.address = ((code[1] & 0x7f) << 8) | code[2];
+		}else if(format == 3){
+			int flags = code[1] >> 4; // x b p e
+			if(size == 4) ins.address = ((code[1] & 15) << 16) | (code[2] << 8) | code[3];
+			else{
+				int displacement = ((code[1] & 15) << 8) | code[2];
+				if(flags & 2) ins.address = address + 3 + ((displacement ^ 0x800) - 0x800); // PC relative
+				else ins.address = displacement;
+				if(flags & 4) ins.mode |= T_BASED;
+			}
+			if(flags & 8) ins.mode |= T_INDEXED;
+			if(ni == 1) ins.mode |= T_IMMEDIATE;
+			if(ni == 2) ins.mode |= T_INDIRECT;
 		}
-		// time to write to text records
-		int location = ins.location;
-		string object_code = ins.object_code;
-		if(ins.mnemonic == "RESW" || ins.mnemonic == "RESB"){
-			insert_new = true;
-			continue;
+		if(size != 3 || (ins.mode & ~T_INDEXED)) ins.handler = M_COUNT; // finished by xe
+		return true;
+	}
+};
+
+#define SIM_INLINE __attribute__((always_inline))
+bool sic_machine::run(unsigned long long max_instructions){
+	// handlers by mnemonic_id, the operations that aren't simulated stop the program.
+	// those of an immediate operand (#) are only reached through xe, the others take ta
+	// as it is
+	void* handlers[M_COUNT+1];
+	fill(handlers, handlers+M_COUNT, &&unsupported);
+	handlers[M_NONE] = &&decode; // not decoded yet
+	handlers[M_COUNT] = &&xe;
+	handlers[M_LDA] = &&op_lda; handlers[M_LDX] = &&op_ldx; handlers[M_LDL] = &&op_ldl;
+	handlers[M_LDB] = &&op_ldb; handlers[M_LDS] = &&op_lds; handlers[M_LDT] = &&op_ldt; handlers[M_LDCH] = &&op_ldch;
+	handlers[M_STA] = &&op_sta; handlers[M_STX] = &&op_stx; handlers[M_STL] = &&op_stl;
+	handlers[M_STB] = &&op_stb; handlers[M_STS] = &&op_sts; handlers[M_STT] = &&op_stt; handlers[M_STCH] = &&op_stch;
+	handlers[M_ADD] = &&op_add; handlers[M_SUB] = &&op_sub; handlers[M_MUL] = &&op_mul; handlers[M_DIV] = &&op_div;
+	handlers[M_AND] = &&op_and; handlers[M_OR] = &&op_or; handlers[M_COMP] = &&op_comp;
+	handlers[M_J] = &&op_j; handlers[M_JLT] = &&op_jlt; handlers[M_JEQ] = &&op_jeq; handlers[M_JGT] = &&op_jgt;
+	handlers[M_JSUB] = &&op_jsub; handlers[M_RSUB] = &&op_rsub;
+	handlers[M_TIX] = &&op_tix; handlers[M_TD] = &&op_td; handlers[M_RD] = &&op_rd; handlers[M_WD] = &&op_wd;
+	handlers[M_ADDR] = &&op_addr; handlers[M_SUBR] = &&op_subr; handlers[M_MULR] = &&op_mulr; handlers[M_DIVR] = &&op_divr;
+	handlers[M_COMPR] = &&op_compr; handlers[M_RMO] = &&op_rmo; handlers[M_CLEAR] = &&op_clear;
+	handlers[M_SHIFTL] = &&op_shiftl; handlers[M_SHIFTR] = &&op_shiftr; handlers[M_TIXR] = &&op_tixr;
+	void* immediate_handlers[M_COUNT];
+	copy(handlers, handlers+M_COUNT, immediate_handlers); // a store or jump uses ta either way
+	immediate_handlers[M_LDA] = &&imm_lda; immediate_handlers[M_LDX] = &&imm_ldx; immediate_handlers[M_LDL] = &&imm_ldl;
+	immediate_handlers[M_LDB] = &&imm_ldb; immediate_handlers[M_LDS] = &&imm_lds; immediate_handlers[M_LDT] = &&imm_ldt;
+	immediate_handlers[M_LDCH] = &&imm_ldch;
+	immediate_handlers[M_ADD] = &&imm_add; immediate_handlers[M_SUB] = &&imm_sub; immediate_handlers[M_MUL] = &&imm_mul;
+	immediate_handlers[M_DIV] = &&imm_div; immediate_handlers[M_AND] = &&imm_and; immediate_handlers[M_OR] = &&imm_or;
+	immediate_handlers[M_COMP] = &&imm_comp; immediate_handlers[M_TIX] = &&imm_tix;
+	immediate_handlers[M_TD] = &&imm_td; immediate_handlers[M_RD] = &&imm_rd; immediate_handlers[M_WD] = &&imm_wd;
+
+	// the registers are kept in locals while running, but for B, S and T of SIC/XE that
+	// are seldom used and would leave too few machine registers for the others
+	int A = this->A, X = this->X, L = this->L, CC = this->CC;
+	unsigned pc = PC, ta = 0, ins_address = 0;
+	int operand = 0;
+	unsigned long long cnt = cnt_instructions;
+	unsigned long long limit = max_instructions ? cnt + max_instructions : ~0ULL;
+	unsigned char* mem = memory.data();
+	unsigned long long* counts = profiling ? executions.data() : NULL;
+	const decoded_instruction* ins;
+	fault = "";
+
+	// the helpers are always inlined, a call would keep the registers they use in memory
+	auto sign = [](int word) SIM_INLINE { return (word ^ 0x800000) - 0x800000; }; // of a 24 bit word
+	auto compare = [&](int a, int b) SIM_INLINE { a = sign(a), b = sign(b); return (a > b) - (a < b); };
+	auto word = [&]() SIM_INLINE { return (mem[ta] << 16) | (mem[ta+1] << 8) | mem[ta+2]; };
+	auto store_word = [&](int value) SIM_INLINE {
+		mem[ta] = value >> 16;
+		mem[ta+1] = value >> 8;
+		mem[ta+2] = value;
+		stored(ta, 3);
+	};
+	// the registers of format 2 by number, F (6) and 7 are rejected when decoded
+	auto get_register = [&](int r) SIM_INLINE {
+		switch(r){
+			case 0: return A;
+			case 1: return X;
+			case 2: return L;
+			case 3: return B;
+			case 4: return S;
+			case 5: return T;
+			case 8: return (int)pc;
+			default: return CC & 0xffffff;
 		}
-		if(insert_new){
-			text_records.push_back(text_record(ins.location));
-			text_records.back().insert(ins.object_code);
-			insert_new = false;
-			continue;
+	};
+	auto set_register = [&](int r, int value) SIM_INLINE {
+		value &= 0xffffff;
+		switch(r){
+			case 0: A = value; break;
+			case 1: X = value; break;
+			case 2: L = value; break;
+			case 3: B = value; break;
+			case 4: S = value; break;
+			case 5: T = value; break;
+			case 8: pc = value; break;
+			default: CC = compare(value, 0);
+		}
+	};
+
+// fetches the next instruction and jumps to its handler, with the target address in ta.
+// this is all a SIC instruction takes, xe finishes the others
+#define SIM_NEXT() do{ \
+		if(pc >= SIM_MEMORY) goto bad_pc; \
+		ins = &decoded[pc]; \
+		ins_address = pc; \
+		ta = ins->address; \
+		if(ins->mode & T_INDEXED) ta += X; \
+		pc += 3; \
+		cnt++; \
+		if(counts) counts[ins_address]++; \
+		goto *handlers[ins->handler]; \
+	}while(0)
+#define SIM_WORD_OPERAND() if(ta > SIM_MEMORY-3) goto bad_address
+#define SIM_BYTE_OPERAND() if(ta >= SIM_MEMORY) goto bad_address
+// a handler reading a word operand and its immediate twin, the operand is word() or ta
+#define SIM_WORD_HANDLER(name, ...) \
+	op_##name: SIM_WORD_OPERAND(); operand = word(); __VA_ARGS__ SIM_NEXT(); \
+	imm_##name: operand = ta & 0xffffff; __VA_ARGS__ SIM_NEXT();
+#define SIM_BYTE_HANDLER(name, ...) \
+	op_##name: SIM_BYTE_OPERAND(); operand = mem[ta]; __VA_ARGS__ SIM_NEXT(); \
+	imm_##name: operand = ta & 0xff; __VA_ARGS__ SIM_NEXT();
+// the registers of format 2, ta is its byte of registers
+#define SIM_R1 (ta >> 4)
+#define SIM_R2 (ta & 15)
+#define SIM_JUMP(condition) do{ \
+		if(cnt >= limit) goto limit_reached; \
+		if(condition) pc = ta; \
+		SIM_NEXT(); \
+	}while(0)
+
+	SIM_NEXT();
+
+decode:{
+	cnt--; // counted again once decoded
+	if(counts) counts[ins_address]--;
+	decoded_instruction d;
+	if(!decode(ins_address, d)){
+		if(ins_address + MNEMONICS[OPCODES.ids[mem[ins_address] & 0xfc]].format > SIM_MEMORY) fault = E_SIMADR(ins_address, ins_address);
+		else fault = E_SIMOPC(ins_address, mem[ins_address]);
+		goto stop;
+	}
+	auto simulated = [](int r){ return r <= 5 || r == 8 || r == 9; }; // F isn't
+	bool uses_r2 = (d.operation != M_CLEAR && d.operation != M_TIXR && d.operation != M_SHIFTL && d.operation != M_SHIFTR);
+	if(MNEMONICS[d.operation].format == 2 && d.operation != M_SVC && (!simulated(d.address >> 4) || (uses_r2 && !simulated(d.address & 15)))){
+		fault = E_SIMUNS(ins_address, mem[ins_address]);
+		goto stop;
+	}
+	decoded[ins_address] = d;
+	pc = ins_address;
+	SIM_NEXT();
+}
+
+xe: // the size, base relative, indirect and immediate addressing of SIC/XE
+	pc = ins_address + ins->size;
+	if(ins->mode & T_BASED) ta += B;
+	if(ins->mode & T_INDIRECT){
+		if(ta > SIM_MEMORY-3) goto bad_address;
+		ta = word();
+	}
+	if(ins->mode & T_IMMEDIATE) goto *immediate_handlers[ins->operation];
+	goto *handlers[ins->operation];
+
+SIM_WORD_HANDLER(lda, A = operand;)
+SIM_WORD_HANDLER(ldx, X = operand;)
+SIM_WORD_HANDLER(ldl, L = operand;)
+SIM_WORD_HANDLER(ldb, B = operand;)
+SIM_WORD_HANDLER(lds, S = operand;)
+SIM_WORD_HANDLER(ldt, T = operand;)
+SIM_BYTE_HANDLER(ldch, A = (A & 0xffff00) | operand;)
+op_sta: SIM_WORD_OPERAND(); store_word(A); SIM_NEXT();
+op_stx: SIM_WORD_OPERAND(); store_word(X); SIM_NEXT();
+op_stl: SIM_WORD_OPERAND(); store_word(L); SIM_NEXT();
+op_stb: SIM_WORD_OPERAND(); store_word(B); SIM_NEXT();
+op_sts: SIM_WORD_OPERAND(); store_word(S); SIM_NEXT();
+op_stt: SIM_WORD_OPERAND(); store_word(T); SIM_NEXT();
+op_stch: SIM_BYTE_OPERAND(); mem[ta] = A; stored(ta, 1); SIM_NEXT();
+SIM_WORD_HANDLER(add, A = (A + operand) & 0xffffff;)
+SIM_WORD_HANDLER(sub, A = (A - operand) & 0xffffff;)
+SIM_WORD_HANDLER(mul, A = ((long long)sign(A) * sign(operand)) & 0xffffff;)
+SIM_WORD_HANDLER(div,
+	if(sign(operand) == 0) goto divide_by_zero;
+	A = (sign(A) / sign(operand)) & 0xffffff;
+)
+SIM_WORD_HANDLER(and, A &= operand;)
+SIM_WORD_HANDLER(or, A |= operand;)
+SIM_WORD_HANDLER(comp, CC = compare(A, operand);)
+SIM_WORD_HANDLER(tix, X = (X + 1) & 0xffffff; CC = compare(X, operand);)
+op_j:
+	if(ta == ins_address || ta == SIM_HALT) goto halt; // a jump to itself, or to the return address of the program (J @RETADR)
+	SIM_JUMP(true);
+op_jlt: SIM_JUMP(CC < 0);
+op_jeq: SIM_JUMP(CC == 0);
+op_jgt: SIM_JUMP(CC > 0);
+op_jsub: L = pc; SIM_JUMP(true);
+op_rsub:
+	if(L == SIM_HALT) goto halt;
+	ta = L;
+	SIM_JUMP(true);
+SIM_BYTE_HANDLER(td, CC = -1;) // always ready
+SIM_BYTE_HANDLER(rd, {
+	if(!open_device(operand, DEV_READ)){
+		fault = E_SIMDEV(operand, device_fname(operand));
+		goto stop;
+	}
+	device& dev = devices[operand];
+	A = (A & 0xffff00) | (dev.next < dev.input.size ? (unsigned char)dev.input.data[dev.next++] : 0);
+})
+SIM_BYTE_HANDLER(wd, {
+	if(!open_device(operand, DEV_WRITE)){
+		fault = E_SIMDEV(operand, device_fname(operand));
+		goto stop;
+	}
+	output_writer& out = devices[operand].output;
+	out.buffer += (char)A;
+	out.check_full();
+})
+op_addr: set_register(SIM_R2, get_register(SIM_R2) + get_register(SIM_R1)); SIM_NEXT();
+op_subr: set_register(SIM_R2, get_register(SIM_R2) - get_register(SIM_R1)); SIM_NEXT();
+op_mulr: set_register(SIM_R2, (long long)sign(get_register(SIM_R2)) * sign(get_register(SIM_R1))); SIM_NEXT();
+op_divr:
+	operand = sign(get_register(SIM_R1));
+	if(operand == 0) goto divide_by_zero;
+	set_register(SIM_R2, sign(get_register(SIM_R2)) / operand);
+	SIM_NEXT();
+op_compr: CC = compare(get_register(SIM_R1), get_register(SIM_R2)); SIM_NEXT();
+op_rmo: set_register(SIM_R2, get_register(SIM_R1)); SIM_NEXT();
+op_clear: set_register(SIM_R1, 0); SIM_NEXT();
+op_shiftl:{ // circular
+	unsigned value = get_register(SIM_R1), count = SIM_R2 + 1;
+	set_register(SIM_R1, (value << count) | (value >> (24 - count)));
+	SIM_NEXT();
+}
+op_shiftr: set_register(SIM_R1, sign(get_register(SIM_R1)) >> (SIM_R2 + 1)); SIM_NEXT(); // filled with the sign bit
+op_tixr: X = (X + 1) & 0xffffff; CC = compare(X, get_register(SIM_R1)); SIM_NEXT();
+#undef SIM_NEXT
+#undef SIM_WORD_OPERAND
+#undef SIM_BYTE_OPERAND
+#undef SIM_WORD_HANDLER
+#undef SIM_BYTE_HANDLER
+#undef SIM_INLINE
+#undef SIM_R1
+#undef SIM_R2
+#undef SIM_JUMP
+
+unsupported:
+	fault = E_SIMUNS(ins_address, mem[ins_address]);
+	cnt--;
+	if(counts) counts[ins_address]--;
+	goto stop;
+divide_by_zero:
+	fault = E_SIMDIV(ins_address);
+	goto stop;
+bad_pc:
+	fault = E_SIMADR(ins_address, pc);
+	goto stop;
+bad_address:
+	fault = E_SIMADR(ins_address, ta);
+	goto stop;
+limit_reached: // the jump runs when the program is resumed
+	fault = E_SIMLIM;
+	cnt--;
+	if(counts) counts[ins_address]--;
+	goto stop;
+halt:
+	pc = ins_address;
+stop:
+	if(fault.size()) pc = ins_address; // at the instruction that failed
+	this->A = A; this->X = X; this->L = L; this->CC = CC;
+	PC = pc;
+	cnt_instructions = cnt;
+	for(int d = 0; d<256; d++){ // the output so far is written, the devices stay open for a resumed run
+		if(devices[d].mode == DEV_WRITE && !devices[d].output.flush() && fault.empty()) fault = E_SIMDEV(d, device_fname(d));
+	}
+	return fault.empty();
+}
+
+// the hot spot report of a profiled run, like an annotated disassembly. given the
+// assembler that assembled the program, every source line is shown with the executions
+// and estimated cycles of the instruction at its location, otherwise every executed
+// address is shown with the operation found there
+string profile_report(const sic_machine& machine, const assembler* asmb){
+	struct report_line{
+		unsigned long long cnt_executions, cycles;
+		string where, text; // line number or address, and the source line or operation
+	};
+	vector<report_line> lines;
+	unsigned long long total_cycles = 0;
+	auto cost = [&](int address){ return machine.executions[address] * sim_cycles(machine.operation_at(address)); };
+	if(asmb){
+		size_t s = 0; // the control section of the line, its locations are shifted to where it was loaded
+		for(size_t i = 0; i<asmb->program.size(); i++){
+			const instruction& ins = asmb->program[i];
+			while(s+1 < asmb->sections.size() && (int)i >= asmb->sections[s+1].first_line) s++;
+			int address = asmb->location[i];
+			if(address >= 0 && s < asmb->sections.size()) address += asmb->sections[s].address - asmb->sections[s].origin;
+			bool executable = (address >= 0 && address < SIM_MEMORY && is_operation(ins.mnemonic));
+			string_view text = ins.instruction_text;
+			if(text.size() && text.back() == '\r') text.remove_suffix(1);
+			lines.push_back({executable ? machine.executions[address] : 0, executable ? cost(address) : 0,
+				to_string(ins.source_line_number), string(text)});
+		}
+	}else{
+		for(int address = 0; address<SIM_MEMORY; address++){
+			if(!machine.executions[address]) continue;
+			lines.push_back({machine.executions[address], cost(address), "Loc-" + hex_string(address, 4), machine.disassemble(address)});
+		}
+	}
+	for(report_line& line: lines) total_cycles += line.cycles;
+
+	char row[64];
+	auto append_line = [&](string& out, const report_line& line){
+		if(line.cnt_executions){
+			snprintf(row, sizeof(row), "%7.2f%% %12llu %12llu  ", 100.0*line.cycles/max(total_cycles, 1ULL),
+				line.cycles, line.cnt_executions);
+		}else snprintf(row, sizeof(row), "%8s %12s %12s  ", "", "", "");
+		out += row;
+		out += line.where + INDENT + line.text + "\n";
+	};
+	const char* columns = " cycles%       cycles   executions  ";
+	string out = "Execution profile, " + to_string(machine.cnt_instructions) + " instructions, "
+		+ to_string(total_cycles) + " estimated cycles\n\n";
+	out += "Hot spots\n" + string(columns) + (asmb ? "line" : "address") + INDENT "source\n";
+	vector<int> hot;
+	for(int i = 0; i<(int)lines.size(); i++) if(lines[i].cnt_executions) hot.push_back(i);
+	stable_sort(hot.begin(), hot.end(), [&](int a, int b){ return lines[a].cycles > lines[b].cycles; });
+	if(hot.size() > PRF_HOTSP) hot.resize(PRF_HOTSP);
+	for(int i: hot) append_line(out, lines[i]);
+	out += string("\nAnnotated ") + (asmb ? "source" : "code") + "\n" + columns + (asmb ? "line" : "address") + INDENT "source\n";
+	for(report_line& line: lines) append_line(out, line);
+	return out;
+}
+
+// fname as seen from the directory dir, or from the working directory if dir is empty
+string in_dir(const string& dir, const string& fname){
+	if(dir.empty() || (fname.size() && fname[0] == '/')) return fname;
+	return dir + "/" + fname;
+}
+
+// writes the in-memory outputs in emit to the files named in output_fnames
+// (indexed by output_kind) in dir, an error is appended to report
+bool write_outputs(const assembly_result& res, int emit, const string& dir, const string* output_fnames, string& report){
+	const string* contents[OUT_COUNT] = {&res.intermediate_file, &res.assembly_listing, &res.object_program, &res.object_binary};
+	for(int f = 0; f<OUT_COUNT; f++){
+		if(!(emit & (1<<f)) || write_file(in_dir(dir, output_fnames[f]), *contents[f])) continue;
+		report += diagnostic({true, E_NOWRT(output_fnames[f]), "", 0}).to_string();
+		return false;
+	}
+	return true;
+}
+
+// assembles one file and writes the outputs it emits to the files named in
+// output_fnames (indexed by output_kind), the diagnostics are appended to report.
+// the file names are relative to dir (see in_dir())
+bool assemble_file(assembler& asmb, const string& dir, string input_fname, const string* output_fnames, string& report){
+	phase_timer timer(asmb.stats, P_READ);
+	source_file source;
+	if(!source.open(in_dir(dir, input_fname))){
+		report += diagnostic({true, E_NOFIL, "", 0}).to_string();
+		return false;
+	}
+	timer.stop();
+
+	assembly_result res = asmb.assemble(source.text());
+	for(diagnostic& diag: res.diagnostics) report += diag.to_string();
+	if(!res.success) return false;
+
+	timer.start(P_WRITE);
+	return write_outputs(res, asmb.emit, dir, output_fnames, report);
+}
+
+// the closing notes of a successful assembly
+void print_outputs(int emit, const string* output_fnames, ostream& out = cout){
+	const char* notes[OUT_COUNT] = {"Intermediate File Written to file\t\t:", "Assembly Listing written to file \t\t:",
+		"Object Code written to file      \t\t:", "Binary Object written to file    \t\t:"};
+	out << "Code assembled successfully\n";
+	for(int f = 0; f<OUT_COUNT; f++) if(emit & (1<<f)) out << notes[f] << output_fnames[f] << "\n";
+}
+
+// name of a batch mode output, the source's extension replaced by extension
+string output_file_name(string input_fname, string extension){
+	size_t dot = input_fname.find_last_of('.');
+	size_t slash = input_fname.find_last_of('/');
+	if(dot == string::npos || (slash != string::npos && dot < slash)) return input_fname + extension;
+	return input_fname.substr(0, dot) + extension;
+}
+
+// one source file of a batch mode run
+struct batch_job{
+	string input_file_name;
+	bool success;
+	string report; // diagnostics printed for this file
+};
+
+// a pool of threads assembling batch jobs. every worker owns a deque of job
+// indices, takes work from the front of its own deque and steals from the back
+// of the others once it runs dry, so a few large files don't stall the pool
+class batch_pool{
+public:
+	vector<batch_job>& jobs;
+	int num_threads;
+	int emit;
+	bool optimize;
+	build_cache* cache; // shared by the workers, NULL if none
+	string dir; // the file names are relative to it, see in_dir()
+	vector<deque<int>> queues;
+	vector<mutex> queue_locks;
+
+	batch_pool(vector<batch_job>& jobs, int num_threads, int emit, bool optimize, build_cache* cache, string dir = ""): jobs(jobs),
+		num_threads(num_threads), emit(emit), optimize(optimize), cache(cache), dir(dir),
+		queues(num_threads), queue_locks(num_threads) {
+		// contiguous blocks of files per worker
+		for(int i = 0; i<(int)jobs.size(); i++) queues[(long long)i*num_threads/jobs.size()].push_back(i);
+	}
+
+	void run(){
+		vector<thread> workers;
+		for(int id = 1; id<num_threads; id++) workers.push_back(thread(&batch_pool::work, this, id));
+		work(0);
+		for(thread& t: workers) t.join();
+	}
+
+private:
+	bool next_job(int id, int& job){
+		{ // own queue first
+			lock_guard<mutex> lock(queue_locks[id]);
+			if(queues[id].size()){
+				job = queues[id].front();
+				queues[id].pop_front();
+				return true;
+			}
 		}
-		if((text_records.back().total_length + ins.object_code.size()) > 60){
-			text_records.push_back(text_record(ins.location));
-			text_records.back().insert(ins.object_code);
+		for(int k = 1; k<num_threads; k++){ // then steal
+			int victim = (id+k)%num_threads;
+			lock_guard<mutex> lock(queue_locks[victim]);
+			if(queues[victim].size()){
+				job = queues[victim].back();
+				queues[victim].pop_back();
+				return true;
+			}
+		}
+		return false; // jobs are never added while running, so all queues are empty
+	}
+
+	void work(int id){
+		assembler asmb; // one reusable assembler per thread
+		asmb.emit = emit;
+		asmb.optimize = optimize;
+		asmb.cache = cache;
+		int job;
+		while(next_job(id, job)){
+			batch_job& bj = jobs[job];
+			string output_fnames[OUT_COUNT] = {output_file_name(bj.input_file_name, IMD_FEXTN),
+				output_file_name(bj.input_file_name, ALS_FEXTN), output_file_name(bj.input_file_name, OBJ_FEXTN),
+				output_file_name(bj.input_file_name, BIN_FEXTN)};
+			bj.success = assemble_file(asmb, dir, bj.input_file_name, output_fnames, bj.report);
+		}
+	}
+};
+
+// the directory of the daemon's socket when $XDG_RUNTIME_DIR isn't set, the daemon
+// makes it readable by its user alone
+string daemon_socket_dir(){
+	char dir[64];
+	snprintf(dir, sizeof(dir), DMN_SOCKDIR, (unsigned)getuid());
+	return dir;
+}
+
+// the socket of the daemon, unless --daemon=<socket> gives another
+string daemon_socket_fname(){
+	const char* env = getenv("SIC_ASSEMBLER_SOCKET");
+	if(env && *env) return env;
+	env = getenv("XDG_RUNTIME_DIR");
+	if(env && *env) return string(env) + "/" DMN_SOCKET;
+	return daemon_socket_dir() + "/" DMN_SOCKET;
+}
+
+// command line options
+struct cli_options{
+	int batch_threads; // -j <threads>, batch mode if not 0
+	int pass_threads; // -t <threads>, threads used by the passes of each file
+	bool one_pass; // --one-pass
+	bool pipelined; // --pipeline
+	bool optimize; // -O, the peephole optimizer rewrites the program before it is encoded
+	bool stats_json; // --stats=json, statistics of the assembly printed to stderr
+	bool convert; // --convert <object program> <output file>
+	bool link; // --link <object programs...>, the linking loader links them into one
+	bool watch; // --watch, the file is assembled again whenever it changes
+	bool run; // --run, the program is run on the simulator
+	bool profile; // --profile, the run is profiled
+	vector<pair<int, string>> device_fnames; // --device=<device>:<file>
+	unsigned long long max_instructions; // --max-instructions=<count>, 0 for no limit
+	int emit; // --emit=<outputs>, a mask of output_kind bits
+	bool emit_given;
+	string output_fnames[OUT_COUNT]; // --intermediate-file=, --listing-file=, --obj-file=, --bin-file=
+	bool output_fnames_given;
+	string cache_dir; // --cache=<dir>, empty if outputs aren't cached
+	long long cache_limit; // --cache-size=<megabytes>
+	bool daemon; // --daemon[=<socket>], requests are served from a pool of workers
+	string socket_fname; // of the daemon
+	vector<string> input_files;
+	string dir; // the file names are relative to it, see in_dir(). set by the daemon for its clients
+};
+
+// the mask of a comma separated list of outputs, -1 if one is unknown
+int parse_emit(string list){
+	int emit = 0;
+	size_t begin = 0;
+	while(begin <= list.size()){
+		size_t end = list.find(',', begin);
+		if(end == string::npos) end = list.size();
+		string name = list.substr(begin, end-begin);
+		int f = 0;
+		while(f<OUT_COUNT && name != OUTPUT_NAMES[f]) f++;
+		if(f == OUT_COUNT) return -1;
+		emit |= (1<<f);
+		begin = end+1;
+	}
+	return emit;
+}
+
+cli_options parse_options(int argc, char** args){
+	cli_options opts = {0, 1, false, false, false, false, false, false, false, false, false, {}, 0, EMIT_DEFAULT, false, {IMD_FNAME, ALS_FNAME, OBJ_FNAME, BIN_FNAME}, false, "", CACHE_LIMIT,
+		false, daemon_socket_fname(), {}, ""};
+	const string fname_options[OUT_COUNT] = {"--intermediate-file=", "--listing-file=", "--obj-file=", "--bin-file="};
+	for(int i = 1; i<argc; i++){
+		string arg = args[i];
+		int named = 0; // output whose file name is given by arg, OUT_COUNT if none
+		while(named<OUT_COUNT && arg.compare(0, fname_options[named].size(), fname_options[named]) != 0) named++;
+		if(named < OUT_COUNT){
+			opts.output_fnames[named] = arg.substr(fname_options[named].size());
+			if(opts.output_fnames[named].empty()) fatal(E_BADOP(arg));
+			opts.output_fnames_given = true;
+		}else if(arg.compare(0, 7, "--emit=") == 0){
+			opts.emit = parse_emit(arg.substr(7));
+			if(opts.emit < 0) fatal(E_BADOP(arg));
+			opts.emit_given = true;
+		}else if(arg == "-j" || arg == "-t"){
+			if(i+1 == argc || atoi(args[i+1]) < 1) fatal(arg == "-j" ? E_BADJB : E_BADOP(arg));
+			(arg == "-j" ? opts.batch_threads : opts.pass_threads) = atoi(args[++i]);
+		}else if(arg == "--one-pass"){
+			opts.one_pass = true;
+		}else if(arg == "--pipeline"){
+			opts.pipelined = true;
+		}else if(arg == "-O"){
+			opts.optimize = true;
+		}else if(arg == "--stats=json"){
+			opts.stats_json = true;
+		}else if(arg == "--convert"){
+			opts.convert = true;
+		}else if(arg == "--link"){
+			opts.link = true;
+		}else if(arg.compare(0, 8, "--cache=") == 0 && arg.size() > 8){
+			opts.cache_dir = arg.substr(8);
+		}else if(arg.compare(0, 13, "--cache-size=") == 0){
+			opts.cache_limit = atoll(arg.c_str()+13) << 20;
+			if(opts.cache_limit <= 0) fatal(E_BADOP(arg));
+		}else if(arg == "--daemon" || arg.compare(0, 9, "--daemon=") == 0){
+			opts.daemon = true;
+			if(arg.size() > 9) opts.socket_fname = arg.substr(9);
+		}else if(arg == "--watch"){
+			opts.watch = true;
+		}else if(arg == "--run"){
+			opts.run = true;
+		}else if(arg == "--profile"){
+			opts.profile = true;
+		}else if(arg.compare(0, 9, "--device=") == 0){
+			size_t colon = arg.find(':');
+			int device;
+			if(colon == string::npos || colon+1 == arg.size() || !parse_int(string_view(arg).substr(9, colon-9), 16, device)
+				|| device < 0 || device > 255) fatal(E_BADDV(arg));
+			opts.device_fnames.push_back({device, arg.substr(colon+1)});
+		}else if(arg.compare(0, 19, "--max-instructions=") == 0){
+			opts.max_instructions = strtoull(arg.c_str()+19, NULL, 10);
+			if(opts.max_instructions == 0) fatal(E_BADOP(arg));
+		}else if(arg.size()>1 && arg[0]=='-'){
+			fatal(E_BADOP(arg));
 		}else{
-			text_records.back().insert(ins.object_code);
+			opts.input_files.push_back(arg);
+		}
+	}
+	if(opts.daemon){ // takes nothing else but -j <workers>
+		if(opts.input_files.size() || argc != (opts.batch_threads ? 4 : 2)) fatal(E_BADOP("--daemon"));
+		return opts;
+	}
+	if(opts.input_files.empty()) fatal(E_NOARG);
+	if(opts.convert && (opts.input_files.size() != 2 || argc != 4)) fatal(E_BADOP("--convert")); // takes nothing else
+	if(opts.link && !opts.emit_given) opts.emit = (1<<OUT_OBJECT);
+	if(opts.link && (opts.batch_threads || opts.one_pass || opts.pipelined || opts.optimize || opts.stats_json || opts.convert
+		|| opts.watch || opts.run || opts.cache_dir.size() || (opts.emit & ~((1<<OUT_OBJECT) | (1<<OUT_BINARY))))) fatal(E_BADOP("--link")); // writes object programs only
+	if(opts.run && (opts.input_files.size() != 1 || opts.batch_threads || opts.one_pass || opts.pipelined || opts.stats_json
+		|| opts.convert || opts.emit_given || opts.output_fnames_given)) fatal(E_BADOP("--run")); // writes no outputs
+	if((opts.device_fnames.size() || opts.max_instructions || opts.profile) && !opts.run)
+		fatal(E_BADOP(opts.profile ? "--profile" : opts.max_instructions ? "--max-instructions" : "--device"));
+	if(opts.batch_threads && opts.one_pass) fatal(E_BADOP("--one-pass"));
+	if(opts.optimize && (opts.one_pass || opts.pipelined)) fatal(E_BADOP("-O")); // rewrites the whole program
+	if(opts.pipelined && (opts.batch_threads || opts.one_pass || (opts.emit & (1<<OUT_BINARY)))) fatal(E_BADOP("--pipeline"));
+	if(opts.stats_json && (opts.batch_threads || opts.one_pass || opts.pipelined)) fatal(E_BADST);
+	if(opts.one_pass && opts.emit_given && opts.emit != (1<<OUT_OBJECT)) fatal(E_BADOP("--emit")); // only writes the object program
+	if(opts.batch_threads && opts.output_fnames_given) fatal(E_BADOP("-j")); // names come from the sources
+	if(opts.cache_dir.size() && (opts.one_pass || opts.pipelined || opts.run || opts.convert)) fatal(E_BADOP("--cache")); // whole results only
+	if(opts.watch && (opts.input_files.size() != 1 || opts.batch_threads || opts.one_pass || opts.pipelined || opts.stats_json
+		|| opts.convert || opts.run || opts.cache_dir.size())) fatal(E_BADOP("--watch")); // one file in two passes
+	return opts;
+}
+
+// batch mode, '-j <threads> <files...>', returns the exit status
+int run_batch(const cli_options& opts, ostream& out = cout){
+	int num_threads = opts.batch_threads;
+	vector<batch_job> jobs;
+	for(const string& fname: opts.input_files) jobs.push_back({fname, false, ""});
+	if(num_threads > (int)jobs.size()) num_threads = jobs.size();
+
+	unique_ptr<build_cache> cache;
+	if(opts.cache_dir.size()){
+		cache.reset(new build_cache(in_dir(opts.dir, opts.cache_dir), opts.cache_limit));
+		if(!cache->open()){
+			out << "Error: " << E_BADCH(opts.cache_dir) << "\n";
+			return 1;
 		}
 	}
+	batch_pool pool(jobs, num_threads, opts.emit, opts.optimize, cache.get(), opts.dir);
+	pool.run();
 
-	// writing to the object file
-	object_program << header_record << "\n";
-	for(text_record tr: text_records){
-		object_program << tr.to_string() << "\n";
+	// reports are printed in the order the files were given
+	int cnt_success = 0;
+	for(batch_job& bj: jobs){
+		if(bj.report.size()) out << bj.input_file_name << ":\n" << bj.report;
+		cnt_success += bj.success;
 	}
-	object_program << end_record << "\n";
+	out << cnt_success << " of " << jobs.size() << " files assembled successfully\n";
+	if(cache) out << cache->hits << " of " << jobs.size() << " files found in the cache\n";
+	return (cnt_success == (int)jobs.size()) ? 0 : 1;
+}
 
-	// closing streams
-	intermediate_file_r.close();
-	assembly_listing.close();
+// one-pass mode, '--one-pass <file>', only the object program is written
+int run_one_pass(const cli_options& opts){
+	string obj_fname = opts.output_fnames[OUT_OBJECT];
+	source_file source;
+	if(!source.open(opts.input_files[0])) fatal(E_NOFIL);
+	ofstream object_program(obj_fname, ios::binary);
+	if(!object_program.is_open()) fatal(E_NOWRT(obj_fname));
+
+	assembler asmb;
+	assembly_result res = asmb.assemble_one_pass(source.text(), &object_program);
+	for(diagnostic& diag: res.diagnostics) cout << diag.to_string();
 	object_program.close();
-	return;
+	if(!res.success){
+		remove(obj_fname.c_str());
+		return 0;
+	}
+	if(!object_program) fatal(E_NOWRT(obj_fname));
+
+	print_outputs(1<<OUT_OBJECT, opts.output_fnames);
+	return 0;
 }
 
-void populate_OPTAB(){
-	OPTAB = {
-		{"LDA", 0x00}, {"LDX", 0x04}, {"LDL", 0x08},
-		{"STA", 0x0c}, {"STX", 0x10}, {"STL", 0x14}, 
-		{"LDCH", 0x50}, {"STCH", 0x54}, 
-		{"ADD", 0x18}, {"SUB", 0x1c}, {"MUL", 0x20}, {"DIV", 24},
-		{"COMP", 0x28}, 
-		{"J", 0x3c}, {"JLT", 0x38}, {"JEQ", 0x30}, {"JGT", 0x34},
-		{"JSUB", 0x48}, {"RSUB", 0x4c},
-		{"TIX", 0x2c},
-		{"TD", 0xe0}, {"RD", 0xd8}, {"WD", 0xdc}
-	};
+// pipelined mode, '--pipeline <file>', returns the exit status
+int run_pipelined(const cli_options& opts){
+	assembler asmb;
+	asmb.emit = opts.emit;
+	assembly_result res = asmb.assemble_pipelined(opts.input_files[0], opts.output_fnames);
+	for(diagnostic& diag: res.diagnostics) cout << diag.to_string();
+	if(!res.success) return 0;
+
+	print_outputs(opts.emit, opts.output_fnames);
+	return 0;
+}
+
+// prints the error of a mode run as a step of a build (converting, linking and
+// running), which unlike fatal() fails with exit status 1
+int run_error(string error_string){
+	cout << "Error: " << error_string << "\n";
+	return 1;
+}
+
+// '--convert <object program> <output file>', converts an object program from text
+// to binary or back, whichever it isn't. returns the exit status
+int run_convert(const cli_options& opts){
+	source_file object;
+	if(!object.open(opts.input_files[0])) return run_error(E_NOFIL);
+	bool to_text = is_binary_object(object.text());
+	string converted;
+	bool valid = to_text ? object_binary_to_text(object.text(), converted) : object_text_to_binary(object.text(), converted);
+	if(!valid) return run_error(E_BADOB);
+	if(!write_file(opts.input_files[1], converted)) return run_error(E_NOWRT(opts.input_files[1]));
+
+	cout << "Object program converted successfully\n";
+	cout << (to_text ? "Object Code written to file      \t\t:" : "Binary Object written to file    \t\t:") << opts.input_files[1] << "\n";
+	return 0;
+}
+
+// '--link <object programs...>', links text object programs of control sections, in the
+// order given, into one absolute object program written in the formats of --emit (the
+// text one by default). -t gives the threads of the linking loader. returns the exit status
+int run_link(const cli_options& opts){
+	vector<source_file> inputs(opts.input_files.size());
+	vector<string_view> objects;
+	for(size_t f = 0; f<inputs.size(); f++){
+		if(!inputs[f].open(opts.input_files[f])) return run_error(E_NOFIL);
+		objects.push_back(inputs[f].text());
+	}
+	linked_program linked;
+	string err = link_objects(objects, opts.input_files, opts.pass_threads, linked);
+	if(err.size()) return run_error(err);
+	string binary;
+	if(opts.emit & (1<<OUT_BINARY)) object_text_to_binary(linked.object_program, binary);
+	if((opts.emit & (1<<OUT_OBJECT)) && !write_file(opts.output_fnames[OUT_OBJECT], linked.object_program)) return run_error(E_NOWRT(opts.output_fnames[OUT_OBJECT]));
+	if((opts.emit & (1<<OUT_BINARY)) && !write_file(opts.output_fnames[OUT_BINARY], binary)) return run_error(E_NOWRT(opts.output_fnames[OUT_BINARY]));
+
+	cout << "Object programs linked successfully\n";
+	cout << "Control sections linked         \t\t:" << linked.cnt_sections << "\n";
+	cout << "External symbols                 \t\t:" << linked.cnt_symbols << "\n";
+	cout << "Modification records applied    \t\t:" << linked.cnt_modifications << "\n";
+	if(opts.emit & (1<<OUT_OBJECT)) cout << "Object Code written to file      \t\t:" << opts.output_fnames[OUT_OBJECT] << "\n";
+	if(opts.emit & (1<<OUT_BINARY)) cout << "Binary Object written to file    \t\t:" << opts.output_fnames[OUT_BINARY] << "\n";
+	return 0;
+}
+
+// the default mode, one file assembled in two passes by asmb. returns the exit status
+int run_two_pass(const cli_options& opts, assembler& asmb, ostream& out = cout){
+	asmb.num_threads = opts.pass_threads;
+	asmb.emit = opts.emit;
+	asmb.optimize = opts.optimize;
+	build_cache cache(in_dir(opts.dir, opts.cache_dir), opts.cache_limit);
+	if(opts.cache_dir.size()){
+		if(!cache.open()){
+			out << "Error: " << E_BADCH(opts.cache_dir) << "\n";
+			return 0;
+		}
+		asmb.cache = &cache;
+	}
+	assembly_stats stats;
+	if(opts.stats_json) asmb.stats = &stats;
+	string report = "";
+	bool success = assemble_file(asmb, opts.dir, opts.input_files[0], opts.output_fnames, report);
+	asmb.cache = NULL;
+	asmb.stats = NULL;
+	out << report;
+	if(opts.stats_json) cerr << stats.to_json();
+	if(!success) return 0;
+
+	// ending notes of the assembler
+	print_outputs(opts.emit, opts.output_fnames, out);
+	return 0;
+}
+
+// '--watch <file>', assembles the file and then again every time it changes, each
+// time reusing what it can of the last assembly (see assembler::reassemble()).
+// runs until it is interrupted
+int run_watch(const cli_options& opts){
+	string input_file_name = opts.input_files[0];
+	assembler asmb(opts.pass_threads);
+	asmb.emit = opts.emit;
+	asmb.optimize = opts.optimize;
+	struct stat last_st = {};
+	cout << "Watching " << input_file_name << " for changes, press Ctrl+C to stop\n" << flush;
+	while(true){
+		// a changed file has a new modification time, size or inode (if it was replaced)
+		struct stat st;
+		if(stat(input_file_name.c_str(), &st) != 0 || (st.st_mtim.tv_sec == last_st.st_mtim.tv_sec
+			&& st.st_mtim.tv_nsec == last_st.st_mtim.tv_nsec && st.st_size == last_st.st_size && st.st_ino == last_st.st_ino)){
+			this_thread::sleep_for(chrono::milliseconds(WATCH_POLL));
+			continue;
+		}
+		last_st = st;
+
+		auto begin = chrono::steady_clock::now();
+		string report = "";
+		source_file source;
+		bool success = source.open(input_file_name) || st.st_size == 0;
+		if(!success) report += diagnostic({true, E_NOFIL, "", 0}).to_string();
+		else{
+			const assembly_result& res = asmb.reassemble(source.text());
+			for(const diagnostic& diag: res.diagnostics) report += diag.to_string();
+			success = res.success && write_outputs(res, opts.emit, opts.dir, opts.output_fnames, report);
+		}
+		char note[128];
+		snprintf(note, sizeof(note), "Code assembled successfully in %.3f ms, %d of %zu lines parsed\n",
+			chrono::duration<double>(chrono::steady_clock::now() - begin).count() * 1000, asmb.cnt_parsed_lines, asmb.program.size());
+		cout << "\n" << report << (success ? note : "") << flush;
+	}
+	return 0;
+}
+
+// '--run <file>', runs a program on the simulator. the file is either an object
+// program, in text or binary, or a source that is assembled in memory first.
+// returns the exit status, 1 unless the program halted normally
+int run_program(const cli_options& opts){
+	source_file input;
+	if(!input.open(opts.input_files[0])) return run_error(E_NOFIL);
+	string_view object = input.text();
+	assembly_result res;
+	assembler asmb; // kept to map the profile back to the source
+	bool assembled = !is_binary_object(object) && object.substr(0, 2) != "H^"; // a source, no label has a caret
+	if(assembled){
+		asmb.emit = (1<<OUT_BINARY);
+		asmb.optimize = opts.optimize;
+		res = asmb.assemble(object);
+		for(diagnostic& diag: res.diagnostics) cout << diag.to_string();
+		if(!res.success) return 1;
+		object = res.object_binary;
+	}
+	memory_image image;
+	if(!load_object(object, image)) return run_error(E_BADOB);
+	sic_machine machine;
+	for(auto& device: opts.device_fnames) machine.device_fnames[device.first] = device.second;
+	machine.profiling = opts.profile;
+	if(!machine.load(image)) return run_error(E_SIMMEM);
+
+	auto begin = chrono::steady_clock::now();
+	bool halted = machine.run(opts.max_instructions);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+	if(!machine.close_devices()) halted = false;
+	if(!halted) cout << "Error: " << machine.fault << "\n";
+	else cout << "Program halted normally\n";
+	cout << "Instructions executed            \t\t:" << machine.cnt_instructions << "\n";
+	cout << "Instructions per second          \t\t:" << (long long)(machine.cnt_instructions / max(seconds, 1e-9)) << "\n";
+	cout << "Registers at the end             \t\t:A=" << hex_string(machine.A, 6) << " X=" << hex_string(machine.X, 6)
+		<< " L=" << hex_string(machine.L, 6) << " B=" << hex_string(machine.B, 6) << " S=" << hex_string(machine.S, 6)
+		<< " T=" << hex_string(machine.T, 6) << " PC=" << hex_string(machine.PC, 6) << "\n";
+	if(opts.profile){
+		if(!write_file(PRF_FNAME, profile_report(machine, assembled ? &asmb : NULL))) return run_error(E_NOWRT(PRF_FNAME));
+		cout << "Execution profile written to file\t\t:" << PRF_FNAME << "\n";
+	}
+	return halted ? 0 : 1;
+}
+
+// the assembler daemon ('--daemon[=<socket>]'). it listens on a Unix domain socket
+// and serves each request with one of a pool of assemblers kept warm from one
+// request to the next, so that a request pays neither the start of a process nor
+// a cold assembler. a client sends either a source text and the outputs it wants, which
+// come back in the response, or the options of a command line run on files (the
+// default mode and batch mode), which the daemon runs in the client's directory
+// and answers with what it printed and its exit status.
+// the messages both ways are frames of a 32 bit length (in host byte order, they
+// never leave the machine) and that many bytes of fields, each a 32 bit length and
+// its bytes. numbers are fields of decimal digits. a connection carries any number
+// of requests, each answered before the next is read. requests are
+//	DMN_MAGIC "text" <emit> <source>
+//		answered "ok" <success> <count> {<is_error> <message> <line_text> <line_number>}*count
+//		<intermediate file> <listing> <object program> <binary object>
+//	DMN_MAGIC "files" <dir> <batch threads> <pass threads> <emit> <optimize> <output file>*OUT_COUNT
+//		<cache dir> <cache limit> <count> <input file>*count
+//		answered "ok" <exit status> <output>
+// and a request the daemon can't serve is answered "error" <message>
+
+void append_field(string& out, string_view field){
+	uint32_t size = field.size();
+	char* p = grow(out, 4 + size);
+	memcpy(p, &size, 4);
+	if(size) memcpy(p+4, field.data(), size);
+}
+
+void append_field(string& out, long long number){ append_field(out, std::to_string(number)); }
+
+// reads the fields of a message in order. a missing or malformed field sets failed
+struct message_reader{
+	string_view rest;
+	bool failed;
+
+	message_reader(string_view message): rest(message), failed(false) {}
+
+	string_view field(){
+		uint32_t size;
+		if(rest.size() < 4 || (memcpy(&size, rest.data(), 4), rest.size()-4 < size)){
+			failed = true;
+			return "";
+		}
+		string_view f = rest.substr(4, size);
+		rest.remove_prefix(4 + size);
+		return f;
+	}
+
+	long long number(){
+		string_view f = field();
+		long long value = 0;
+		from_chars_result res = from_chars(f.data(), f.data()+f.size(), value);
+		if(res.ec != errc() || res.ptr != f.data()+f.size() || f.empty()) failed = true;
+		return value;
+	}
+};
+
+// writes a whole message to fd, false if it can't
+bool send_message(int fd, const string& message){
+	uint32_t size = message.size();
+	iovec iov[2] = {{&size, 4}, {(void*)message.data(), message.size()}};
+	int first = 0;
+	while(first < 2){
+		ssize_t written = writev(fd, iov+first, 2-first);
+		if(written < 0 && errno == EINTR) continue;
+		if(written <= 0) return false;
+		for(; first < 2 && (size_t)written >= iov[first].iov_len; first++) written -= iov[first].iov_len;
+		if(first < 2){
+			iov[first].iov_base = (char*)iov[first].iov_base + written;
+			iov[first].iov_len -= written;
+		}
+	}
+	return true;
 }
 
-void populate_DIRECTIVES(){
-	DIRECTIVES = {
-		{"START", 0}, {"END", 0}, {"BYTE", 0}, {"WORD", 0}, {"RESB", 0}, {"RESW", 0}
+// reads a whole message from fd, false at the end of the connection or on an error
+bool receive_message(int fd, string& message){
+	uint32_t size;
+	auto read_all = [&](char* p, size_t count){
+		while(count){
+			ssize_t got = read(fd, p, count);
+			if(got < 0 && errno == EINTR) continue;
+			if(got <= 0) return false;
+			p += got;
+			count -= got;
+		}
+		return true;
 	};
+	if(!read_all((char*)&size, 4) || size > DMN_MAXMSG) return false;
+	message.resize(size);
+	return read_all(&message[0], size);
 }
 
-void populate_SYMTAB(){
-	SYMTAB = {};
+// the address of a Unix domain socket, false if the name is too long for one
+bool socket_address(const string& socket_fname, sockaddr_un& address){
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(socket_fname.empty() || socket_fname.size() >= sizeof(address.sun_path)) return false;
+	memcpy(address.sun_path, socket_fname.data(), socket_fname.size());
+	return true;
 }
 
-int main(int argc, char** args){
+// whether the process at the other end of the connection fd runs as this user. the
+// daemon and its clients talk to no one else, the files of either are at stake
+bool peer_is_user(int fd){
+	ucred cred;
+	socklen_t size = sizeof(cred);
+	return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &size) == 0 && cred.uid == getuid();
+}
 
-	// finding the program's name from cmd line argument
-	if(argc < 2) error(E_NOARG);
-	input_file_name = args[1];
-	program_starting_address = 0;
-	program_name = PRG_DFLTN;
+// a connection to the daemon
+class daemon_client{
+public:
+	daemon_client(): fd(-1) {}
+	~daemon_client(){ close(); }
 
-	// setting flags
-	fl_empty_lines = false;
+	// false if no daemon of this user listens on the socket
+	bool connect(string socket_fname){
+		close();
+		sockaddr_un address;
+		if(!socket_address(socket_fname, address)) return false;
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(fd >= 0 && ::connect(fd, (sockaddr*)&address, sizeof(address)) == 0 && peer_is_user(fd)) return true;
+		close();
+		return false;
+	}
 
-	// populates tables
-	populate_OPTAB();
-	populate_SYMTAB();
-	populate_DIRECTIVES();
+	void close(){
+		if(fd >= 0) ::close(fd);
+		fd = -1;
+	}
 
-	// Assembling starts here
-	pass_1();
-	pass_2();
+	// assembles source in the daemon, the outputs in emit are returned in result.
+	// false if the daemon didn't answer
+	bool assemble(string_view source, int emit, assembly_result& result){
+		string request = "";
+		append_field(request, DMN_MAGIC);
+		append_field(request, "text");
+		append_field(request, emit);
+		append_field(request, source);
+		string response;
+		if(!exchange(request, response)) return false;
+		message_reader reader(response);
+		result = assembly_result();
+		result.success = reader.number();
+		long long cnt_diagnostics = reader.number();
+		for(long long d = 0; d<cnt_diagnostics && !reader.failed; d++){
+			diagnostic diag;
+			diag.is_error = reader.number();
+			diag.message = string(reader.field());
+			diag.line_text = string(reader.field());
+			diag.line_number = reader.number();
+			result.diagnostics.push_back(diag);
+		}
+		for(string* output: {&result.intermediate_file, &result.assembly_listing, &result.object_program, &result.object_binary}){
+			*output = string(reader.field());
+		}
+		return !reader.failed;
+	}
 
-	// show warning of empty lines if flag is ON
-	if(fl_empty_lines && SHOW_W_LINBL) warning(W_LINBL);
+	// runs the default mode or batch mode of the command line in the daemon, in the
+	// directory opts.dir, which must be absolute. false if the daemon didn't answer
+	bool run(const cli_options& opts, int& status, string& output){
+		string request = "";
+		append_field(request, DMN_MAGIC);
+		append_field(request, "files");
+		append_field(request, opts.dir);
+		append_field(request, opts.batch_threads);
+		append_field(request, opts.pass_threads);
+		append_field(request, opts.emit);
+		append_field(request, opts.optimize);
+		for(int f = 0; f<OUT_COUNT; f++) append_field(request, opts.output_fnames[f]);
+		append_field(request, opts.cache_dir);
+		append_field(request, opts.cache_limit);
+		append_field(request, opts.input_files.size());
+		for(const string& fname: opts.input_files) append_field(request, fname);
+		string response;
+		if(!exchange(request, response)) return false;
+		message_reader reader(response);
+		status = reader.number();
+		output = string(reader.field());
+		return !reader.failed;
+	}
 
-	// ending notes of the assembler
-	cout << "Code assembled successfully\n";
-	cout << "Intermediate File Written to file\t\t:" << IMD_FNAME << "\n";
-	cout << "Assembly Listing written to file \t\t:" << ALS_FNAME << "\n";
-	cout << "Object Code written to file      \t\t:" << OBJ_FNAME << "\n";
+private:
+	int fd;
+
+	// sends a request and receives its response, without the leading "ok"
+	bool exchange(const string& request, string& response){
+		if(fd < 0 || !send_message(fd, request) || !receive_message(fd, response)) return false;
+		message_reader reader(response);
+		if(reader.field() != "ok" || reader.failed) return false;
+		response.erase(0, response.size() - reader.rest.size());
+		return true;
+	}
+};
+
+// whether the daemon can run a command line, the modes that read and write only
+// whole files without printing statistics
+bool daemon_serves(const cli_options& opts){
+	return !(opts.one_pass || opts.pipelined || opts.convert || opts.link || opts.run || opts.watch || opts.daemon || opts.stats_json);
+}
+
+class assembler_daemon{
+public:
+	string socket_fname;
+	int num_workers;
+	atomic<long long> cnt_requests;
+
+	assembler_daemon(string socket_fname, int num_workers): socket_fname(socket_fname), num_workers(num_workers),
+		cnt_requests(0), listen_fd(-1), stopping(false), cnt_connections(0) {
+		for(int id = 0; id<num_workers; id++) idle.push_back(new assembler());
+	}
+	~assembler_daemon(){
+		if(listen_fd >= 0) close(listen_fd);
+		for(assembler* asmb: idle) delete asmb;
+	}
+
+	// binds the socket, replacing a stale one, so that only its user may connect.
+	// the default directory in /tmp is made first. returns the error, empty if none
+	string listen(){
+		sockaddr_un address;
+		if(!socket_address(socket_fname, address)) return E_BADSK(socket_fname);
+		string dir = daemon_socket_dir();
+		if(socket_fname == dir + "/" DMN_SOCKET){
+			struct stat st;
+			mkdir(dir.c_str(), 0700);
+			if(lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077)) return E_DMDIR(dir);
+		}
+		daemon_client probe;
+		if(probe.connect(socket_fname)) return E_DMRUN(socket_fname);
+		unlink(socket_fname.c_str());
+		listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(listen_fd < 0) return E_BADSK(socket_fname);
+		mode_t mask = umask(0177); // the socket is made 0600
+		bool bound = (bind(listen_fd, (sockaddr*)&address, sizeof(address)) == 0);
+		umask(mask);
+		if(!bound || chmod(socket_fname.c_str(), 0600) != 0 || ::listen(listen_fd, SOMAXCONN) != 0) return E_BADSK(socket_fname);
+		return "";
+	}
+
+	// accepts connections until stop(). each connection has a thread of its own,
+	// which waits for its requests without holding a worker, so connections kept
+	// open by clients don't starve the others
+	void serve(){
+		while(!stopping){
+			int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+			if(fd < 0){
+				if(stopping) break;
+				if(errno != EINTR && errno != ECONNABORTED) this_thread::sleep_for(chrono::milliseconds(1)); // out of descriptors, say
+				continue;
+			}
+			{
+				lock_guard<mutex> lock(pool_mutex);
+				cnt_connections++;
+			}
+			thread(&assembler_daemon::serve_connection, this, fd).detach();
+		}
+		unique_lock<mutex> lock(pool_mutex);
+		pool_changed.wait(lock, [&](){ return cnt_connections == 0; });
+		unlink(socket_fname.c_str());
+	}
+
+	// makes serve() return once the connections being served are closed
+	void stop(){
+		stopping = true;
+		shutdown(listen_fd, SHUT_RDWR);
+	}
+
+private:
+	int listen_fd;
+	atomic<bool> stopping;
+	mutex pool_mutex;
+	condition_variable pool_changed;
+	vector<assembler*> idle; // the workers, assemblers kept warm from one request to the next
+	int cnt_connections;
+
+	void serve_connection(int fd){
+		string request, response;
+		bool allowed = peer_is_user(fd); // a connection of another user is closed unanswered
+		while(allowed && receive_message(fd, request)){
+			assembler* asmb;
+			{
+				unique_lock<mutex> lock(pool_mutex);
+				pool_changed.wait(lock, [&](){ return idle.size() > 0; });
+				asmb = idle.back();
+				idle.pop_back();
+			}
+			response = "";
+			handle(*asmb, request, response);
+			{
+				lock_guard<mutex> lock(pool_mutex);
+				idle.push_back(asmb);
+			}
+			pool_changed.notify_all();
+			cnt_requests++;
+			if(!send_message(fd, response)) break;
+		}
+		close(fd);
+		{
+			lock_guard<mutex> lock(pool_mutex);
+			cnt_connections--;
+		}
+		pool_changed.notify_all();
+	}
+
+	void handle(assembler& asmb, const string& request, string& response){
+		message_reader reader(request);
+		if(reader.field() != DMN_MAGIC) return refuse(response, "Unknown protocol, the client and the daemon differ in version");
+		string_view kind = reader.field();
+		if(kind == "text"){
+			int emit = reader.number();
+			string_view source = reader.field();
+			if(reader.failed || emit <= 0 || emit >= (1<<OUT_COUNT)) return refuse(response, "Malformed request");
+			asmb.emit = emit;
+			asmb.optimize = false;
+			asmb.num_threads = 1;
+			const assembly_result& res = asmb.assemble(source);
+			append_field(response, "ok");
+			append_field(response, res.success);
+			append_field(response, res.diagnostics.size());
+			for(const diagnostic& diag: res.diagnostics){
+				append_field(response, diag.is_error);
+				append_field(response, diag.message);
+				append_field(response, diag.line_text);
+				append_field(response, diag.line_number);
+			}
+			for(const string* output: {&res.intermediate_file, &res.assembly_listing, &res.object_program, &res.object_binary}){
+				append_field(response, *output);
+			}
+		}else if(kind == "files"){
+			cli_options opts = {0, 1, false, false, false, false, false, false, false, false, false, {}, 0, EMIT_DEFAULT, false,
+				{"", "", "", ""}, false, "", CACHE_LIMIT, false, "", {}, ""};
+			opts.dir = string(reader.field());
+			opts.batch_threads = reader.number();
+			opts.pass_threads = reader.number();
+			opts.emit = reader.number();
+			opts.optimize = reader.number();
+			for(int f = 0; f<OUT_COUNT; f++) opts.output_fnames[f] = string(reader.field());
+			opts.cache_dir = string(reader.field());
+			opts.cache_limit = reader.number();
+			long long cnt_inputs = reader.number();
+			for(long long i = 0; i<cnt_inputs && !reader.failed; i++) opts.input_files.push_back(string(reader.field()));
+			if(reader.failed || opts.dir.empty() || opts.dir[0] != '/' || opts.batch_threads < 0 || opts.batch_threads > 1024
+				|| opts.pass_threads < 1 || opts.pass_threads > 1024 || opts.emit <= 0 || opts.emit >= (1<<OUT_COUNT)
+				|| opts.cache_limit <= 0 || opts.input_files.empty() || (!opts.batch_threads && opts.input_files.size() != 1)){
+				return refuse(response, "Malformed request");
+			}
+			ostringstream out;
+			int status = opts.batch_threads ? run_batch(opts, out) : run_two_pass(opts, asmb, out);
+			append_field(response, "ok");
+			append_field(response, status);
+			append_field(response, out.str());
+		}else{
+			refuse(response, "Unknown request");
+		}
+	}
+
+	static void refuse(string& response, string message){
+		response = "";
+		append_field(response, "error");
+		append_field(response, message);
+	}
+};
+
+// the socket is removed when the daemon is interrupted or killed
+string daemon_socket_fname_to_remove;
+void remove_daemon_socket(int){
+	unlink(daemon_socket_fname_to_remove.c_str());
+	_exit(0);
+}
 
+// '--daemon[=<socket>]', serves requests until it is interrupted. '-j <workers>'
+// sets the size of the pool, one worker per core by default
+int run_daemon(const cli_options& opts){
+	signal(SIGPIPE, SIG_IGN); // a client that hangs up only ends its connection
+	int num_workers = opts.batch_threads ? opts.batch_threads : max(1u, thread::hardware_concurrency());
+	assembler_daemon daemon(opts.socket_fname, num_workers);
+	string err = daemon.listen();
+	if(err.size()) fatal(err);
+	daemon_socket_fname_to_remove = opts.socket_fname;
+	signal(SIGINT, remove_daemon_socket);
+	signal(SIGTERM, remove_daemon_socket);
+	cout << "Listening on " << opts.socket_fname << " with " << num_workers << " workers, press Ctrl+C to stop\n" << flush;
+	daemon.serve();
 	return 0;
 }
+
+// runs the command line tool with the options it was given, returns the exit status
+int run_command_line(const cli_options& opts){
+	if(opts.daemon) return run_daemon(opts);
+	if(opts.batch_threads) return run_batch(opts);
+	if(opts.one_pass) return run_one_pass(opts);
+	if(opts.pipelined) return run_pipelined(opts);
+	if(opts.convert) return run_convert(opts);
+	if(opts.link) return run_link(opts);
+	if(opts.run) return run_program(opts);
+	if(opts.watch) return run_watch(opts);
+	assembler asmb(opts.pass_threads);
+	return run_two_pass(opts, asmb);
+}
+
+// the benchmarks in bench/ include this file with NO_MAIN defined
+#ifndef NO_MAIN
+int main(int argc, char** args){
+
+	// finding the program's name from cmd line argument
+	if(argc < 2) fatal(E_NOARG);
+	cli_options opts = parse_options(argc, args);
+	return run_command_line(opts);
+}
+#endif
@@ -0,0 +1,35 @@
+/*
+Thin client of the assembler daemon (assembler --daemon), a drop-in replacement for
+the assembler: it takes the same arguments, writes the same files and prints the
+same output. the default mode and batch mode are sent to the daemon listening on
+$SIC_ASSEMBLER_SOCKET ($XDG_RUNTIME_DIR/sic_assembler.sock or
+/tmp/sic_assembler-<uid>/sic_assembler.sock by default); the other modes, or every
+mode when no daemon of the same user is listening, run in the client itself.
+
+To compile and run use:-
+$g++ -std=c++17 -O2 assembler_client.cpp -o assembler_client -pthread
+$./assembler --daemon &
+$./assembler_client COPY.txt
+*/
+
+#define NO_MAIN
+#include "assembler.cpp"
+
+int main(int argc, char** args){
+	if(argc < 2) fatal(E_NOARG);
+	cli_options opts = parse_options(argc, args);
+	char cwd[PATH_MAX];
+	if(daemon_serves(opts) && getcwd(cwd, sizeof(cwd))){
+		signal(SIGPIPE, SIG_IGN);
+		opts.dir = cwd;
+		daemon_client client;
+		int status;
+		string output;
+		if(client.connect(opts.socket_fname) && client.run(opts, status, output)){
+			fwrite(output.data(), 1, output.size(), stdout);
+			return status;
+		}
+		opts.dir = "";
+	}
+	return run_command_line(opts);
+}
@@ -0,0 +1,182 @@
+/*
+Times the phases of the assembler on a generated program or a source file:
+pass 1, pass 2, packing the object records and writing the three output files.
+
+To compile and run use:-
+$g++ -std=c++17 -O2 bench/assembler_bench.cpp -o assembler_bench -pthread
+$./assembler_bench --profile 1m
+$./assembler_bench --profile 10m -t 8
+$./assembler_bench -f big.asm
+
+To check a change for regressions, save the numbers before it and compare after:-
+$./assembler_bench --profile 1m --save before.txt
+$./assembler_bench --profile 1m --compare before.txt
+
+Options:-
+	--profile <1m|10m>	generated program of 1M or 10M lines (default 1m)
+	-f <file>		assemble a source file instead
+	-t <threads>		threads used by the passes (default 1)
+	--runs <n>		runs per phase, the fastest is kept (default 3)
+	--save <file>		write the timings to a file
+	--compare <file>	compare with saved timings, exit status 1 on a regression
+	--tolerance <percent>	slowdown allowed by --compare (default 5)
+*/
+
+#define NO_MAIN
+#include "../assembler.cpp"
+#include "sicgen.h"
+#include <chrono>
+#include <map>
+
+#define PHASES {"pass_1", "pass_2", "records", "write", "total"}
+
+struct bench_options{
+	string profile = "1m";
+	string input_file = "";
+	int threads = 1;
+	int runs = 3;
+	string save_file = "";
+	string compare_file = "";
+	double tolerance = 5;
+};
+
+// unlike fatal(), fails with a non-zero exit status for scripts
+void bench_error(string error_string){
+	fprintf(stderr, "Error: %s\n", error_string.c_str());
+	exit(1);
+}
+
+void usage(){
+	fprintf(stderr, "usage: assembler_bench [--profile 1m|10m] [-f file] [-t threads] [--runs n] "
+		"[--save file] [--compare file] [--tolerance percent]\n");
+	exit(1);
+}
+
+bench_options parse_bench_options(int argc, char** args){
+	bench_options opts;
+	for(int i = 1; i<argc; i++){
+		string arg = args[i];
+		if(i+1 == argc) usage();
+		string value = args[++i];
+		if(arg == "--profile") opts.profile = value;
+		else if(arg == "-f") opts.input_file = value;
+		else if(arg == "-t") opts.threads = max(1, atoi(value.c_str()));
+		else if(arg == "--runs") opts.runs = max(1, atoi(value.c_str()));
+		else if(arg == "--save") opts.save_file = value;
+		else if(arg == "--compare") opts.compare_file = value;
+		else if(arg == "--tolerance") opts.tolerance = atof(value.c_str());
+		else usage();
+	}
+	if(opts.profile != "1m" && opts.profile != "10m") usage();
+	return opts;
+}
+
+double seconds_since(chrono::steady_clock::time_point begin){
+	return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+// fastest time of every phase over the runs
+map<string, double> time_phases(string_view source, const bench_options& opts){
+	map<string, double> best;
+	char out_dir[] = "/tmp/assembler_bench.XXXXXX";
+	if(!mkdtemp(out_dir)) bench_error("Can't create a directory for the outputs");
+	string dir = out_dir;
+	assembler asmb(opts.threads);
+	for(int run = 0; run<opts.runs; run++){
+		map<string, double> times;
+		asmb.reset();
+		try{
+			auto begin = chrono::steady_clock::now();
+			asmb.pass_1(source);
+			times["pass_1"] = seconds_since(begin);
+
+			begin = chrono::steady_clock::now();
+			asmb.pass_2();
+			times["pass_2"] = seconds_since(begin);
+
+			begin = chrono::steady_clock::now();
+			asmb.write_object_program();
+			times["records"] = seconds_since(begin);
+		}catch(assembly_error& err){
+			bench_error("The benchmark program doesn't assemble:\n" + err.diag.to_string());
+		}
+
+		auto begin = chrono::steady_clock::now();
+		const assembly_result& res = asmb.result;
+		if(!write_file(dir + "/" IMD_FNAME, res.intermediate_file) || !write_file(dir + "/" ALS_FNAME, res.assembly_listing)
+			|| !write_file(dir + "/" OBJ_FNAME, res.object_program)) bench_error(E_NOWRT(dir));
+		times["write"] = seconds_since(begin);
+
+		times["total"] = times["pass_1"] + times["pass_2"] + times["records"] + times["write"];
+		for(auto& t: times) if(run == 0 || t.second < best[t.first]) best[t.first] = t.second;
+	}
+	for(string name: {IMD_FNAME, ALS_FNAME, OBJ_FNAME}) unlink((dir + "/" + name).c_str());
+	rmdir(out_dir);
+	return best;
+}
+
+// saved timings, one "phase seconds" per line
+map<string, double> load_timings(string fname){
+	map<string, double> timings;
+	ifstream file(fname);
+	if(!file.is_open()) bench_error(E_NOFIL);
+	string phase;
+	double seconds;
+	while(file >> phase >> seconds) timings[phase] = seconds;
+	return timings;
+}
+
+int main(int argc, char** args){
+	bench_options opts = parse_bench_options(argc, args);
+
+	// the program to assemble
+	string generated = "";
+	source_file input;
+	string_view source;
+	long long cnt_lines;
+	if(opts.input_file.size()){
+		if(!input.open(opts.input_file)) bench_error(E_NOFIL);
+		source = input.text();
+		cnt_lines = count(source.begin(), source.end(), '\n') + 1;
+		printf("%s: ", opts.input_file.c_str());
+	}else{
+		generator_options gen_opts;
+		gen_opts.lines = (opts.profile == "10m") ? 10000000 : 1000000;
+		generated_program gen = generate_program(gen_opts);
+		generated = move(gen.text);
+		source = generated;
+		cnt_lines = gen_opts.lines;
+		printf("profile %s: %lld statements, ", opts.profile.c_str(), gen.statements);
+	}
+	printf("%lld lines, %zu bytes, %d thread(s), best of %d runs\n\n", cnt_lines, source.size(), opts.threads, opts.runs);
+
+	map<string, double> timings = time_phases(source, opts);
+	map<string, double> baseline;
+	if(opts.compare_file.size()) baseline = load_timings(opts.compare_file);
+
+	// the report, throughput is of source lines and bytes
+	bool regressed = false;
+	printf("%-8s %10s %12s %10s", "phase", "seconds", "Mlines/s", "MB/s");
+	if(baseline.size()) printf(" %10s %8s", "baseline", "change");
+	printf("\n");
+	for(string phase: PHASES){
+		double t = timings[phase];
+		printf("%-8s %10.4f %12.2f %10.1f", phase.c_str(), t, cnt_lines/t/1e6, source.size()/t/1e6);
+		if(baseline.count(phase)){
+			double change = 100*(t - baseline[phase])/baseline[phase];
+			printf(" %10.4f %+7.1f%%", baseline[phase], change);
+			if(change > opts.tolerance){
+				printf("  REGRESSION");
+				regressed = true;
+			}
+		}
+		printf("\n");
+	}
+
+	if(opts.save_file.size()){
+		ofstream file(opts.save_file);
+		for(string phase: PHASES) file << phase << " " << timings[phase] << "\n";
+		if(!file.good()) bench_error(E_NOWRT(opts.save_file));
+	}
+	return regressed ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+/*
+Times requests to the assembler daemon (assembler --daemon) against assembling
+in the process itself, for a small generated module. the daemon is started in
+this process on a temporary socket, unless --socket names one already running.
+reported are the mean, median and 99th percentile latency of
+	in-process	assembler::assemble() on a warm assembler, the floor
+	connection	an inline source on one connection kept open
+	connect		an inline source on a new connection per request
+	files		a command line run on a file (what assembler_client sends)
+	concurrent	inline sources from --clients connections at once, with the throughput
+
+To compile and run use:-
+$g++ -std=c++17 -O2 bench/daemon_bench.cpp -o daemon_bench -pthread
+$./daemon_bench
+$./daemon_bench --lines 2000 --clients 8
+$./daemon_bench --socket $XDG_RUNTIME_DIR/sic_assembler.sock
+
+Options:-
+	--lines <n>		lines of the generated module (default 100)
+	--requests <n>	timed requests per mode (default 2000)
+	--workers <n>	workers of the daemon started here (default one per core)
+	--clients <n>	connections of the concurrent mode (default 4)
+	--socket <file>	time the daemon listening on the socket instead of starting one
+*/
+
+#define NO_MAIN
+#include "../assembler.cpp"
+#include "sicgen.h"
+
+struct daemon_bench_options{
+	long long lines = 100;
+	int requests = 2000;
+	int workers = 0;
+	int clients = 4;
+	string socket_fname = "";
+};
+
+// unlike fatal(), fails with a non-zero exit status for scripts
+void bench_error(string error_string){
+	fprintf(stderr, "Error: %s\n", error_string.c_str());
+	exit(1);
+}
+
+void usage(){
+	fprintf(stderr, "usage: daemon_bench [--lines n] [--requests n] [--workers n] [--clients n] [--socket file]\n");
+	exit(1);
+}
+
+daemon_bench_options parse_bench_options(int argc, char** args){
+	daemon_bench_options opts;
+	for(int i = 1; i<argc; i++){
+		string arg = args[i];
+		if(i+1 == argc) usage();
+		string value = args[++i];
+		if(arg == "--lines") opts.lines = max(3LL, atoll(value.c_str()));
+		else if(arg == "--requests") opts.requests = max(1, atoi(value.c_str()));
+		else if(arg == "--workers") opts.workers = max(1, atoi(value.c_str()));
+		else if(arg == "--clients") opts.clients = max(1, atoi(value.c_str()));
+		else if(arg == "--socket") opts.socket_fname = value;
+		else usage();
+	}
+	return opts;
+}
+
+double seconds_since(chrono::steady_clock::time_point begin){
+	return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+// prints the mean, median and 99th percentile of the latencies in microseconds
+void report(const char* mode, vector<double>& latencies, string extra = ""){
+	sort(latencies.begin(), latencies.end());
+	double mean = 0;
+	for(double t: latencies) mean += t/latencies.size();
+	printf("%-12s %10.1f %10.1f %10.1f  %s\n", mode, mean*1e6, latencies[latencies.size()/2]*1e6,
+		latencies[min(latencies.size()-1, latencies.size()*99/100)]*1e6, extra.c_str());
+}
+
+int main(int argc, char** args){
+	daemon_bench_options opts = parse_bench_options(argc, args);
+	signal(SIGPIPE, SIG_IGN);
+
+	generator_options gen_opts;
+	gen_opts.lines = opts.lines;
+	gen_opts.symbols = max(1LL, opts.lines/10);
+	string source = generate_program(gen_opts).text;
+	int emit = EMIT_DEFAULT;
+
+	char dir_template[] = "/tmp/daemon_bench-XXXXXX";
+	if(!mkdtemp(dir_template)) bench_error("Can't make a temporary directory");
+	string dir = dir_template;
+	ofstream(dir + "/module.asm") << source;
+
+	assembler_daemon* daemon = NULL;
+	thread server;
+	string socket_fname = opts.socket_fname;
+	if(socket_fname.empty()){
+		socket_fname = dir + "/daemon.sock";
+		int workers = opts.workers ? opts.workers : max(1u, thread::hardware_concurrency());
+		daemon = new assembler_daemon(socket_fname, workers);
+		string err = daemon->listen();
+		if(err.size()) bench_error(err);
+		server = thread(&assembler_daemon::serve, daemon);
+		printf("daemon with %d workers, ", workers);
+	}
+	printf("%lld line module, %zu bytes, %d requests per mode\n\n", opts.lines, source.size(), opts.requests);
+
+	assembler local;
+	local.emit = emit;
+	assembly_result expected = local.assemble(source);
+	if(!expected.success) bench_error("The benchmark module doesn't assemble");
+
+	printf("%-12s %10s %10s %10s\n", "mode", "mean (us)", "p50 (us)", "p99 (us)");
+	vector<double> latencies(opts.requests);
+	for(int r = 0; r<opts.requests; r++){
+		auto begin = chrono::steady_clock::now();
+		local.assemble(source);
+		latencies[r] = seconds_since(begin);
+	}
+	report("in-process", latencies);
+
+	daemon_client client;
+	assembly_result res;
+	if(!client.connect(socket_fname)) bench_error("No daemon listens on " + socket_fname);
+	for(int r = 0; r<opts.requests; r++){
+		auto begin = chrono::steady_clock::now();
+		bool answered = client.assemble(source, emit, res);
+		latencies[r] = seconds_since(begin);
+		if(!answered) bench_error("The daemon didn't answer");
+	}
+	if(res.object_program != expected.object_program || res.assembly_listing != expected.assembly_listing)
+		bench_error("The daemon's outputs differ from the assembler's");
+	report("connection", latencies);
+
+	for(int r = 0; r<opts.requests; r++){
+		auto begin = chrono::steady_clock::now();
+		daemon_client once;
+		bool answered = once.connect(socket_fname) && once.assemble(source, emit, res);
+		latencies[r] = seconds_since(begin);
+		if(!answered) bench_error("The daemon didn't answer");
+	}
+	report("connect", latencies);
+
+	char module_fname[] = "module.asm";
+	char* run_args[] = {args[0], module_fname, NULL};
+	cli_options run_opts = parse_options(2, run_args);
+	run_opts.dir = dir;
+	for(int r = 0; r<opts.requests; r++){
+		int status;
+		string output;
+		auto begin = chrono::steady_clock::now();
+		bool answered = client.run(run_opts, status, output);
+		latencies[r] = seconds_since(begin);
+		if(!answered || output.compare(0, 27, "Code assembled successfully")) bench_error("The daemon didn't run the command line");
+	}
+	report("files", latencies);
+
+	// every client sends its share of the requests on a connection of its own
+	vector<vector<double>> client_latencies(opts.clients);
+	vector<thread> clients;
+	atomic<bool> failed(false);
+	auto begin = chrono::steady_clock::now();
+	for(int c = 0; c<opts.clients; c++){
+		clients.push_back(thread([&, c](){
+			daemon_client conn;
+			assembly_result out;
+			if(!conn.connect(socket_fname)){
+				failed = true;
+				return;
+			}
+			for(int r = c; r<opts.requests; r += opts.clients){
+				auto request_begin = chrono::steady_clock::now();
+				if(!conn.assemble(source, emit, out)) failed = true;
+				client_latencies[c].push_back(seconds_since(request_begin));
+			}
+		}));
+	}
+	for(thread& t: clients) t.join();
+	double elapsed = seconds_since(begin);
+	if(failed) bench_error("The daemon didn't answer a concurrent client");
+	latencies.clear();
+	for(vector<double>& l: client_latencies) latencies.insert(latencies.end(), l.begin(), l.end());
+	char throughput[64];
+	snprintf(throughput, sizeof(throughput), "%.0f requests/s from %d clients", opts.requests/elapsed, opts.clients);
+	report("concurrent", latencies, throughput);
+
+	client.close();
+	if(daemon){
+		daemon->stop();
+		server.join();
+		delete daemon;
+	}
+	for(const char* fname: {"module.asm", IMD_FNAME, ALS_FNAME, OBJ_FNAME}) unlink((dir + "/" + fname).c_str());
+	rmdir(dir.c_str());
+	return 0;
+}
@@ -0,0 +1,181 @@
+/*
+Times assembling a program of generated modules (control sections that call each
+other through EXTDEF and EXTREF) as one source, against assembling the modules
+separately in parallel and linking their object programs with the linking loader
+(assembler --link). also timed are relinking after one module changed, which only
+reassembles that module, and the linking loader alone with one and with every thread.
+the linked program must be the same whichever way it was built.
+
+To compile and run use:-
+$g++ -std=c++17 -O2 bench/link_bench.cpp -o link_bench -pthread
+$./link_bench
+$./link_bench --modules 8 --lines 2000
+
+Options:-
+	--modules <n>	modules of the generated program (default 16)
+	--lines <n>		lines of each module, the program must fit in memory (default 1000)
+	--threads <n>	threads of the parallel builds (default one per core)
+	--runs <n>		timed builds per mode, the mean and the fastest are reported (default 5)
+*/
+
+#define NO_MAIN
+#include "../assembler.cpp"
+
+struct link_bench_options{
+	int modules = 16;
+	int lines = 1000;
+	int threads = 0;
+	int runs = 5;
+};
+
+// unlike fatal(), fails with a non-zero exit status for scripts
+void bench_error(string error_string){
+	fprintf(stderr, "Error: %s\n", error_string.c_str());
+	exit(1);
+}
+
+void usage(){
+	fprintf(stderr, "usage: link_bench [--modules n] [--lines n] [--threads n] [--runs n]\n");
+	exit(1);
+}
+
+link_bench_options parse_bench_options(int argc, char** args){
+	link_bench_options opts;
+	for(int i = 1; i<argc; i++){
+		string arg = args[i];
+		if(i+1 == argc) usage();
+		string value = args[++i];
+		if(arg == "--modules") opts.modules = min(max(1, atoi(value.c_str())), 99999);
+		else if(arg == "--lines") opts.lines = max(8, atoi(value.c_str()));
+		else if(arg == "--threads") opts.threads = max(1, atoi(value.c_str()));
+		else if(arg == "--runs") opts.runs = max(1, atoi(value.c_str()));
+		else usage();
+	}
+	return opts;
+}
+
+double seconds_since(chrono::steady_clock::time_point begin){
+	return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+// the module k of n, a section named Mk that defines the entry Ek and the word Dk and
+// refers to those of the next module. every fourth line uses an external symbol, the
+// others its own data, so its object program has both kinds of modification records.
+// with first, the module starts the program (START, or it is its first section) and
+// its END names the entry. version changes the value of a word
+string module_source(int k, int n, int lines, bool first, bool separate, int version = 0){
+	string name = "M" + to_string(k), next = to_string((k+1) % n);
+	string out = name + (first || separate ? "\tSTART\t0\n" : "\tCSECT\n");
+	out += "\tEXTDEF\tE" + to_string(k) + ",D" + to_string(k) + "\n";
+	if(n > 1) out += "\tEXTREF\tE" + next + ",D" + next + "\n";
+	string own = "D" + to_string(k), ext = (n > 1) ? "D" + next : own;
+	out += "E" + to_string(k) + "\tLDA\t" + own + "\n";
+	for(int l = 0; l<lines-8; l++){
+		switch(l % 4){
+			case 0: out += "\tADD\t" + own + "\n"; break;
+			case 1: out += "\t+STA\t" + ext + "\n"; break;
+			case 2: out += "\tSTA\t" + own + "\n"; break;
+			default: out += "\tLDX\t" + own + "\n"; break;
+		}
+	}
+	out += "\tRSUB\n";
+	out += own + "\tWORD\t" + to_string(k + version) + "\n";
+	out += "\tWORD\t" + ext + "\n";
+	if(separate || k == n-1) out += first ? "\tEND\tE0\n" : "\tEND\n";
+	return out;
+}
+
+// a timed mode, build() is called runs times and returns the binary object it made
+void time_mode(const char* mode, int runs, const function<string()>& build, const string& expected){
+	double mean = 0, best = 0;
+	for(int run = 0; run<runs; run++){
+		auto begin = chrono::steady_clock::now();
+		string binary = build();
+		double t = seconds_since(begin);
+		if(binary != expected) bench_error(string("The program built by <") + mode + "> differs from the one assembled as one source");
+		mean += t/runs;
+		if(run == 0 || t < best) best = t;
+	}
+	printf("%-24s %12.3f %12.3f\n", mode, mean*1e3, best*1e3);
+}
+
+int main(int argc, char** args){
+	link_bench_options opts = parse_bench_options(argc, args);
+	int threads = opts.threads ? opts.threads : max(1u, thread::hardware_concurrency());
+	int n = opts.modules;
+
+	string source = "";
+	vector<string> modules(n), names(n);
+	for(int k = 0; k<n; k++){
+		source += module_source(k, n, opts.lines, k == 0, false);
+		modules[k] = module_source(k, n, opts.lines, k == 0, true);
+		names[k] = "M" + to_string(k);
+	}
+	printf("%d modules of %d lines, %zu bytes, %d threads, %d runs per mode\n\n", n, opts.lines, source.size(), threads, opts.runs);
+
+	int emit = (1<<OUT_OBJECT) | (1<<OUT_BINARY);
+	assembler whole(threads);
+	whole.emit = emit;
+	assembly_result expected = whole.assemble(source);
+	if(!expected.success) bench_error("The benchmark program doesn't assemble:\n" + expected.diagnostics.back().to_string());
+
+	// the object programs of the modules, assembled separately
+	vector<string> objects(n);
+	auto assemble_modules = [&](const vector<int>& which){
+		parallel_for(which.size(), threads, [&](int m){
+			assembler asmb;
+			asmb.emit = (1<<OUT_OBJECT);
+			assembly_result res = asmb.assemble(modules[which[m]]);
+			if(!res.success) bench_error("A benchmark module doesn't assemble:\n" + res.diagnostics.back().to_string());
+			objects[which[m]] = move(res.object_program);
+		});
+	};
+	auto link = [&](int link_threads){
+		vector<string_view> views(objects.begin(), objects.end());
+		linked_program linked;
+		string err = link_objects(views, names, link_threads, linked);
+		if(err.size()) bench_error(err);
+		string binary;
+		object_text_to_binary(linked.object_program, binary);
+		return binary;
+	};
+	vector<int> every(n);
+	for(int k = 0; k<n; k++) every[k] = k;
+	assemble_modules(every);
+	linked_program linked;
+	vector<string_view> views(objects.begin(), objects.end());
+	if(link_objects(views, names, threads, linked).size()) bench_error("The benchmark modules don't link");
+	printf("%d control sections, %d external symbols, %d modification records\n\n", linked.cnt_sections, linked.cnt_symbols, linked.cnt_modifications);
+
+	printf("%-24s %12s %12s\n", "mode", "mean (ms)", "best (ms)");
+	time_mode("one source", opts.runs, [&](){
+		assembler asmb(threads);
+		asmb.emit = emit;
+		return asmb.assemble(source).object_binary;
+	}, expected.object_binary);
+	time_mode("separately + link", opts.runs, [&](){
+		assemble_modules(every);
+		return link(threads);
+	}, expected.object_binary);
+
+	// one module changed, each run reassembles only that module and links the program
+	int changed = n/2;
+	string original = modules[changed];
+	assembler edited_whole(threads);
+	edited_whole.emit = emit;
+	string edited_source = source;
+	string original_section = module_source(changed, n, opts.lines, changed == 0, false);
+	edited_source.replace(source.find(original_section), original_section.size(), module_source(changed, n, opts.lines, changed == 0, false, 1));
+	string expected_edited = edited_whole.assemble(edited_source).object_binary;
+	modules[changed] = module_source(changed, n, opts.lines, changed == 0, true, 1);
+	time_mode("one module changed", opts.runs, [&](){
+		assemble_modules({changed});
+		return link(threads);
+	}, expected_edited);
+	modules[changed] = original;
+	assemble_modules({changed});
+
+	time_mode("link, 1 thread", opts.runs, [&](){ return link(1); }, expected.object_binary);
+	time_mode(("link, " + to_string(threads) + (threads == 1 ? " thread" : " threads")).c_str(), opts.runs, [&](){ return link(threads); }, expected.object_binary);
+	return 0;
+}
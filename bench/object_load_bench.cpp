@@ -0,0 +1,115 @@
+/*
+Times loading an object program into memory from the text records and from the
+binary format, each read from a mapped file as the simulator and the tools do.
+
+To compile and run use:-
+$g++ -std=c++17 -O2 bench/object_load_bench.cpp -o object_load_bench -pthread
+$./object_load_bench
+$./object_load_bench -f output_object_program.txt
+
+Options:-
+	-f <file>		load this object program (text or binary) instead of a generated one
+	--runs <n>		loads of each format, the mean and the fastest are reported (default 2000)
+*/
+
+#define NO_MAIN
+#include "../assembler.cpp"
+#include "sicgen.h"
+
+struct load_bench_options{
+	string input_file = "";
+	int runs = 2000;
+};
+
+// unlike fatal(), fails with a non-zero exit status for scripts
+void bench_error(string error_string){
+	fprintf(stderr, "Error: %s\n", error_string.c_str());
+	exit(1);
+}
+
+void usage(){
+	fprintf(stderr, "usage: object_load_bench [-f object program] [--runs n]\n");
+	exit(1);
+}
+
+load_bench_options parse_bench_options(int argc, char** args){
+	load_bench_options opts;
+	for(int i = 1; i<argc; i++){
+		string arg = args[i];
+		if(i+1 == argc) usage();
+		string value = args[++i];
+		if(arg == "-f") opts.input_file = value;
+		else if(arg == "--runs") opts.runs = max(1, atoi(value.c_str()));
+		else usage();
+	}
+	return opts;
+}
+
+double seconds_since(chrono::steady_clock::time_point begin){
+	return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+struct load_timing{
+	double mean, best; // seconds per load
+};
+
+// maps and loads fname runs times, the image of the last load is left in image
+load_timing time_loads(string fname, int runs, memory_image& image){
+	load_timing timing = {0, 0};
+	for(int run = 0; run<runs; run++){
+		auto begin = chrono::steady_clock::now();
+		source_file object;
+		if(!object.open(fname) || !load_object(object.text(), image)) bench_error(E_BADOB);
+		double t = seconds_since(begin);
+		timing.mean += t/runs;
+		if(run == 0 || t < timing.best) timing.best = t;
+	}
+	return timing;
+}
+
+int main(int argc, char** args){
+	load_bench_options opts = parse_bench_options(argc, args);
+
+	// the object program in both formats, written to a temporary directory
+	string text, binary;
+	if(opts.input_file.size()){
+		source_file input;
+		if(!input.open(opts.input_file)) bench_error(E_NOFIL);
+		bool is_binary = is_binary_object(input.text());
+		bool valid = is_binary ? object_binary_to_text(input.text(), text) : object_text_to_binary(input.text(), binary);
+		if(!valid) bench_error(E_BADOB);
+		(is_binary ? binary : text) = string(input.text());
+		printf("%s: ", opts.input_file.c_str());
+	}else{
+		generator_options gen_opts;
+		gen_opts.lines = 30000; // about as many statements as fit in memory
+		generated_program gen = generate_program(gen_opts);
+		assembler asmb;
+		asmb.emit = (1<<OUT_OBJECT) | (1<<OUT_BINARY);
+		assembly_result res = asmb.assemble(gen.text);
+		if(!res.success) bench_error("The benchmark program doesn't assemble:\n" + res.diagnostics.back().to_string());
+		text = move(res.object_program);
+		binary = move(res.object_binary);
+		printf("generated program of %lld statements: ", gen.statements);
+	}
+	char out_dir[] = "/tmp/object_load_bench.XXXXXX";
+	if(!mkdtemp(out_dir)) bench_error("Can't create a directory for the object programs");
+	string text_fname = string(out_dir) + "/" OBJ_FNAME, binary_fname = string(out_dir) + "/" BIN_FNAME;
+	if(!write_file(text_fname, text) || !write_file(binary_fname, binary)) bench_error(E_NOWRT(out_dir));
+	printf("%zu bytes of text records, %zu bytes of binary, %d loads each\n\n", text.size(), binary.size(), opts.runs);
+
+	memory_image text_image, binary_image;
+	load_timing text_timing = time_loads(text_fname, opts.runs, text_image);
+	load_timing binary_timing = time_loads(binary_fname, opts.runs, binary_image);
+	unlink(text_fname.c_str());
+	unlink(binary_fname.c_str());
+	rmdir(out_dir);
+	if(text_image.memory != binary_image.memory || text_image.entry_point != binary_image.entry_point)
+		bench_error("The two formats load different images");
+
+	printf("%-8s %12s %12s %10s\n", "format", "mean (us)", "best (us)", "MB/s");
+	printf("%-8s %12.2f %12.2f %10.1f\n", "text", text_timing.mean*1e6, text_timing.best*1e6, text.size()/text_timing.mean/1e6);
+	printf("%-8s %12.2f %12.2f %10.1f\n", "binary", binary_timing.mean*1e6, binary_timing.best*1e6, binary.size()/binary_timing.mean/1e6);
+	printf("\nbinary loads %.1fx faster\n", text_timing.mean/binary_timing.mean);
+	return 0;
+}
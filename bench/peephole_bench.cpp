@@ -0,0 +1,203 @@
+/*
+Measures what the peephole optimizer (-O) saves: the instructions a program executes
+on the simulator and the size of its object code, assembled with and without it.
+the built-in program is written the way a naive code generator would write it, with
+temporaries stored and loaded again, a loop whose condition jumps to a jump and a
+subroutine ending in a call. the results of both runs (A, X and RESULT if the program
+has it) must be the same, as must those of a program whose indexed store rewrites
+the return address of a subroutine the optimizer would otherwise turn into a tail call.
+
+To compile and run use:-
+$g++ -std=c++17 -O2 bench/peephole_bench.cpp -o peephole_bench -pthread
+$./peephole_bench
+$./peephole_bench --iterations 100000
+$./peephole_bench -f COPY.txt
+
+Options:-
+	--iterations <n>	iterations of the built-in program's loop (default 1000000)
+	-f <file>		measure a source file instead, its devices are the XX.dev files
+*/
+
+#define NO_MAIN
+#include "../assembler.cpp"
+
+// sums the squares of 0 to n-1 into RESULT, about 20 instructions an iteration
+string compiled_source(int iterations){
+	return string(
+	"SUMSQ\tSTART\t0\n"
+	"FIRST\tSTL\tRETADR\n"
+	"\tLDA\tZERO\n"
+	"\tSTA\tI\n"
+	"\tSTA\tSUM\n"
+	"LOOP\tJSUB\tSTEP\n"
+	"\tLDA\tI\n"
+	"\tADD\tONE\n"
+	"\tSTA\tI\n"
+	"\tLDA\tI\n"
+	"\tCOMP\tN\n"
+	"\tJLT\tCONT\n"
+	"\tJ\tDONE\n"
+	"CONT\tJ\tNEXT\n"
+	"NEXT\tJ\tLOOP\n"
+	"DONE\tLDA\tSUM\n"
+	"\tSTA\tRESULT\n"
+	"\tLDL\tRETADR\n"
+	"\tRSUB\n"
+	"STEP\tSTL\tSTEPRT\n"
+	"\tLDA\tI\n"
+	"\tMUL\tI\n"
+	"\tSTA\tT1\n"
+	"\tLDA\tT1\n"
+	"\tJSUB\tACCUM\n"
+	"\tLDL\tSTEPRT\n"
+	"\tRSUB\n"
+	"ACCUM\tADD\tSUM\n"
+	"\tSTA\tSUM\n"
+	"\tLDA\tSUM\n"
+	"\tRSUB\n"
+	"ZERO\tWORD\t0\n"
+	"ONE\tWORD\t1\n"
+	"N\tWORD\t") + to_string(iterations) + "\n"
+	"I\tRESW\t1\n"
+	"SUM\tRESW\t1\n"
+	"T1\tRESW\t1\n"
+	"RESULT\tRESW\t1\n"
+	"RETADR\tRESW\t1\n"
+	"STEPRT\tRESW\t1\n"
+	"\tEND\tFIRST\n";
+}
+
+// OUTER looks like a tail call, but PATCH copies the low byte of ALT into SAVEL with
+// STCH BUF,X before loading it. OUTER then returns to ALT, after JSUB GETADR, so
+// RESULT is 2 unless the rewrite skips the store and returns to the caller (1)
+const char* ALIASED_SOURCE =
+	"ALIAS\tSTART\t0\n"
+	"FIRST\tSTL\tRETADR\n"
+	"\tJSUB\tGETADR\n"
+	"\tLDA\tPASSES\n"
+	"\tADD\tONE\n"
+	"\tSTA\tPASSES\n"
+	"\tCOMP\tONE\n"
+	"\tJGT\tDONE\n"
+	"\tJSUB\tOUTER\n"
+	"DONE\tLDA\tPASSES\n"
+	"\tSTA\tRESULT\n"
+	"\tLDL\tRETADR\n"
+	"\tRSUB\n"
+	"GETADR\tSTL\tALT\n"
+	"\tRSUB\n"
+	"OUTER\tSTL\tSAVEL\n"
+	"\tJSUB\tPATCH\n"
+	"\tLDL\tSAVEL\n"
+	"\tRSUB\n"
+	"PATCH\tLDX\tTWO\n"
+	"\tLDCH\tALT,X\n"
+	"\tLDX\tFIVE\n"
+	"\tSTCH\tBUF,X\n"
+	"\tLDA\tSAVEL\n"
+	"\tRSUB\n"
+	"ONE\tWORD\t1\n"
+	"TWO\tWORD\t2\n"
+	"FIVE\tWORD\t5\n"
+	"PASSES\tWORD\t0\n"
+	"BUF\tWORD\t0\n"
+	"SAVEL\tWORD\t0\n"
+	"ALT\tRESW\t1\n"
+	"RESULT\tRESW\t1\n"
+	"RETADR\tRESW\t1\n"
+	"\tEND\tFIRST\n";
+
+struct peephole_bench_options{
+	int iterations = 1000000;
+	string input_file = "";
+};
+
+// unlike fatal(), fails with a non-zero exit status for scripts
+void bench_error(string error_string){
+	fprintf(stderr, "Error: %s\n", error_string.c_str());
+	exit(1);
+}
+
+void usage(){
+	fprintf(stderr, "usage: peephole_bench [--iterations n] [-f file]\n");
+	exit(1);
+}
+
+peephole_bench_options parse_bench_options(int argc, char** args){
+	peephole_bench_options opts;
+	for(int i = 1; i<argc; i++){
+		string arg = args[i];
+		if(i+1 == argc) usage();
+		string value = args[++i];
+		if(arg == "--iterations") opts.iterations = min(max(1, atoi(value.c_str())), (1<<23)-1);
+		else if(arg == "-f") opts.input_file = value;
+		else usage();
+	}
+	return opts;
+}
+
+// a run of the program assembled with or without the optimizer
+struct measured_run{
+	unsigned long long cnt_instructions;
+	double seconds;
+	int object_bytes;
+	int A, X, result; // result is the word at RESULT, -1 if there is none
+	peephole_counts rewrites;
+};
+
+measured_run measure(string_view source, bool optimize){
+	assembler asmb;
+	asmb.emit = (1<<OUT_BINARY);
+	asmb.optimize = optimize;
+	assembly_result res = asmb.assemble(source);
+	if(!res.success) bench_error("The benchmark program doesn't assemble:\n" + res.diagnostics.back().to_string());
+	memory_image image;
+	if(!load_object(res.object_binary, image)) bench_error(E_BADOB);
+	sic_machine machine;
+	if(!machine.load(image)) bench_error(E_SIMMEM);
+	auto begin = chrono::steady_clock::now();
+	bool halted = machine.run();
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+	if(!halted || !machine.close_devices()) bench_error(machine.fault);
+
+	measured_run run = {machine.cnt_instructions, seconds, (int)asmb.object_bytes.size(), machine.A, machine.X, -1, asmb.peephole_count};
+	symbol_table::handle sym = asmb.SYMTAB.find("RESULT");
+	if(sym >= 0){
+		int address = asmb.SYMTAB.value(sym);
+		run.result = (machine.memory[address] << 16) | (machine.memory[address+1] << 8) | machine.memory[address+2];
+	}
+	return run;
+}
+
+int main(int argc, char** args){
+	peephole_bench_options opts = parse_bench_options(argc, args);
+
+	string source, name;
+	if(opts.input_file.size()){
+		source_file input;
+		if(!input.open(opts.input_file)) bench_error(E_NOFIL);
+		source = string(input.text());
+		name = opts.input_file;
+	}else{
+		source = compiled_source(opts.iterations);
+		name = "compiled";
+	}
+
+	measured_run aliased = measure(ALIASED_SOURCE, true);
+	if(aliased.result != 2 || aliased.rewrites.tail_calls != 0)
+		bench_error("The optimizer made a tail call of a subroutine whose return address is stored indexed");
+
+	measured_run plain = measure(source, false), optimized = measure(source, true);
+	if(plain.A != optimized.A || plain.X != optimized.X || plain.result != optimized.result)
+		bench_error("The optimized program computed something else");
+
+	const peephole_counts& pc = optimized.rewrites;
+	printf("%s: %d load%s removed, %d jump%s threaded, %d tail call%s\n\n", name.c_str(), pc.loads, (pc.loads==1 ? "" : "s"),
+		pc.jumps, (pc.jumps==1 ? "" : "s"), pc.tail_calls, (pc.tail_calls==1 ? "" : "s"));
+	printf("%-10s %14s %12s %10s\n", "", "instructions", "code bytes", "seconds");
+	printf("%-10s %14llu %12d %10.4f\n", "plain", plain.cnt_instructions, plain.object_bytes, plain.seconds);
+	printf("%-10s %14llu %12d %10.4f\n", "-O", optimized.cnt_instructions, optimized.object_bytes, optimized.seconds);
+	printf("%-10s %13.1f%% %11.1f%%\n", "saved", 100.0*(1 - (double)optimized.cnt_instructions/plain.cnt_instructions),
+		100.0*(1 - (double)optimized.object_bytes/plain.object_bytes));
+	return 0;
+}
@@ -0,0 +1,146 @@
+/*
+Times incremental reassembly (assembler::reassemble(), as --watch uses it) against
+a full assembly of the same source, for a few typical edits of a generated
+program or a source file. the edits are made around an unlabelled LDA inserted
+in the middle of the source. every edit is applied and undone in turn, so that
+each timed call sees a changed source, and its four outputs are checked against
+those of a full assembly.
+
+To compile and run use:-
+$g++ -std=c++17 -O2 bench/reassemble_bench.cpp -o reassemble_bench -pthread
+$./reassemble_bench
+$./reassemble_bench --lines 30000
+$./reassemble_bench -f big.asm
+
+Options:-
+	--lines <n>		lines of the generated program (default 1000000)
+	-f <file>		edit a source file instead, it needs a label after START
+	--runs <n>		timed calls per edit, the mean and the fastest are reported (default 20)
+*/
+
+#define NO_MAIN
+#include "../assembler.cpp"
+#include "sicgen.h"
+
+struct reassemble_bench_options{
+	long long lines = 1000000;
+	string input_file = "";
+	int runs = 20;
+};
+
+// unlike fatal(), fails with a non-zero exit status for scripts
+void bench_error(string error_string){
+	fprintf(stderr, "Error: %s\n", error_string.c_str());
+	exit(1);
+}
+
+void usage(){
+	fprintf(stderr, "usage: reassemble_bench [--lines n] [-f file] [--runs n]\n");
+	exit(1);
+}
+
+reassemble_bench_options parse_bench_options(int argc, char** args){
+	reassemble_bench_options opts;
+	for(int i = 1; i<argc; i++){
+		string arg = args[i];
+		if(i+1 == argc) usage();
+		string value = args[++i];
+		if(arg == "--lines") opts.lines = max(3LL, atoll(value.c_str()));
+		else if(arg == "-f") opts.input_file = value;
+		else if(arg == "--runs") opts.runs = max(1, atoi(value.c_str()));
+		else usage();
+	}
+	return opts;
+}
+
+double seconds_since(chrono::steady_clock::time_point begin){
+	return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+// an edit of the source, the text at position replaced by text
+struct source_edit{
+	string name;
+	size_t position, length;
+	string text;
+};
+
+// times reassembling the edited and the original source in turn, the results are
+// checked against a full assembly once
+void time_edit(assembler& asmb, const string& source, const source_edit& edit, int runs){
+	string edited = source;
+	edited.replace(edit.position, edit.length, edit.text);
+	assembler full;
+	full.emit = asmb.emit;
+	assembly_result expected = full.assemble(edited);
+	double mean = 0, best = 0;
+	int cnt_parsed = 0;
+	for(int run = 0; run<runs; run++){
+		auto begin = chrono::steady_clock::now();
+		const assembly_result& res = asmb.reassemble(edited);
+		double t = seconds_since(begin);
+		if(run == 0 && (res.success != expected.success || res.intermediate_file != expected.intermediate_file
+			|| res.assembly_listing != expected.assembly_listing || res.object_program != expected.object_program
+			|| res.object_binary != expected.object_binary))
+			bench_error("Reassembling after the edit <" + edit.name + "> differs from a full assembly");
+		mean += t/runs;
+		if(run == 0 || t < best) best = t;
+		cnt_parsed = asmb.cnt_parsed_lines;
+		asmb.reassemble(source);
+	}
+	printf("%-16s %12.3f %12.3f %10d\n", edit.name.c_str(), mean*1e3, best*1e3, cnt_parsed);
+}
+
+int main(int argc, char** args){
+	reassemble_bench_options opts = parse_bench_options(argc, args);
+
+	string source;
+	if(opts.input_file.size()){
+		source_file input;
+		if(!input.open(opts.input_file)) bench_error(E_NOFIL);
+		source = string(input.text());
+		printf("%s: ", opts.input_file.c_str());
+	}else{
+		generator_options gen_opts;
+		gen_opts.lines = opts.lines;
+		source = generate_program(gen_opts).text;
+		printf("generated program: ");
+	}
+	// the edits are made around an unlabelled LDA of the first label after START,
+	// inserted before the line holding the middle byte of the source
+	size_t label_begin = string::npos, label_end = string::npos;
+	for(size_t p = source.find('\n') + 1; p && p < source.size(); p = source.find('\n', p) + 1){
+		if(!isalpha((unsigned char)source[p])) continue;
+		label_begin = p;
+		label_end = source.find_first_of(" \t\n", p);
+		break;
+	}
+	if(label_end == string::npos) bench_error("The source has no label after START to load");
+	string label = source.substr(label_begin, label_end-label_begin);
+	size_t line_begin = source.rfind('\n', source.size()/2) + 1; // 0 if there is no newline before
+	if(line_begin == 0) line_begin = source.find('\n') + 1;
+	string line = "\tLDA\t" + label + "\n";
+	source.insert(line_begin, line);
+	size_t lda = line_begin+1, line_end = line_begin + line.size()-1;
+
+	long long cnt_lines = count(source.begin(), source.end(), '\n') + 1;
+	printf("%lld lines, %zu bytes, %d runs per edit\n\n", cnt_lines, source.size(), opts.runs);
+
+	string store = line;
+	store.replace(lda-line_begin, 3, "STA");
+	vector<source_edit> edits = {
+		{"operation", lda, 3, "LDX"}, // same size, same symbols
+		{"comment", line_end+1, 0, ".\tan added comment\n"},
+		{"insert", line_end+1, 0, store}, // the later lines move
+		{"delete", line_begin, line.size(), ""},
+	};
+
+	assembler asmb;
+	asmb.emit = EMIT_DEFAULT | (1<<OUT_BINARY);
+	auto begin = chrono::steady_clock::now();
+	if(!asmb.reassemble(source).success) bench_error("The benchmark program doesn't assemble:\n" + asmb.result.diagnostics.back().to_string());
+	printf("full assembly %.3f ms\n\n", seconds_since(begin)*1e3);
+
+	printf("%-16s %12s %12s %10s\n", "edit", "mean (ms)", "best (ms)", "parsed");
+	for(source_edit& edit: edits) time_edit(asmb, source, edit, opts.runs);
+	return 0;
+}
@@ -0,0 +1,46 @@
+/*
+Writes a synthetic SIC program to stdout, see sicgen.h.
+
+To compile and run use:-
+$g++ -std=c++17 -O2 bench/sicgen.cpp -o sicgen
+$./sicgen -n 1000000 -s 5000 > big.asm
+
+Options (fractions are between 0 and 1):-
+	-n <lines>		total lines
+	-s <symbols>		distinct labels
+	-r <fraction>		statements that are RESW/RESB
+	-c <fraction>		statements that are BYTE C'...'
+	-m <fraction>		lines that are comments
+	-b <fraction>		lines that are blank
+	-S <seed>		random seed
+*/
+
+#include "sicgen.h"
+#include <iostream>
+
+int main(int argc, char** args){
+	generator_options opts;
+	for(int i = 1; i<argc; i++){
+		std::string arg = args[i];
+		if(i+1 == argc || arg.size() != 2 || arg[0] != '-'){
+			fprintf(stderr, "usage: sicgen [-n lines] [-s symbols] [-r reserve] [-c strings] [-m comments] [-b blanks] [-S seed]\n");
+			return 1;
+		}
+		const char* value = args[++i];
+		switch(arg[1]){
+			case 'n': opts.lines = atoll(value); break;
+			case 's': opts.symbols = atoi(value); break;
+			case 'r': opts.reserve_ratio = atof(value); break;
+			case 'c': opts.string_ratio = atof(value); break;
+			case 'm': opts.comment_ratio = atof(value); break;
+			case 'b': opts.blank_ratio = atof(value); break;
+			case 'S': opts.seed = atoi(value); break;
+			default: fprintf(stderr, "sicgen: unknown option %s\n", arg.c_str()); return 1;
+		}
+	}
+	generated_program gen = generate_program(opts);
+	std::cout.write(gen.text.data(), gen.text.size());
+	if(gen.filler_comments)
+		fprintf(stderr, "sicgen: address space full, %lld statements written as comments\n", gen.filler_comments);
+	return 0;
+}
@@ -0,0 +1,142 @@
+// synthetic SIC program generator, shared by sicgen.cpp and assembler_bench.cpp
+//
+// the programs are valid for the assembler: every referenced symbol is defined
+// once, operands fit their directives and the program fits the 64K address
+// space of SIC. that space holds only about 20K statements, so once it is used up
+// the remaining lines are written as comments (see generated_program)
+
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <cstdio>
+
+struct generator_options{
+	long long lines = 100000; // total lines, including START and END
+	int symbols = 5000; // distinct labels, at most one per statement
+	double reserve_ratio = 0.05; // fraction of statements that are RESW/RESB
+	double string_ratio = 0.10; // fraction of statements that are BYTE C'...'
+	double comment_ratio = 0.20; // fraction of lines that are comments
+	double blank_ratio = 0.02; // fraction of lines that are blank
+	unsigned seed = 1;
+};
+
+struct generated_program{
+	std::string text;
+	long long statements; // lines with a mnemonic
+	long long filler_comments; // lines turned into comments once the address space was full
+};
+
+#define GEN_MAXAD 65000 // generated programs end below this address
+
+// name of the i'th symbol
+inline std::string generated_symbol(int i){
+	return "L" + std::to_string(i);
+}
+
+inline generated_program generate_program(const generator_options& opts){
+	static const char* OPERATIONS[] = {"LDA", "LDX", "LDL", "STA", "STX", "STL", "LDCH", "STCH",
+		"ADD", "SUB", "MUL", "DIV", "COMP", "J", "JLT", "JEQ", "JGT", "JSUB", "TIX", "TD", "RD", "WD"};
+	const int cnt_operations = sizeof(OPERATIONS)/sizeof(OPERATIONS[0]);
+	std::mt19937_64 rng(opts.seed);
+	std::uniform_real_distribution<double> unit(0, 1);
+	auto below = [&](long long n){ return (long long)(rng() % n); };
+
+	// lines 2 .. lines-1 are the body; statements are planned first so that labels
+	// can be spread evenly over them
+	long long body_lines = std::max(0LL, opts.lines - 2);
+	double statement_ratio = std::max(0.0, 1 - opts.comment_ratio - opts.blank_ratio);
+	int symbols = std::max(1, opts.symbols);
+	int code_limit = GEN_MAXAD - 3*symbols; // room is kept for the symbols defined at the end
+	if(code_limit < 3){
+		fprintf(stderr, "sicgen: too many symbols for the address space, use fewer\n");
+		exit(1);
+	}
+	double average_size = opts.reserve_ratio*5 + opts.string_ratio*15.5 + 0.05*3 + 0.02*1
+		+ std::max(0.0, 1 - opts.reserve_ratio - opts.string_ratio - 0.07)*3; // bytes per statement
+	long long planned = std::max(1LL, std::min((long long)(body_lines * statement_ratio), (long long)(code_limit / average_size)));
+
+	generated_program gen = {"", 0, 0};
+	gen.text.reserve(body_lines * 24 + 64);
+	gen.text += "BENCH\tSTART\t0\n";
+
+	// label of the first statement is L0, the entry point given to END
+	int location = 0;
+	int defined = 0; // symbols L0 .. L(defined-1) have been written
+	long long statement_index = 0;
+	char line[96];
+	for(long long l = 0; l<body_lines; l++){
+		double kind = unit(rng) * (opts.comment_ratio + opts.blank_ratio + statement_ratio);
+		bool is_statement = (l == 0) || (kind >= opts.comment_ratio + opts.blank_ratio);
+		if(!is_statement && kind >= opts.comment_ratio){
+			gen.text += "\n";
+			continue;
+		}
+
+		// choosing the statement and its size
+		std::string mnemonic, operand;
+		int size = 3;
+		double what = unit(rng);
+		if(is_statement && l > 0 && what < opts.reserve_ratio){
+			int count = 1 + below(4);
+			mnemonic = (below(2) ? "RESW" : "RESB");
+			operand = std::to_string(count);
+			size = (mnemonic == "RESW") ? 3*count : count;
+		}else if(is_statement && l > 0 && what < opts.reserve_ratio + opts.string_ratio){
+			int count = 1 + below(30);
+			mnemonic = "BYTE";
+			operand = "C'";
+			for(int i = 0; i<count; i++) operand += (char)('A' + below(26));
+			operand += "'";
+			size = count;
+		}else if(is_statement && l > 0 && what < opts.reserve_ratio + opts.string_ratio + 0.05){
+			mnemonic = "WORD";
+			operand = std::to_string(below(1<<20));
+		}else if(is_statement && l > 0 && what < opts.reserve_ratio + opts.string_ratio + 0.07){
+			mnemonic = "BYTE";
+			snprintf(line, sizeof(line), "X'%02X'", (int)below(256));
+			operand = line;
+			size = 1;
+		}else if(is_statement && l > 0 && what < opts.reserve_ratio + opts.string_ratio + 0.08){
+			mnemonic = "RSUB";
+		}else{ // an operation on a symbol, forward references included
+			mnemonic = OPERATIONS[below(cnt_operations)];
+			operand = generated_symbol(below(symbols));
+			if(below(8) == 0) operand += ",X";
+		}
+		if(is_statement && location + size > code_limit){ // out of address space
+			is_statement = false;
+			gen.filler_comments++;
+		}
+		if(!is_statement){
+			snprintf(line, sizeof(line), ".\tcomment on line %lld of the generated program\n", l+2);
+			gen.text += line;
+			continue;
+		}
+
+		// labels spread evenly over the planned statements, the rest are defined at the end
+		std::string label = "";
+		if(defined < symbols && (l == 0 || (statement_index * symbols) / planned >= defined)){
+			label = generated_symbol(defined++);
+		}
+		gen.text += label;
+		gen.text += '\t';
+		gen.text += mnemonic;
+		gen.text += '\t';
+		gen.text += operand;
+		gen.text += '\n';
+		location += size;
+		statement_index++;
+		gen.statements++;
+	}
+
+	// symbols that are still undefined, as words after the code
+	for(; defined<symbols; defined++){
+		gen.text += generated_symbol(defined) + "\tWORD\t0\n";
+		location += 3;
+		gen.statements++;
+	}
+	gen.text += "\tEND\tL0\n";
+	gen.statements += 2;
+	return gen;
+}
@@ -0,0 +1,190 @@
+/*
+Times the simulator on two workloads of a few hundred million instructions:
+- copy, the COPY program of COPY.txt copying a generated input device to an output one
+- loop, a loop of loads, stores, arithmetic and indexed byte moves with no I/O
+
+To compile and run use:-
+$g++ -std=c++17 -O2 bench/simulator_bench.cpp -o simulator_bench -pthread
+$./simulator_bench
+$./simulator_bench --instructions 1000000000
+
+Options:-
+	--instructions <n>	about how many instructions each workload runs (default 300000000)
+	--runs <n>		runs per workload, the fastest is kept (default 3)
+	--profile		count the executions of every address, as --run --profile does
+*/
+
+#define NO_MAIN
+#include "../assembler.cpp"
+
+// the program of COPY.txt, about 14 instructions per byte copied
+const char* COPY_SOURCE =
+	"COPY\tSTART\t1000\n"
+	"FIRST\tSTL\tRETADR\n"
+	"CLOOP\tJSUB\tRDREC\n"
+	"\tLDA\tLENGTH\n"
+	"\tCOMP\tZERO\n"
+	"\tJEQ\tENDFIL\n"
+	"\tJSUB\tWRREC\n"
+	"\tJ\tCLOOP\n"
+	"ENDFIL\tLDA\tEOF\n"
+	"\tSTA\tBUFFER\n"
+	"\tLDA\tTHREE\n"
+	"\tSTA\tLENGTH\n"
+	"\tJSUB\tWRREC\n"
+	"\tLDL\tRETADR\n"
+	"\tRSUB\n"
+	"EOF\tBYTE\tC'EOF'\n"
+	"THREE\tWORD\t3\n"
+	"ZERO\tWORD\t0\n"
+	"RETADR\tRESW\t1\n"
+	"LENGTH\tRESW\t1\n"
+	"BUFFER\tRESB\t4096\n"
+	"RDREC\tLDX\tZERO\n"
+	"\tLDA\tZERO\n"
+	"RLOOP\tTD\tINPUT\n"
+	"\tJEQ\tRLOOP\n"
+	"\tRD\tINPUT\n"
+	"\tCOMP\tZERO\n"
+	"\tJEQ\tEXIT\n"
+	"\tSTCH\tBUFFER,X\n"
+	"\tTIX\tMAXLEN\n"
+	"\tJLT\tRLOOP\n"
+	"EXIT\tSTX\tLENGTH\n"
+	"\tRSUB\n"
+	"INPUT\tBYTE\tX'F1'\n"
+	"MAXLEN\tWORD\t4096\n"
+	"WRREC\tLDX\tZERO\n"
+	"WLOOP\tTD\tOUTPUT\n"
+	"\tJEQ\tWLOOP\n"
+	"\tLDCH\tBUFFER,X\n"
+	"\tWD\tOUTPUT\n"
+	"\tTIX\tLENGTH\n"
+	"\tJLT\tWLOOP\n"
+	"\tRSUB\n"
+	"OUTPUT\tBYTE\tX'05'\n"
+	"\tEND\tFIRST\n";
+
+// 9 instructions per inner iteration, 1000 iterations per round
+string loop_source(long long rounds){
+	return string(
+	"LOOP\tSTART\t0\n"
+	"FIRST\tSTL\tRETADR\n"
+	"OUTER\tLDX\tZERO\n"
+	"INNER\tLDA\tSUM\n"
+	"\tADD\tSTEP\n"
+	"\tMUL\tTHREE\n"
+	"\tDIV\tTHREE\n"
+	"\tSTA\tSUM\n"
+	"\tLDCH\tTABLE,X\n"
+	"\tSTCH\tTABLE,X\n"
+	"\tTIX\tLIMIT\n"
+	"\tJLT\tINNER\n"
+	"\tLDA\tCOUNT\n"
+	"\tSUB\tONE\n"
+	"\tSTA\tCOUNT\n"
+	"\tCOMP\tZERO\n"
+	"\tJGT\tOUTER\n"
+	"\tLDL\tRETADR\n"
+	"\tRSUB\n"
+	"ZERO\tWORD\t0\n"
+	"ONE\tWORD\t1\n"
+	"THREE\tWORD\t3\n"
+	"STEP\tWORD\t7\n"
+	"LIMIT\tWORD\t1000\n"
+	"COUNT\tWORD\t") + to_string(rounds) + "\n"
+	"SUM\tWORD\t0\n"
+	"RETADR\tRESW\t1\n"
+	"TABLE\tRESB\t1000\n"
+	"\tEND\tFIRST\n";
+}
+
+struct sim_bench_options{
+	long long instructions = 300000000;
+	int runs = 3;
+	bool profile = false;
+};
+
+// unlike fatal(), fails with a non-zero exit status for scripts
+void bench_error(string error_string){
+	fprintf(stderr, "Error: %s\n", error_string.c_str());
+	exit(1);
+}
+
+void usage(){
+	fprintf(stderr, "usage: simulator_bench [--instructions n] [--runs n] [--profile]\n");
+	exit(1);
+}
+
+sim_bench_options parse_bench_options(int argc, char** args){
+	sim_bench_options opts;
+	for(int i = 1; i<argc; i++){
+		string arg = args[i];
+		if(arg == "--profile"){
+			opts.profile = true;
+			continue;
+		}
+		if(i+1 == argc) usage();
+		string value = args[++i];
+		if(arg == "--instructions") opts.instructions = max(1LL, atoll(value.c_str()));
+		else if(arg == "--runs") opts.runs = max(1, atoi(value.c_str()));
+		else usage();
+	}
+	return opts;
+}
+
+memory_image assemble_image(string_view source){
+	assembler asmb;
+	asmb.emit = (1<<OUT_BINARY);
+	assembly_result res = asmb.assemble(source);
+	if(!res.success) bench_error("The benchmark program doesn't assemble:\n" + res.diagnostics.back().to_string());
+	memory_image image;
+	if(!load_object(res.object_binary, image)) bench_error(E_BADOB);
+	return image;
+}
+
+// runs the program of image opts.runs times and prints the fastest run
+void time_workload(string name, const memory_image& image, const sim_bench_options& opts, const string* device_fnames){
+	double best = 0;
+	unsigned long long cnt_instructions = 0;
+	for(int run = 0; run<opts.runs; run++){
+		sic_machine machine;
+		for(int d = 0; d<256; d++) machine.device_fnames[d] = device_fnames[d];
+		machine.profiling = opts.profile;
+		if(!machine.load(image)) bench_error(E_SIMMEM);
+		auto begin = chrono::steady_clock::now();
+		bool halted = machine.run();
+		double t = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+		if(!halted || !machine.close_devices()) bench_error(machine.fault);
+		if(run == 0 || t < best) best = t;
+		cnt_instructions = machine.cnt_instructions;
+	}
+	printf("%-6s %14llu %10.4f %12.1f\n", name.c_str(), cnt_instructions, best, cnt_instructions/best/1e6);
+}
+
+int main(int argc, char** args){
+	sim_bench_options opts = parse_bench_options(argc, args);
+
+	// the input of COPY, records of printable bytes ended by newlines and no zero bytes
+	char dir[] = "/tmp/simulator_bench.XXXXXX";
+	if(!mkdtemp(dir)) bench_error("Can't create a directory for the devices");
+	string device_fnames[256];
+	device_fnames[0xf1] = string(dir) + "/F1" DEV_FEXTN;
+	device_fnames[0x05] = string(dir) + "/05" DEV_FEXTN;
+	string input(opts.instructions/14, 'A');
+	for(size_t i = 0; i<input.size(); i++) input[i] = (i%80 == 79) ? '\n' : 'A' + i%26;
+	if(!write_file(device_fnames[0xf1], input)) bench_error(E_NOWRT(device_fnames[0xf1]));
+
+	printf("best of %d runs%s\n\n", opts.runs, opts.profile ? ", profiled" : "");
+	printf("%-6s %14s %10s %12s\n", "work", "instructions", "seconds", "Minstr/s");
+	time_workload("copy", assemble_image(COPY_SOURCE), opts, device_fnames);
+	source_file output;
+	if(!output.open(device_fnames[0x05]) || output.text() != input + "EOF") bench_error("COPY didn't copy its input");
+	output.close();
+	time_workload("loop", assemble_image(loop_source(max(1LL, opts.instructions/9007))), opts, device_fnames);
+
+	unlink(device_fnames[0xf1].c_str());
+	unlink(device_fnames[0x05].c_str());
+	rmdir(dir);
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+Benchmark of the symbol table against the unordered_map it replaced, with
+1M distinct symbols.
+
+To compile and run use:-
+$g++ -std=c++17 -O2 bench/symtab_bench.cpp -o symtab_bench -pthread
+$./symtab_bench [number of symbols]
+*/
+
+#define NO_MAIN
+#include "../assembler.cpp"
+#include <chrono>
+#include <random>
+
+// seconds taken by f()
+template <typename F> double time_of(F f){
+	auto begin = chrono::steady_clock::now();
+	f();
+	return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+void report(string what, int count, double seconds){
+	printf("%-44s %8.1f ns/op %8.2f Mop/s\n", what.c_str(), 1e9*seconds/count, count/seconds/1e6);
+}
+
+int main(int argc, char** args){
+	int cnt_symbols = (argc > 1) ? atoi(args[1]) : 1000000;
+
+	// distinct names shaped like labels, a letter then base 36 digits, as views of one buffer
+	string buffer = "";
+	vector<pair<size_t, size_t>> spans;
+	for(int i = 0; i<cnt_symbols; i++){
+		size_t begin = buffer.size();
+		buffer += "LBL";
+		for(int n = i; ; n /= 36){
+			buffer += "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[n%36];
+			if(n < 36) break;
+		}
+		spans.push_back({begin, buffer.size()-begin});
+	}
+	vector<string_view> names, misses;
+	for(auto& span: spans) names.push_back(string_view(buffer).substr(span.first, span.second));
+	for(string_view name: names) misses.push_back(name.substr(1)); // never a defined name
+
+	// references in a random order, hashed in advance like the parser does
+	vector<string_view> references = names;
+	shuffle(references.begin(), references.end(), mt19937(1));
+	vector<unsigned> name_hashes, reference_hashes, miss_hashes;
+	for(string_view name: names) name_hashes.push_back(symbol_hash(name));
+	for(string_view name: references) reference_hashes.push_back(symbol_hash(name));
+	for(string_view name: misses) miss_hashes.push_back(symbol_hash(name));
+
+	printf("%d distinct symbols\n", cnt_symbols);
+	long long checksum = 0;
+
+	// the old table, a string key per symbol and a count() then [] per reference
+	{
+		unordered_map<string, int> table;
+		report("unordered_map<string,int> insert", cnt_symbols, time_of([&](){
+			for(int i = 0; i<cnt_symbols; i++) table.insert({string(names[i]), i});
+		}));
+		report("unordered_map<string,int> count+[] hit", cnt_symbols, time_of([&](){
+			for(string_view name: references){
+				string key(name);
+				if(table.count(key)) checksum += table[key];
+			}
+		}));
+		report("unordered_map<string,int> count miss", cnt_symbols, time_of([&](){
+			for(string_view name: misses) checksum += table.count(string(name));
+		}));
+	}
+
+	// the new table, with the hashes the parser computes
+	{
+		symbol_table table;
+		report("symbol_table insert", cnt_symbols, time_of([&](){
+			for(int i = 0; i<cnt_symbols; i++) table.insert(names[i], name_hashes[i], i);
+		}));
+		report("symbol_table find hit (hashed when parsed)", cnt_symbols, time_of([&](){
+			for(int i = 0; i<cnt_symbols; i++){
+				symbol_table::handle h = table.find(references[i], reference_hashes[i]);
+				if(h>=0) checksum += table.value(h);
+			}
+		}));
+		report("symbol_table find hit (hashed here)", cnt_symbols, time_of([&](){
+			for(string_view name: references){
+				symbol_table::handle h = table.find(name);
+				if(h>=0) checksum += table.value(h);
+			}
+		}));
+		report("symbol_table find miss (hashed when parsed)", cnt_symbols, time_of([&](){
+			for(int i = 0; i<cnt_symbols; i++) checksum += (table.find(misses[i], miss_hashes[i]) < 0);
+		}));
+		report("symbol_table insert (reserved)", cnt_symbols, time_of([&](){
+			table.clear();
+			table.reserve(cnt_symbols);
+			for(int i = 0; i<cnt_symbols; i++) table.insert(names[i], name_hashes[i], i);
+		}));
+	}
+
+	printf("checksum %lld\n", checksum);
+	return 0;
+}